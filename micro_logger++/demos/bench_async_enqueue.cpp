@@ -0,0 +1,71 @@
+/*
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/.
+ */
+#include "micro_logger/micro_logger_writer.hpp"
+//
+#include <chrono>
+#include <format>
+#include <iostream>
+#include <memory>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+template <typename T> long long measure_ns(T obj) {
+  auto start = std::chrono::steady_clock::now();
+  obj();
+  auto stop = std::chrono::steady_clock::now();
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(stop - start)
+      .count();
+}
+
+/*
+ * Producer side only: the shared ring has every thread contend on one
+ * write index, the per-thread queues should stay flat as threads are added.
+ */
+template <typename T, typename P>
+void bench_enqueue(std::string_view name, size_t threads_count,
+                   const P &parameters) {
+  constexpr size_t data_set_size = 2000000;
+  constexpr std::string_view line{
+      "[10/17/26 12:00:00.000][0x7f0000000000][main.cpp:042::main][INFO] "
+      "an ordinary log line\n"};
+  std::unique_ptr<micro_logger::BaseWriter> output =
+      std::make_unique<micro_logger::SilentWriter>();
+  T writer(output, parameters);
+  auto exec_time_ns = measure_ns([&writer, threads_count, line]() {
+    std::vector<std::thread> threads;
+    for (size_t t = 0; t < threads_count; ++t) {
+      threads.emplace_back([&writer, threads_count, line]() {
+        for (size_t i = 0; i < data_set_size / threads_count; ++i) {
+          writer.write(line.data(), line.size());
+        }
+      });
+    }
+    for (auto &th : threads) {
+      th.join();
+    }
+  });
+  std::cout << std::format("[{}] threads: {} took {}ms, {:.2f} ns/line", name,
+                           threads_count, exec_time_ns / 1000000,
+                           static_cast<double>(exec_time_ns) / data_set_size)
+            << std::endl;
+}
+
+int main(int argc, char **argv) {
+  for (size_t threads_count : {1, 8, 32, 128}) {
+    // both wait for room instead of dropping, as the per-thread queues do
+    bench_enqueue<micro_logger::AsyncWriter>(
+        "shared ring", threads_count,
+        micro_logger::AsyncWriterParameters{
+            .overflow = micro_logger::OverflowPolicy::block,
+            .block_timeout = std::chrono::seconds(10),
+        });
+    bench_enqueue<micro_logger::PerThreadAsyncWriter>(
+        "per thread", threads_count,
+        micro_logger::PerThreadAsyncWriterParameters{});
+  }
+  return 0;
+}
@@ -0,0 +1,87 @@
+/*
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/.
+ */
+#include "header_formatter.h"
+#include "micro_logger/micro_logger.hpp"
+#include "micro_logger/micro_logger_writer.hpp"
+//
+#include <chrono>
+#include <format>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+template <typename T> long long measure_ns(T obj) {
+  auto start = std::chrono::steady_clock::now();
+  obj();
+  auto stop = std::chrono::steady_clock::now();
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(stop - start)
+      .count();
+}
+
+/*
+ * Steady state: every log call looks its thread's header formatter up,
+ * so this has to stay flat as threads are added.
+ */
+void bench_lookup(size_t threads_count) {
+  constexpr size_t data_set_size = 20000000;
+  auto exec_time_ns = measure_ns([threads_count]() {
+    std::vector<std::thread> threads;
+    for (size_t t = 0; t < threads_count; ++t) {
+      threads.emplace_back([threads_count]() {
+        size_t sum = 0;
+        for (size_t i = 0; i < data_set_size / threads_count; ++i) {
+          sum += micro_logger::init_header_formatter().pattern.size();
+        }
+        if (sum == 0) {
+          std::cerr << "empty pattern" << std::endl;
+        }
+      });
+    }
+    for (auto &th : threads) {
+      th.join();
+    }
+  });
+  std::cout << std::format("[lookup] threads: {} took {}ms, {:.2f} ns/lookup",
+                           threads_count, exec_time_ns / 1000000,
+                           static_cast<double>(exec_time_ns) / data_set_size)
+            << std::endl;
+}
+
+/*
+ * Thread churn: short lived threads logging once pay for rendering the
+ * header on first use and releasing it on exit.
+ */
+void bench_churn() {
+  constexpr size_t data_set_size = 10000;
+  auto thread_ns = measure_ns([]() {
+    for (size_t i = 0; i < data_set_size; ++i) {
+      std::thread([]() {}).join();
+    }
+  });
+  auto exec_time_ns = measure_ns([]() {
+    for (size_t i = 0; i < data_set_size; ++i) {
+      std::thread([]() { micro_logger::init_header_formatter(); }).join();
+    }
+  });
+  std::cout << std::format(
+                   "[churn] threads: {} took {}ms, {:.2f} us/thread, "
+                   "{:.2f} us/thread above a bare thread",
+                   data_set_size, exec_time_ns / 1000000,
+                   static_cast<double>(exec_time_ns) / data_set_size / 1000,
+                   static_cast<double>(exec_time_ns - thread_ns) /
+                       data_set_size / 1000)
+            << std::endl;
+}
+
+int main(int argc, char **argv) {
+  micro_logger::SilentWriter writer;
+  micro_logger::initialize(writer);
+  for (size_t threads_count : {1, 8}) {
+    bench_lookup(threads_count);
+  }
+  bench_churn();
+  return 0;
+}
@@ -0,0 +1,56 @@
+/*
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/.
+ */
+#include "micro_logger/micro_logger.hpp"
+#include "timestamp.h"
+//
+#include <chrono>
+#include <format>
+#include <iostream>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+using TimePoint = std::chrono::system_clock::time_point;
+using GetTime = size_t (*)(char *, TimePoint,
+                           const micro_logger_CustomParameters &);
+
+/*
+ * Reports the cost of rendering one timestamp, with and without the per
+ * thread cache, for one thread and for threads competing on localtime_r.
+ */
+void bench(GetTime get_time, std::string_view desc, size_t threads_count) {
+  constexpr size_t data_set_size = 2000000;
+  auto start = std::chrono::steady_clock::now();
+  std::vector<std::thread> threads;
+  for (size_t t = 0; t < threads_count; ++t) {
+    threads.emplace_back([get_time, threads_count]() {
+      char output[micro_logger::default_parameters.header_size];
+      for (size_t i = 0; i < data_set_size / threads_count; ++i) {
+        get_time(output, std::chrono::system_clock::now(),
+                 micro_logger::default_parameters);
+      }
+    });
+  }
+  for (auto &th : threads) {
+    th.join();
+  }
+  auto stop = std::chrono::steady_clock::now();
+  auto exec_time_ns =
+      std::chrono::duration_cast<std::chrono::nanoseconds>(stop - start)
+          .count();
+  std::cout << std::format("[{}] threads: {} took {}ms, {:.2f} ns/timestamp",
+                           desc, threads_count, exec_time_ns / 1000000,
+                           static_cast<double>(exec_time_ns) / data_set_size)
+            << std::endl;
+}
+
+int main(int argc, char **argv) {
+  for (size_t threads_count : {1, 8}) {
+    bench(micro_logger::get_time_uncached, "uncached", threads_count);
+    bench(micro_logger::get_time, "cached", threads_count);
+  }
+  return 0;
+}
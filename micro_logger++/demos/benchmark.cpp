@@ -9,10 +9,12 @@
 //
 #include <chrono>
 #include <cstdint>
+#include <filesystem>
 #include <format>
 #include <iostream>
 #include <string_view>
 #include <thread>
+#include <unistd.h>
 #include <unordered_map>
 #include <vector>
 
@@ -186,8 +188,6 @@ void bench_thread_local_cache() {
   }
 }
 
-template <typename T>
-concept HasRestartCapability = requires(T t) { t.restart(); };
 /*
  * data to write is 907bytes per one attempt
  * */
@@ -211,9 +211,8 @@ template <typename T> void bench_logging_generic(T &obj) {
         },
         __func__, {"write one thread"}, 907 * data_set_size);
   }
-  if constexpr (HasRestartCapability<T>) {
-    obj.restart();
-  }
+  // drain what an async writer still holds outside of the measurement
+  micro_logger::flush();
   {
     size_t data_set_size = 100;
 
@@ -241,9 +240,8 @@ template <typename T> void bench_logging_generic(T &obj) {
         __func__, {"write multithread"},
         907 * data_set_size * (data_set_size * 10));
   }
-  if constexpr (HasRestartCapability<T>) {
-    obj.restart();
-  }
+  // drain what an async writer still holds outside of the measurement
+  micro_logger::flush();
 }
 
 void bench_logging_bandwidth() {
@@ -252,20 +250,143 @@ void bench_logging_bandwidth() {
   bench_logging_generic(writer);
 }
 
+/*
+ * Writer only: the same rendered line over and over, no formatting
+ * */
+void bench_writer(const micro_logger::BaseWriter &writer,
+                  std::string_view description) {
+  constexpr size_t data_set_size = 5000000;
+  constexpr std::string_view line{
+      "[10/17/26 12:00:00.000][0x7f0000000000][benchmark.cpp:042::main]"
+      "[INFO ] my super shot logging message\n"};
+  bench(
+      [&]() {
+        for (size_t i = 0; i < data_set_size; ++i) {
+          writer.write(line.data(), line.size());
+        }
+        writer.flush();
+      },
+      __func__, description, line.size() * data_set_size);
+}
+
+void bench_file_writers() {
+  {
+    micro_logger::FileWriter writer("/dev/null");
+    bench_writer(writer, "ofstream /dev/null");
+  }
+  {
+    micro_logger::BufferedFileWriter writer("/dev/null");
+    bench_writer(writer, "buffered fd /dev/null");
+  }
+  {
+    micro_logger::BufferedFileWriter writer(
+        "/dev/null", {.flush_interval = std::chrono::milliseconds(1000)});
+    bench_writer(writer, "buffered fd /dev/null, 1s interval");
+  }
+  {
+    std::unique_ptr<micro_logger::BaseWriter> output =
+        std::make_unique<micro_logger::SilentWriter>();
+    micro_logger::FlightRecorderWriter writer(output);
+    bench_writer(writer, "flight recorder, 4 MiB ring");
+  }
+  {
+    // /dev/null can not be mapped, segments go to the temp directory
+    const auto directory = std::filesystem::temp_directory_path() /
+                           std::format("benchmark_mmap_{}", getpid());
+    std::filesystem::create_directory(directory);
+    {
+      micro_logger::BufferedFileWriter writer(
+          (directory / "bench.log").c_str());
+      bench_writer(writer, "buffered fd in temp directory");
+    }
+    {
+      micro_logger::MmapFileWriter writer((directory / "bench.log").c_str());
+      bench_writer(writer, "mmap segments in temp directory");
+    }
+    {
+      micro_logger::UringWriter writer((directory / "bench.log").c_str());
+      bench_writer(writer, writer.is_async()
+                               ? "io_uring in temp directory"
+                               : "io_uring fallback in temp directory");
+    }
+    std::filesystem::remove_all(directory);
+  }
+}
+
+/*
+ * Compressed frames against the plain file: input bandwidth and bytes on
+ * disk for the same varied lines
+ * */
+void bench_compressed_writer() {
+  constexpr size_t data_set_size = 2000000;
+  const auto directory = std::filesystem::temp_directory_path() /
+                         std::format("benchmark_compressed_{}", getpid());
+  std::filesystem::create_directory(directory);
+  constexpr std::string_view pattern{
+      "[10/17/26 12:00:{:02}.{:03}][0x7f0000000000][benchmark.cpp:042::main]"
+      "[INFO ] request {} took {} us\n"};
+  const auto format_line = [&](char *line, size_t i) {
+    return std::format_to(line, pattern, i / 1000 % 60, i % 1000, i,
+                          i * 7919 % 10007);
+  };
+  // same lines for both, their size is known before the measurement
+  size_t input = 0;
+  char line[256];
+  for (size_t i = 0; i < data_set_size; ++i) {
+    input += format_line(line, i) - line;
+  }
+  const std::string_view name{__func__};
+  const auto run = [&](const micro_logger::BaseWriter &writer,
+                       std::string_view description) {
+    bench(
+        [&]() {
+          for (size_t i = 0; i < data_set_size; ++i) {
+            writer.write(line, format_line(line, i) - line);
+          }
+          writer.flush();
+        },
+        name, description, input);
+  };
+  const auto plain_path = directory / "plain.log";
+  {
+    micro_logger::BufferedFileWriter writer(plain_path.c_str());
+    run(writer, "buffered fd");
+  }
+  const auto compressed_path = directory / "compressed.log.gz";
+  try {
+    std::unique_ptr<micro_logger::BaseWriter> file =
+        std::make_unique<micro_logger::BufferedFileWriter>(
+            compressed_path.c_str());
+    micro_logger::CompressedWriter writer(file);
+    run(writer, "gzip frames over buffered fd");
+  } catch (const std::domain_error &e) {
+    // most likely built without zlib
+    std::cout << std::format("[{}] skipped: {}", __func__, e.what())
+              << std::endl;
+    std::filesystem::remove_all(directory);
+    return;
+  }
+  const auto plain = std::filesystem::file_size(plain_path);
+  const auto compressed = std::filesystem::file_size(compressed_path);
+  std::cout << std::format("[{}] on disk: plain {} KB, compressed {} KB, "
+                           "ratio {:.1f}",
+                           __func__, to_kilobytes(plain),
+                           to_kilobytes(compressed),
+                           static_cast<double>(plain) / compressed)
+            << std::endl;
+  std::filesystem::remove_all(directory);
+}
+
+void bench_logging_bandwidth_buffered() {
+  static micro_logger::BufferedFileWriter writer("/dev/null");
+  micro_logger::initialize(writer);
+  bench_logging_generic(writer);
+}
+
 void bench_logging_bandwidth_async() {
   std::unique_ptr<micro_logger::BaseWriter> file_writer =
       std::make_unique<micro_logger::FileWriter>("/dev/null");
-  class AsyncWriterTestImpl : public micro_logger::AsyncWriter {
-  public:
-    using AsyncWriter::AsyncWriter;
-    void restart() {
-      stop();
-      run = true;
-      auto new_th = std::thread([this]() { worker(); });
-      thread.swap(new_th);
-    }
-  };
-  static AsyncWriterTestImpl writer(file_writer);
+  static micro_logger::AsyncWriter writer(file_writer);
   micro_logger::initialize(writer);
   bench_logging_generic(writer);
 }
@@ -277,6 +398,9 @@ int main(int argc, char **argv) {
       {"bytes_to_integral", bench_bytes_to_integral},
       {"thread_local_cache", bench_thread_local_cache},
       {"logging_bandwidth", bench_logging_bandwidth},
+      {"logging_bandwidth_buffered", bench_logging_bandwidth_buffered},
+      {"file_writers", bench_file_writers},
+      {"compressed_writer", bench_compressed_writer},
       {"logging_bandwidth_async", bench_logging_bandwidth_async},
   };
   for (int i = 1; i < argc; i++) {
@@ -7,9 +7,17 @@
 #define MICRO_LOGGER_MICRO_LOGGER_HPP
 
 #include "micro_logger_custom_parameters.h"
+#include "micro_logger_level.h"
 #include "micro_logger_writer.hpp"
 //
+#include <atomic>
+#include <chrono>
+#include <concepts>
+#include <format>
+#include <source_location>
 #include <sstream>
+#include <string_view>
+#include <type_traits>
 
 namespace micro_logger {
 
@@ -52,11 +60,88 @@ void initialize(
     const BaseWriter &,
     const micro_logger_CustomParameters *custom_parameters = nullptr);
 
+/**
+ * @brief Flush the writer passed to `initialize`.
+ *
+ * Waits until every line logged before the call has reached the
+ * destination as far as the writer can tell (see `BaseWriter::flush`),
+ * e.g. before `fork`/`exec` or at a checkpoint.  Lines still queued for
+ * deferred formatting are formatted and written first.  An `AsyncWriter`
+ * keeps its worker running.
+ *
+ * @param[in] timeout  Longest wait, the default waits for good.
+ * @return             False when the timeout expired or the writer failed.
+ */
+bool flush(
+    std::chrono::milliseconds timeout = std::chrono::milliseconds::max());
+
+/**
+ * @brief Log levels ordered by severity.
+ *
+ * Used for the runtime threshold, see `set_level`.  `off` disables every
+ * level.
+ */
+enum class Level : int {
+  trace = MICRO_LOGGER_LEVEL_TRACE,
+  debug = MICRO_LOGGER_LEVEL_DEBUG,
+  info = MICRO_LOGGER_LEVEL_INFO,
+  warn = MICRO_LOGGER_LEVEL_WARN,
+  error = MICRO_LOGGER_LEVEL_ERROR,
+  critical = MICRO_LOGGER_LEVEL_CRITICAL,
+  off = MICRO_LOGGER_LEVEL_OFF,
+};
+
+/**
+ * @brief Set the lowest level which is still logged.
+ *
+ * Can be called at any time and from any thread, e.g. to switch `debug`
+ * on only while investigating an incident.  Defaults to `Level::trace`.
+ *
+ * @param[in] level  Lowest enabled level, `Level::off` disables logging.
+ */
+void set_level(Level level);
+
+/** @brief Return the lowest level which is still logged. */
+Level get_level();
+
+/**
+ * @brief Check @p level against the runtime threshold.
+ *
+ * One relaxed atomic load; the `MSG_*` macros call it before evaluating
+ * any of their arguments.
+ */
+inline bool is_enabled(Level level) {
+  return static_cast<int>(level) >=
+         micro_logger_level_threshold.load(std::memory_order_relaxed);
+}
+
+/**
+ * @brief Move message formatting off the calling thread.
+ *
+ * When enabled, `__logme` only captures the call site, a raw timestamp and
+ * a compact binary copy of the arguments into a per-thread buffer.  A
+ * background thread formats the line and passes it to the writer.  Lines
+ * of one thread keep their order; lines of different threads are merged
+ * in the order the background thread picks them up.  Format strings using
+ * `%n`, `%m` or wide characters are still formatted on the calling thread.
+ *
+ * @param[in] enabled      `true` to defer formatting, `false` to format on
+ *                         the calling thread again once pending lines have
+ *                         been written.
+ * @param[in] buffer_size  Size in bytes of each per-thread buffer.  Applies
+ *                         to threads logging for the first time after the
+ *                         call.  A thread whose buffer is full waits for
+ *                         the background thread.
+ */
+void set_deferred_formatting(bool enabled, size_t buffer_size = 64 * 1024);
+
 /**
  * @brief Convert any streamable object to std::string.
  *
  * Helper template used internally by the library, but also available to
- * callers who need a quick string conversion via operator<<.
+ * callers who need a quick string conversion via operator<<.  With the
+ * std::format API (`micro_logger::info` etc.) prefer specialising
+ * `std::formatter` for user types instead.
  *
  * @tparam T  Type with a `std::ostream& operator<<` overload.
  * @param[in] obj  Object to stringify.
@@ -118,45 +203,188 @@ constexpr const char *LVL_ERROR = "ERROR";
 /** Log level identifiers — `CRITICAL` variant. */
 constexpr const char *LVL_CRITICAL = "CRITI";
 
+/**
+ * @brief Core std::format logging function.
+ *
+ * Type-erased counterpart of `__logme` used by `trace` ... `critical`.
+ * The message is formatted straight into the output line after the
+ * header.  Users should not call this function directly.
+ *
+ * @internal
+ */
+void __logme_format(const char *level, const char *file, const char *func,
+                    int line, std::string_view fmt, std::format_args args);
+
+/**
+ * @brief Compile-time checked format string carrying its call site.
+ *
+ * Implicitly constructed from a string literal; the format string is
+ * validated against @p Args at compile time and the caller's file, function
+ * and line are captured through std::source_location.
+ *
+ * @tparam Args  Types of the arguments passed along with the format string.
+ */
+template <typename... Args> struct FormatString {
+  template <typename T>
+    requires std::convertible_to<const T &, std::string_view>
+  consteval FormatString(
+      const T &fmt,
+      std::source_location location = std::source_location::current())
+      : fmt(fmt), file(basename(location.file_name())),
+        func(location.function_name()), line(location.line()) {}
+
+  std::format_string<Args...> fmt;
+  const char *file;
+  const char *func;
+  int line;
+};
+
+/**
+ * @brief Log with std::format syntax, e.g. `info("{} took {}ms", name, dt)`.
+ *
+ * Arguments are type checked at compile time; user types are supported by
+ * specialising `std::formatter`.  The function name is reported as given
+ * by `std::source_location::function_name()`.  These functions always
+ * format on the calling thread, also in deferred formatting mode.  Being
+ * functions, their arguments are evaluated even when the level is
+ * disabled; only the formatting is skipped.  MICRO_LOGGER_ACTIVE_LEVEL only
+ * strips the MSG_* macros.
+ *
+ * @param[in] fmt   std::format format string.
+ * @param[in] args  Arguments corresponding to @p fmt.
+ */
+template <typename... Args>
+void trace(FormatString<std::type_identity_t<Args>...> fmt, Args &&...args) {
+  if (not is_enabled(Level::trace)) {
+    return;
+  }
+  __logme_format(LVL_TRACE, fmt.file, fmt.func, fmt.line, fmt.fmt.get(),
+                 std::make_format_args(args...));
+}
+
+/** @copydoc trace */
+template <typename... Args>
+void debug(FormatString<std::type_identity_t<Args>...> fmt, Args &&...args) {
+  if (not is_enabled(Level::debug)) {
+    return;
+  }
+  __logme_format(LVL_DEBUG, fmt.file, fmt.func, fmt.line, fmt.fmt.get(),
+                 std::make_format_args(args...));
+}
+
+/** @copydoc trace */
+template <typename... Args>
+void info(FormatString<std::type_identity_t<Args>...> fmt, Args &&...args) {
+  if (not is_enabled(Level::info)) {
+    return;
+  }
+  __logme_format(LVL_INFO, fmt.file, fmt.func, fmt.line, fmt.fmt.get(),
+                 std::make_format_args(args...));
+}
+
+/** @copydoc trace */
+template <typename... Args>
+void warn(FormatString<std::type_identity_t<Args>...> fmt, Args &&...args) {
+  if (not is_enabled(Level::warn)) {
+    return;
+  }
+  __logme_format(LVL_WARN, fmt.file, fmt.func, fmt.line, fmt.fmt.get(),
+                 std::make_format_args(args...));
+}
+
+/** @copydoc trace */
+template <typename... Args>
+void error(FormatString<std::type_identity_t<Args>...> fmt, Args &&...args) {
+  if (not is_enabled(Level::error)) {
+    return;
+  }
+  __logme_format(LVL_ERROR, fmt.file, fmt.func, fmt.line, fmt.fmt.get(),
+                 std::make_format_args(args...));
+}
+
+/** @copydoc trace */
+template <typename... Args>
+void critical(FormatString<std::type_identity_t<Args>...> fmt,
+              Args &&...args) {
+  if (not is_enabled(Level::critical)) {
+    return;
+  }
+  __logme_format(LVL_CRITICAL, fmt.file, fmt.func, fmt.line, fmt.fmt.get(),
+                 std::make_format_args(args...));
+}
+
 } // namespace micro_logger
 
 #ifndef USE_C_VERSION
 
-#ifndef NODEBUG
+#if MICRO_LOGGER_ACTIVE_LEVEL <= MICRO_LOGGER_LEVEL_DEBUG
 #define MSG_DEBUG(fmt, ...)                                                    \
-  micro_logger::__logme(micro_logger::LVL_DEBUG,                               \
-                        micro_logger::basename(__FILE__), __FUNCTION__,        \
-                        __LINE__, fmt, ##__VA_ARGS__)
+  (micro_logger::is_enabled(micro_logger::Level::debug)                        \
+       ? micro_logger::__logme(micro_logger::LVL_DEBUG,                        \
+                               micro_logger::basename(__FILE__), __FUNCTION__, \
+                               __LINE__, fmt, ##__VA_ARGS__)                   \
+       : void())
+#else
+#define MSG_DEBUG(fmt, ...) ((void)0)
+#endif
+#if MICRO_LOGGER_ACTIVE_LEVEL <= MICRO_LOGGER_LEVEL_TRACE
 #define MSG_ENTER()                                                            \
-  micro_logger::__logme(micro_logger::LVL_TRACE,                               \
-                        micro_logger::basename(__FILE__), __FUNCTION__,        \
-                        __LINE__, "%s", "--ENTER--")
+  (micro_logger::is_enabled(micro_logger::Level::trace)                        \
+       ? micro_logger::__logme(micro_logger::LVL_TRACE,                        \
+                               micro_logger::basename(__FILE__), __FUNCTION__, \
+                               __LINE__, "%s", "--ENTER--")                    \
+       : void())
 #define MSG_EXIT()                                                             \
-  micro_logger::__logme(micro_logger::LVL_TRACE,                               \
-                        micro_logger::basename(__FILE__), __FUNCTION__,        \
-                        __LINE__, "%s", "--EXIT--")
+  (micro_logger::is_enabled(micro_logger::Level::trace)                        \
+       ? micro_logger::__logme(micro_logger::LVL_TRACE,                        \
+                               micro_logger::basename(__FILE__), __FUNCTION__, \
+                               __LINE__, "%s", "--EXIT--")                     \
+       : void())
 #else
-#define MSG_DEBUG(fmt, ...)
-#define MSG_ENTER()
-#define MSG_EXIT()
+#define MSG_ENTER() ((void)0)
+#define MSG_EXIT() ((void)0)
 #endif
 
+#if MICRO_LOGGER_ACTIVE_LEVEL <= MICRO_LOGGER_LEVEL_INFO
 #define MSG_INFO(fmt, ...)                                                     \
-  micro_logger::__logme(micro_logger::LVL_INFO,                                \
-                        micro_logger::basename(__FILE__), __FUNCTION__,        \
-                        __LINE__, fmt, ##__VA_ARGS__)
+  (micro_logger::is_enabled(micro_logger::Level::info)                         \
+       ? micro_logger::__logme(micro_logger::LVL_INFO,                         \
+                               micro_logger::basename(__FILE__), __FUNCTION__, \
+                               __LINE__, fmt, ##__VA_ARGS__)                   \
+       : void())
+#else
+#define MSG_INFO(fmt, ...) ((void)0)
+#endif
+#if MICRO_LOGGER_ACTIVE_LEVEL <= MICRO_LOGGER_LEVEL_WARN
 #define MSG_WARN(fmt, ...)                                                     \
-  micro_logger::__logme(micro_logger::LVL_WARN,                                \
-                        micro_logger::basename(__FILE__), __FUNCTION__,        \
-                        __LINE__, fmt, ##__VA_ARGS__)
+  (micro_logger::is_enabled(micro_logger::Level::warn)                         \
+       ? micro_logger::__logme(micro_logger::LVL_WARN,                         \
+                               micro_logger::basename(__FILE__), __FUNCTION__, \
+                               __LINE__, fmt, ##__VA_ARGS__)                   \
+       : void())
+#else
+#define MSG_WARN(fmt, ...) ((void)0)
+#endif
+#if MICRO_LOGGER_ACTIVE_LEVEL <= MICRO_LOGGER_LEVEL_ERROR
 #define MSG_ERROR(fmt, ...)                                                    \
-  micro_logger::__logme(micro_logger::LVL_ERROR,                               \
-                        micro_logger::basename(__FILE__), __FUNCTION__,        \
-                        __LINE__, fmt, ##__VA_ARGS__)
+  (micro_logger::is_enabled(micro_logger::Level::error)                        \
+       ? micro_logger::__logme(micro_logger::LVL_ERROR,                        \
+                               micro_logger::basename(__FILE__), __FUNCTION__, \
+                               __LINE__, fmt, ##__VA_ARGS__)                   \
+       : void())
+#else
+#define MSG_ERROR(fmt, ...) ((void)0)
+#endif
+#if MICRO_LOGGER_ACTIVE_LEVEL <= MICRO_LOGGER_LEVEL_CRITICAL
 #define MSG_CRITICAL(fmt, ...)                                                 \
-  micro_logger::__logme(micro_logger::LVL_CRITICAL,                            \
-                        micro_logger::basename(__FILE__), __FUNCTION__,        \
-                        __LINE__, fmt, ##__VA_ARGS__)
+  (micro_logger::is_enabled(micro_logger::Level::critical)                     \
+       ? micro_logger::__logme(micro_logger::LVL_CRITICAL,                     \
+                               micro_logger::basename(__FILE__), __FUNCTION__, \
+                               __LINE__, fmt, ##__VA_ARGS__)                   \
+       : void())
+#else
+#define MSG_CRITICAL(fmt, ...) ((void)0)
+#endif
 
 #endif // USE_C_VERSION
 
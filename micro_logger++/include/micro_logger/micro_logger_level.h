@@ -0,0 +1,43 @@
+/*
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/.
+ */
+
+#ifndef MICRO_LOGGER_MICRO_LOGGER_LEVEL_H
+#define MICRO_LOGGER_MICRO_LOGGER_LEVEL_H
+
+/// Numeric log levels shared by the C and C++ API, ordered by severity.
+/// Plain macros so they can also be compared by the preprocessor.
+#define MICRO_LOGGER_LEVEL_TRACE 0
+#define MICRO_LOGGER_LEVEL_DEBUG 1
+#define MICRO_LOGGER_LEVEL_INFO 2
+#define MICRO_LOGGER_LEVEL_WARN 3
+#define MICRO_LOGGER_LEVEL_ERROR 4
+#define MICRO_LOGGER_LEVEL_CRITICAL 5
+/// Threshold disabling every level.
+#define MICRO_LOGGER_LEVEL_OFF 6
+
+/// Compile-time minimum level.  MSG_* macros below it expand to a no-op, so
+/// neither their arguments nor their format strings end up in the binary.
+/// Defaults to INFO under NODEBUG and to TRACE otherwise.
+#ifndef MICRO_LOGGER_ACTIVE_LEVEL
+#ifdef NODEBUG
+#define MICRO_LOGGER_ACTIVE_LEVEL MICRO_LOGGER_LEVEL_INFO
+#else
+#define MICRO_LOGGER_ACTIVE_LEVEL MICRO_LOGGER_LEVEL_TRACE
+#endif
+#endif
+
+/// Runtime threshold, the lowest level still logged.  Shared by both APIs
+/// so the C `MSG_*` macros test it with one relaxed load, like the C++ ones;
+/// change it with `set_level` or `micro_logger_set_level`.
+#ifdef __cplusplus
+#include <atomic>
+extern "C" std::atomic<int> micro_logger_level_threshold;
+#else
+#include <stdatomic.h>
+extern _Atomic int micro_logger_level_threshold;
+#endif
+
+#endif // MICRO_LOGGER_MICRO_LOGGER_LEVEL_H
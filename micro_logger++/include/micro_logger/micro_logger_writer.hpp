@@ -6,16 +6,28 @@
 #ifndef MICRO_LOGGER_MICRO_LOGGER_WRITER_HPP
 #define MICRO_LOGGER_MICRO_LOGGER_WRITER_HPP
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
 #include <condition_variable>
+#include <csignal>
 #include <cstdint>
 #include <cstring>
 #include <fstream>
 #include <memory>
 #include <mutex>
+#include <string>
+#include <sys/socket.h>
+#include <sys/uio.h>
 #include <thread>
+#include <unistd.h>
+#include <utility>
+#include <vector>
 
 namespace micro_logger {
 
+enum class Level : int;
+
 /**
  * @brief Abstract interface for a log message sink.
  *
@@ -39,6 +51,82 @@ public:
    */
   virtual size_t write(const char *buf, size_t size) const = 0;
 
+  /**
+   * @brief Write a single log line given as consecutive fragments.
+   *
+   * Lets the logger pass the rendered header and the message without first
+   * assembling them into one buffer.  The default implementation joins the
+   * fragments and forwards them to `write`; writers which can consume
+   * fragments directly (writev(2), ring buffers) should override it.
+   *
+   * @param fragments  Pieces of the log line, in order.
+   * @param count      Number of entries in @p fragments.
+   * @return           Number of bytes actually written.
+   */
+  virtual size_t writev(const iovec *fragments, int count) const;
+
+  /**
+   * @brief Write several complete log lines at once.
+   *
+   * Used by AsyncWriter to hand over everything it drained in one pass.
+   * The default implementation calls `write` for every line; writers that
+   * can coalesce (one writev(2) or send per batch) should override it.
+   *
+   * @param lines  One entry per log line, in order.
+   * @param count  Number of entries in @p lines.
+   * @return       Number of bytes actually written.
+   */
+  virtual size_t write_batch(const iovec *lines, int count) const;
+
+  /**
+   * @brief Write a single log line together with the level it was logged at.
+   *
+   * The logger hands every line over through this call, so writers which
+   * map levels onto their destination (syslog severity, journal priority)
+   * get the level without parsing the formatted line.  The default
+   * implementation ignores @p level and calls `write` for a single
+   * fragment, `writev` otherwise.  Lines queued by AsyncWriter and
+   * PerThreadAsyncWriter reach their output through `write_batch`, without
+   * a level.
+   *
+   * @param level      Level the line was logged at.
+   * @param fragments  Pieces of the log line, in order.
+   * @param count      Number of entries in @p fragments.
+   * @return           Number of bytes actually written.
+   */
+  virtual size_t write_record(Level level, const iovec *fragments,
+                              int count) const;
+
+  /**
+   * @brief Concurrency contract of `write`.
+   *
+   * Writers returning false are serialised by the logger with a global
+   * mutex.  Writers returning true promise that concurrent `write` calls
+   * are safe and keep each line intact, so the logger calls them without
+   * any lock.  Queried once, when the writer is passed to `initialize`.
+   *
+   * @return        True when `write` may be called from many threads at once.
+   */
+  virtual bool is_thread_safe() const { return false; }
+
+  /**
+   * @brief Push everything written so far to the destination.
+   *
+   * Returns once the lines accepted before the call have left the writer's
+   * own buffers (stream buffer, queue), without stopping it.  A zero
+   * @p timeout only asks for the buffers to be pushed without waiting for
+   * queued lines.  The default implementation has nothing to push.
+   *
+   * @param timeout  Longest wait, `milliseconds::max()` waits for good.
+   * @return         False when the timeout expired or the destination
+   *                 reported an error.
+   */
+  virtual bool flush(std::chrono::milliseconds /*timeout*/) const {
+    return true;
+  }
+  /** @brief Same as above, without a time limit. */
+  bool flush() const { return flush(std::chrono::milliseconds::max()); }
+
   BaseWriter(const BaseWriter &) = delete;
   BaseWriter(BaseWriter &&) = delete;
   BaseWriter &operator=(const BaseWriter &) = delete;
@@ -53,6 +141,9 @@ public:
 class SilentWriter : public BaseWriter {
 public:
   size_t write(const char *buf, size_t size) const final;
+  size_t writev(const iovec *fragments, int count) const final;
+  size_t write_batch(const iovec *lines, int count) const final;
+  bool is_thread_safe() const final { return true; }
 };
 
 /**
@@ -61,6 +152,8 @@ public:
 class StandardOutWriter : public BaseWriter {
 public:
   size_t write(const char *buf, size_t size) const final;
+  using BaseWriter::flush;
+  bool flush(std::chrono::milliseconds timeout) const final;
 };
 
 /**
@@ -76,46 +169,699 @@ public:
    */
   explicit FileWriter(const char *path);
   size_t write(const char *buf, size_t size) const final;
+  size_t writev(const iovec *fragments, int count) const final;
+  size_t write_batch(const iovec *lines, int count) const final;
+  using BaseWriter::flush;
+  bool flush(std::chrono::milliseconds timeout) const final;
   ~FileWriter();
 
 private:
   mutable std::ofstream outfile;
 };
 
+/** @brief Construction parameters of BufferedFileWriter. */
+struct BufferedFileWriterParameters {
+  /** Size in bytes of the user-space buffer lines are collected in. */
+  size_t buffer_size{1024 * 1024};
+  /** Write the buffer out once it holds this many bytes, 0 when full. */
+  size_t flush_bytes{0};
+  /**
+   * Write the buffer out when a line arrives and the oldest buffered one is
+   * older than this.  Zero disables it; otherwise every line reads the
+   * clock, which costs about as much as copying it.
+   */
+  std::chrono::milliseconds flush_interval{0};
+  /**
+   * Write the buffer out after an ERROR or CRITICAL line, without
+   * fdatasync(2).  The level only reaches a writer the logger calls
+   * directly, not one behind an AsyncWriter.
+   */
+  bool flush_on_severe{true};
+  /** fdatasync(2) the file on every flush() with a non zero timeout. */
+  bool sync{false};
+};
+
+/**
+ * @brief A writer that collects lines in a large buffer and writes them to
+ * a file descriptor.
+ *
+ * The file is opened with `O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC`.
+ * Lines are copied into the buffer and written out with one write(2) when
+ * it reaches `flush_bytes`, when `flush_interval` has passed, after an
+ * ERROR or CRITICAL line, on `flush()` and on destruction.  Lines which do
+ * not fit in the buffer bypass it.
+ */
+class BufferedFileWriter : public BaseWriter {
+public:
+  /**
+   * @brief Open (or append to) the file at the given path.
+   * @param path        Absolute or relative filesystem path.
+   * @param parameters  Buffer size and flush triggers.
+   * @throw std::domain_error when the file can not be opened.
+   */
+  explicit BufferedFileWriter(const char *path,
+                              const BufferedFileWriterParameters &parameters =
+                                  {});
+  size_t write(const char *buf, size_t size) const final;
+  size_t writev(const iovec *fragments, int count) const final;
+  size_t write_batch(const iovec *lines, int count) const final;
+  /** Buffers the line, then writes the buffer out for ERROR and CRITICAL. */
+  size_t write_record(Level level, const iovec *fragments,
+                      int count) const final;
+  using BaseWriter::flush;
+  bool flush(std::chrono::milliseconds timeout) const final;
+  ~BufferedFileWriter();
+
+private:
+  /** @brief write(2) @p count fragments completely, retrying on EINTR. */
+  bool write_fd(const iovec *fragments, int count) const;
+  /** @brief Write the buffered lines out and empty the buffer. */
+  bool write_buffer() const;
+
+  const BufferedFileWriterParameters parameters;
+  int fd;
+  std::unique_ptr<char[]> buffer;
+  /** Fill level which writes the buffer out. */
+  const size_t threshold;
+  /** `flush_interval` in nanoseconds. */
+  const int64_t interval_ns;
+  /** Bytes of @p buffer holding lines. */
+  mutable size_t used{0};
+  /** Coarse monotonic time the oldest buffered line arrived at. */
+  mutable int64_t oldest_ns{0};
+};
+
+/** @brief Construction parameters of RotatingFileWriter. */
+struct RotatingFileWriterParameters {
+  /** Roll over before the active file grows past this, 0 disables it. */
+  size_t max_size{100 * 1024 * 1024};
+  /**
+   * Roll over whenever local time crosses a multiple of this, e.g. one
+   * hour or one day.  Zero disables it.
+   */
+  std::chrono::seconds interval{0};
+  /** Rotated segments kept, the oldest ones are deleted; 0 keeps all. */
+  size_t max_segments{10};
+  /** Gzip rotated segments, needs the library built with zlib. */
+  bool compress{false};
+  /** Buffering of the active file. */
+  BufferedFileWriterParameters buffering{};
+};
+
+/**
+ * @brief A BufferedFileWriter which rolls over to a new file.
+ *
+ * When the next line would take the active file past `max_size`, or local
+ * time crosses an `interval` boundary, the file is renamed to
+ * `<path>.<YYYYmmdd-HHMMSS>` (with a `.N` suffix on a clash) and writing
+ * goes on in a new file at @p path.  A background thread opens that file
+ * ahead of time as `<path>.next`, so the writing thread only renames the
+ * two files and swaps them.  The same thread writes out the old file's
+ * buffer, closes it, compresses it and deletes old segments, including
+ * those left by earlier runs.
+ */
+class RotatingFileWriter : public BaseWriter {
+public:
+  /**
+   * @brief Open (or append to) the active file at @p path.
+   * @throw std::domain_error when the file can not be opened, or
+   *        compression is asked for without zlib support.
+   */
+  explicit RotatingFileWriter(const char *path,
+                              const RotatingFileWriterParameters &parameters =
+                                  {});
+  size_t write(const char *buf, size_t size) const final;
+  size_t writev(const iovec *fragments, int count) const final;
+  size_t write_batch(const iovec *lines, int count) const final;
+  using BaseWriter::flush;
+  /** Also waits for the buffers of the files rolled over from. */
+  bool flush(std::chrono::milliseconds timeout) const final;
+  /** @brief Finishes pending compression and deletion. */
+  ~RotatingFileWriter();
+
+private:
+  /** @brief True when @p size more bytes have to go to a new file. */
+  bool is_due(size_t size) const;
+  /** @brief Rename the active file and swap in the prepared one. */
+  void rotate() const;
+  /**
+   * @brief Rename the active file to a free segment name.
+   * @return The segment name, empty when the rename failed.
+   */
+  std::string rename_active() const;
+  /** @brief Next multiple of `interval` in local time, in seconds. */
+  int64_t next_boundary() const;
+  /** @brief Background thread entry point — compresses and deletes. */
+  void housekeeping();
+
+  /** A file rolled over from, its buffer may not be written out yet. */
+  struct Retired {
+    std::unique_ptr<BufferedFileWriter> writer;
+    /** Name it was renamed to, empty for a retention pass only. */
+    std::string segment;
+  };
+
+  const std::string path;
+  /** Where the next active file is opened ahead of a rollover. */
+  const std::string staging;
+  const RotatingFileWriterParameters parameters;
+  mutable std::unique_ptr<BufferedFileWriter> active;
+  /** Bytes in the active file. */
+  mutable size_t written{0};
+  /** Wall clock second the active file has to be rotated at. */
+  mutable int64_t rotate_at{0};
+  /** Timestamp of the last segment and how many more shared it. */
+  mutable std::string last_stamp;
+  mutable int clash{0};
+  /** Guards @p next, @p rotated, @p prepare, @p unflushed and @p run. */
+  mutable std::mutex sync;
+  mutable std::condition_variable cv;
+  /** Signalled when a retired file's buffer has been written out. */
+  mutable std::condition_variable retired;
+  /** File opened at @p staging, null until the background thread did. */
+  mutable std::unique_ptr<BufferedFileWriter> next;
+  /** Asks the background thread for a new @p next. */
+  mutable bool prepare{true};
+  /** Files rolled over from, waiting to be closed and compressed. */
+  mutable std::vector<Retired> rotated;
+  /** Retired files whose buffer has not been written out yet. */
+  mutable size_t unflushed{0};
+  bool run{true};
+  std::thread thread;
+};
+
+/** @brief Construction parameters of MmapFileWriter. */
+struct MmapFileWriterParameters {
+  /** Bytes preallocated and mapped per segment, the longest line too. */
+  size_t segment_size{64 * 1024 * 1024};
+  /** flush() waits for msync(2) instead of only starting writeback. */
+  bool sync{false};
+};
+
+/**
+ * @brief A writer appending lines to memory-mapped, preallocated segments.
+ *
+ * Segments are files named `<path>.<NNNNNN>`, numbered past the ones already
+ * on disk.  Each is fallocate'd to `segment_size` and mapped; a line is one
+ * atomic reservation of the write offset and a memcpy, no syscall and no
+ * lock, so many threads write at once.  A background thread preallocates
+ * and maps the next segment ahead of time; the thread whose line does not
+ * fit waits for the lines before it and swaps that one in.  The background
+ * thread then starts writeback of the full segment, unmaps it and truncates
+ * it to its content.
+ *
+ * The mapping is shared, so written lines survive a crash of the process in
+ * the page cache; the active segment is then left zero-padded to its full
+ * size.  Lines longer than a segment, and every line after a segment failed
+ * to open, are dropped.
+ */
+class MmapFileWriter : public BaseWriter {
+public:
+  /**
+   * @brief Create and map the first segment.
+   * @throw std::domain_error when it can not be created.
+   */
+  explicit MmapFileWriter(const char *path,
+                          const MmapFileWriterParameters &parameters = {});
+  size_t write(const char *buf, size_t size) const final;
+  size_t writev(const iovec *fragments, int count) const final;
+  /** The whole batch takes one reservation. */
+  size_t write_batch(const iovec *lines, int count) const final;
+  bool is_thread_safe() const final { return true; }
+  using BaseWriter::flush;
+  /**
+   * Starts writeback of the active segment, waits for it with `sync`.  Also
+   * waits for the full segments to be truncated.
+   */
+  bool flush(std::chrono::milliseconds timeout) const final;
+  /** @brief Truncates the active segment to its content. */
+  ~MmapFileWriter();
+
+private:
+  struct Segment {
+    std::string name;
+    int fd{-1};
+    char *base{nullptr};
+    size_t capacity{0};
+    /** Bytes handed out, runs past `capacity` once the segment is full. */
+    std::atomic<size_t> reserved{0};
+    /** Bytes copied in. */
+    std::atomic<size_t> committed{0};
+  };
+  /** @brief Copy @p size bytes of @p fragments in, rolling when full. */
+  size_t append(const iovec *fragments, int count, size_t size) const;
+  /** @brief Map the next free segment, nullptr on failure. */
+  std::unique_ptr<Segment> open_segment();
+  /** @brief Replace @p segment, holding @p length bytes, by the next one. */
+  void roll(Segment *segment, size_t length) const;
+  /** @brief Write back, unmap and truncate @p segment to @p length. */
+  void close_segment(Segment &segment, size_t length) const;
+  /** @brief Prepare the next segment and close the full ones. */
+  void housekeeping();
+
+  const std::string path;
+  const MmapFileWriterParameters parameters;
+  mutable std::atomic<Segment *> active{nullptr};
+  /** Set when a segment could not be opened, the writer drops lines. */
+  mutable std::atomic<bool> broken{false};
+  /**
+   * Guards @p segments, @p next, @p prepare, @p failed, @p full,
+   * @p unclosed, @p run and the active segment against being closed.
+   */
+  mutable std::mutex sync;
+  mutable std::condition_variable cv;
+  /** Signalled when @p next is ready or a full segment was closed. */
+  mutable std::condition_variable ready;
+  /**
+   * Every segment ever opened: a thread may still hold a pointer to a
+   * retired one, only to find out it is full.  Unmapped ones are tiny.
+   */
+  mutable std::vector<std::unique_ptr<Segment>> segments;
+  /** Mapped ahead by the background thread, swapped in by roll(). */
+  mutable std::unique_ptr<Segment> next;
+  /** Asks the background thread for a new @p next. */
+  mutable bool prepare{true};
+  /** The background thread could not open @p next. */
+  mutable bool failed{false};
+  /** Full segments with the length of their content, to be closed. */
+  mutable std::vector<std::pair<Segment *, size_t>> full;
+  /** Full segments not closed yet. */
+  mutable size_t unclosed{0};
+  /**
+   * Past the segments on disk at construction, only opened by the
+   * background thread once it runs.
+   */
+  unsigned next_index;
+  bool run{true};
+  std::thread thread;
+};
+
+/** @brief Construction parameters of UringWriter. */
+struct UringWriterParameters {
+  /** Size of each of the two registered buffers lines are collected in. */
+  size_t buffer_size{1024 * 1024};
+};
+
+/**
+ * @brief A file or socket writer which leaves the waiting to io_uring.
+ *
+ * Lines are copied into one of two buffers registered with the ring.  Once
+ * the previous write completed, the filled buffer goes out as a single
+ * IORING_OP_WRITE_FIXED and the call returns without waiting for it, so a
+ * slow disk or peer only stalls the caller when the second buffer fills up
+ * too.  One write is in flight at a time, which keeps the lines in order
+ * and lets a short write be finished before the next one.  Meant as the
+ * output of AsyncWriter, whose worker then keeps draining the queue.
+ *
+ * Without io_uring (built without the kernel header, or refused by the
+ * kernel at runtime) it falls back to a blocking writev(2) per call.
+ */
+class UringWriter : public BaseWriter {
+public:
+  /**
+   * @brief Open (or append to) the file at @p path.
+   * @throw std::domain_error when the file can not be opened.
+   */
+  explicit UringWriter(const char *path,
+                       const UringWriterParameters &parameters = {});
+  /**
+   * @brief Write to an open file or connected socket.
+   * @param fd  Stays owned by the caller and open while the writer lives.
+   */
+  explicit UringWriter(int fd, const UringWriterParameters &parameters = {});
+  size_t write(const char *buf, size_t size) const final;
+  size_t writev(const iovec *fragments, int count) const final;
+  size_t write_batch(const iovec *lines, int count) const final;
+  using BaseWriter::flush;
+  /**
+   * Submits the collected lines; waits for them unless @p timeout is zero,
+   * which only waits for the write already in flight.
+   */
+  bool flush(std::chrono::milliseconds timeout) const final;
+  /** @brief True when writes go through io_uring, not the fallback. */
+  bool is_async() const;
+  ~UringWriter();
+
+private:
+  struct Ring;
+  /** @brief Set up the ring and its buffers, falls back without them. */
+  void setup();
+  /** @brief Copy @p size bytes of @p fragments into the fill buffer. */
+  size_t append(const iovec *fragments, int count, size_t size) const;
+  /** @brief Hand the fill buffer to the ring, the other one takes over. */
+  void submit() const;
+  /**
+   * @brief Queue the write of what is left of the buffer in flight.
+   * @return false when the ring refused it and writing it directly failed.
+   */
+  bool start() const;
+  /**
+   * @brief Reap the write in flight, finishing it when it was short.
+   * @param wait  Block until it is done instead of only looking.
+   * @return      False when it failed; its lines are lost.
+   */
+  bool complete(bool wait) const;
+  /** @brief Plain blocking write(2) of @p count fragments. */
+  bool write_fd(const iovec *fragments, int count) const;
+
+  const UringWriterParameters parameters;
+  int fd;
+  const bool owns_fd;
+  std::unique_ptr<Ring> ring;
+};
+
+/** @brief What NetworkWriter does with lines while it is disconnected. */
+enum class DisconnectedPolicy {
+  /** Keep them for the next connection, as long as the buffer has room. */
+  buffer,
+  /** Drop them; only lines written while connected are sent. */
+  drop,
+};
+
+/** @brief Construction parameters of NetworkWriter. */
+struct NetworkWriterParameters {
+  /** Bytes waiting to be sent, lines which do not fit are dropped. */
+  size_t buffer_size{4 * 1024 * 1024};
+  /** Behaviour while there is no connection. */
+  DisconnectedPolicy disconnected{DisconnectedPolicy::buffer};
+  /** First delay before reconnecting, doubled on every failed attempt. */
+  std::chrono::milliseconds min_backoff{100};
+  /** Longest delay between two reconnect attempts. */
+  std::chrono::milliseconds max_backoff{30000};
+  /** Longest wait for connect(2) to complete. */
+  std::chrono::milliseconds connect_timeout{1000};
+};
+
 /**
  * @brief A writer that sends log messages over a TCP connection.
  *
- * Connects to the given address:port and writes each log line as a
- * newline-terminated message.  If the connection drops the writer
- * automatically attempts to reconnect.
+ * Each log line is sent as a newline-terminated message to address:port.
+ * `write` only appends the line to a bounded buffer; a background thread
+ * owns the socket and sends whatever accumulated in large send(2) calls
+ * with MSG_NOSIGNAL, so a stalled or missing collector never blocks the
+ * logging threads.  The thread connects, and reconnects when the
+ * connection drops, with exponential backoff; lines queued meanwhile are
+ * kept or dropped according to `disconnected`.  A line cut by a broken
+ * connection is sent again in full.  Lines which do not fit the buffer are
+ * dropped, counted, and reported in the stream as "N messages dropped".
  * Receiving server can be emulated by netcat -l -p \p {port}
  */
 class NetworkWriter : public BaseWriter {
 public:
   /**
-   * @brief Connect to the given remote endpoint.
-   * @param address  IP address or hostname (e.g. `"127.0.0.1"`).
-   * @param port     TCP port number (e.g. `55514`).
+   * @brief Start connecting to the given remote endpoint.
+   * @param address     IPv4 address (e.g. `"127.0.0.1"`).
+   * @param port        TCP port number (e.g. `55514`).
+   * @param parameters  Buffer size, disconnected policy and backoff.
+   * @throw std::domain_error when @p address is not an IPv4 address.
    */
-  explicit NetworkWriter(const std::string &address, int port);
+  explicit NetworkWriter(const std::string &address, int port,
+                         const NetworkWriterParameters &parameters = {});
+  /** @return 0 when the line was dropped. */
   size_t write(const char *buf, size_t size) const final;
+  size_t writev(const iovec *fragments, int count) const final;
+  size_t write_batch(const iovec *lines, int count) const final;
+  bool is_thread_safe() const final { return true; }
+  using BaseWriter::flush;
+  /** Waits until the collector has been handed every line written so far. */
+  bool flush(std::chrono::milliseconds timeout) const final;
+  /** @brief Lines dropped so far. */
+  uint64_t dropped() const;
+  /** @brief Sends what is queued if connected, then disconnects. */
   ~NetworkWriter();
 
+protected:
+  /**
+   * @brief Start connecting a socket of @p type to @p destination.
+   * @param destination  Address and its length.
+   * @param type         SOCK_STREAM, or a message type sending each line
+   *                     as its own datagram.
+   */
+  NetworkWriter(const std::pair<sockaddr_storage, socklen_t> &destination,
+                int type, const NetworkWriterParameters &parameters);
+
 private:
+  /** @brief Background thread entry point — connects and sends. */
+  void sender();
+  /** @brief Open a connection, -1 when it failed or timed out. */
+  int connect_socket() const;
+  /** @brief Wait until @p sock takes more, false when giving up on it. */
+  bool wait_writable(int sock) const;
+  /** @brief Send @p size bytes, false when the connection broke. */
+  bool send_all(int sock, const char *data, size_t size, size_t &sent) const;
+  /**
+   * @brief Send the lines ending at @p ends as one message each, batched
+   *        with sendmmsg(2); @p sent counts the lines sent.
+   * @return False when the connection broke.
+   */
+  bool send_messages(int sock, const std::vector<char> &data,
+                     const std::vector<size_t> &ends, size_t &sent) const;
+
+  const NetworkWriterParameters parameters;
+  const std::pair<sockaddr_storage, socklen_t> destination;
+  const int type;
+  /** Guards everything below. */
+  mutable std::mutex sync;
+  /** Wakes the sender. */
+  mutable std::condition_variable cv;
+  /** Signalled when the sender handed everything over. */
+  mutable std::condition_variable flushed;
+  /** Lines written and not yet taken by the sender. */
+  mutable std::vector<char> pending;
+  /** End offset of every line in @p pending, for message sockets. */
+  mutable std::vector<size_t> pending_ends;
+  /** Bytes taken by the sender and not yet sent, for flush(). */
+  mutable size_t in_flight{0};
+  mutable bool connected{false};
+  mutable bool sender_waiting{false};
+  mutable uint64_t lost{0};
+  bool run{true};
+  std::thread thread;
+};
+
+/** @brief Socket type of UnixSocketWriter. */
+enum class UnixSocketType {
+  /** SOCK_STREAM, lines are coalesced into large sends. */
+  stream,
+  /** SOCK_SEQPACKET, one message per line on a connection. */
+  seqpacket,
+  /** SOCK_DGRAM, one datagram per line. */
+  datagram,
+};
+
+/**
+ * @brief A NetworkWriter for a local agent listening on an AF_UNIX socket.
+ *
+ * Skips the TCP stack of a loopback connection.  A @p path starting with
+ * `@` names an address in the abstract namespace, without a file.  The
+ * message types keep one line per message and hand up to 64 of them to a
+ * single sendmmsg(2); a line too long for one is dropped.
+ */
+class UnixSocketWriter : public NetworkWriter {
+public:
+  /**
+   * @brief Start connecting to the socket at @p path.
+   * @throw std::domain_error when @p path does not fit an AF_UNIX address.
+   */
+  explicit UnixSocketWriter(const std::string &path,
+                            UnixSocketType type = UnixSocketType::stream,
+                            const NetworkWriterParameters &parameters = {});
+};
+
+/** @brief Construction parameters of SyslogWriter. */
+struct SyslogWriterParameters {
+  /** Datagram socket of the local daemon, unused when `port` is set. */
+  std::string path{"/dev/log"};
+  /** IPv4 address of a remote collector, used with `port`. */
+  std::string address{"127.0.0.1"};
+  /** UDP port of a remote collector, 0 sends to `path`. */
+  int port{0};
+  /** Facility code, 1 (user) by default, 16 to 23 are local0 to local7. */
+  int facility{1};
+  /** APP-NAME field, the program name when empty. */
+  std::string app_name{};
+  /** HOSTNAME field, gethostname(2) when empty. */
+  std::string hostname{};
+};
+
+/**
+ * @brief A writer that sends RFC 5424 syslog messages.
+ *
+ * Each line becomes one datagram on an unconnected socket, to the local
+ * daemon at `path` or to a collector over UDP, so a restarted daemon is
+ * picked up without reconnecting.  The severity comes from the level the
+ * line was logged at; lines without one (plain `write`) are sent as
+ * informational.  The trailing newline is dropped, the formatted line is
+ * the MSG part.  Like syslog(3), a send waits while the daemon's queue is
+ * full; a line which fails to send is counted in `dropped`.
+ */
+class SyslogWriter : public BaseWriter {
+public:
+  /** @throw std::domain_error when the socket or address is unusable. */
+  explicit SyslogWriter(const SyslogWriterParameters &parameters = {});
+  ~SyslogWriter();
+  size_t write(const char *buf, size_t size) const final;
+  size_t writev(const iovec *fragments, int count) const final;
+  size_t write_record(Level level, const iovec *fragments,
+                      int count) const final;
+  bool is_thread_safe() const final { return true; }
+  /** @brief Lines which failed to send so far. */
+  uint64_t dropped() const;
+
+private:
+  /** @brief Send one message of @p severity, the header comes first. */
+  size_t send(int severity, const iovec *fragments, int count) const;
+
+  const int facility;
+  const std::pair<sockaddr_storage, socklen_t> destination;
+  /** HOSTNAME, APP-NAME, PROCID, MSGID and STRUCTURED-DATA fields. */
+  const std::string fields;
   int sock;
-  int client_fd;
-  std::string address;
-  int port;
-  void reconnect();
-  void reset_socket();
+  mutable std::atomic<uint64_t> lost{0};
+};
+
+/** @brief Construction parameters of JournalWriter. */
+struct JournalWriterParameters {
+  /** Native protocol socket of systemd-journald. */
+  std::string path{"/run/systemd/journal/socket"};
+  /** SYSLOG_IDENTIFIER field, the program name when empty. */
+  std::string identifier{};
 };
 
 /**
- * @brief A lock-free (mutex-protected) ring-buffer writer.
+ * @brief A writer that sends entries with the systemd journal native
+ *        protocol.
  *
- * Producer threads call `write()` which copies the log line into a free
- * slot and signals a background worker thread.  The worker drains the
- * queue and forwards messages to the wrapped downstream writer.
+ * Each line becomes one datagram with PRIORITY, SYSLOG_IDENTIFIER and
+ * MESSAGE fields, the message in the binary form so it may hold any byte.
+ * Entries too large for a datagram are written to a sealed memfd which is
+ * passed to journald instead.  PRIORITY comes from the level the line was
+ * logged at, informational for plain `write`.  A line which fails to send
+ * is counted in `dropped`.
+ */
+class JournalWriter : public BaseWriter {
+public:
+  /** @throw std::domain_error when @p path does not fit a socket address. */
+  explicit JournalWriter(const JournalWriterParameters &parameters = {});
+  ~JournalWriter();
+  size_t write(const char *buf, size_t size) const final;
+  size_t writev(const iovec *fragments, int count) const final;
+  size_t write_record(Level level, const iovec *fragments,
+                      int count) const final;
+  bool is_thread_safe() const final { return true; }
+  /** @brief Lines which failed to send so far. */
+  uint64_t dropped() const;
+
+private:
+  /** @brief Send one entry of @p priority. */
+  size_t send(int priority, const iovec *fragments, int count) const;
+  /** @brief Pass the entry in @p parts through a memfd. */
+  bool send_memfd(const iovec *parts, int count) const;
+
+  const std::pair<sockaddr_storage, socklen_t> destination;
+  /** Fields before MESSAGE, one per priority. */
+  std::string headers[8];
+  int sock;
+  mutable std::atomic<uint64_t> lost{0};
+};
+
+/** @brief What AsyncWriter does with a line when its ring is full. */
+enum class OverflowPolicy {
+  /** Drop the line being written; the caller gets 0 back. */
+  drop_newest,
+  /** Wait up to `block_timeout` for room, then drop the line. */
+  block,
+  /**
+   * Keep the newest lines: the worker discards the oldest queued ones
+   * without writing them.  The caller waits while that happens, up to
+   * `block_timeout` when the worker is stuck in the downstream writer,
+   * then drops the line.
+   */
+  overwrite_oldest,
+  /**
+   * Write the line to the downstream writer from the calling thread,
+   * ahead of the lines still queued.
+   */
+  write_through,
+};
+
+/** @brief How the AsyncWriter worker waits for lines once the ring is empty. */
+enum class WaitStrategy {
+  /** Park on a condition variable straight away; cheapest on shared hosts. */
+  block,
+  /**
+   * Spin a little, then yield, then park.  Under steady load the worker
+   * rarely parks, so producers rarely pay for a wakeup.
+   */
+  spin_yield_park,
+  /**
+   * Never park; producers never wake the worker up.  Burns a core, meant
+   * to be combined with `cpu`.
+   */
+  busy_spin,
+};
+
+/** @brief Construction parameters of AsyncWriter. */
+struct AsyncWriterParameters {
+  /** Ring size in bytes, rounded up to a multiple of 8. */
+  size_t capacity{1024 * 1024};
+  /** Behaviour when the ring is full. */
+  OverflowPolicy overflow{OverflowPolicy::drop_newest};
+  /**
+   * Longest wait of a producer under OverflowPolicy::block and
+   * OverflowPolicy::overwrite_oldest.
+   */
+  std::chrono::milliseconds block_timeout{100};
+  /** Most lines handed to one `write_batch` call, at most IOV_MAX. */
+  size_t max_batch_lines{256};
+  /**
+   * How long the worker may hold a partial batch back waiting for more
+   * lines.  Zero forwards whatever is ready right away.
+   */
+  std::chrono::microseconds linger{0};
+  /** How the worker waits on an empty ring. */
+  WaitStrategy wait{WaitStrategy::block};
+  /** Core the worker thread is pinned to, -1 leaves it to the scheduler. */
+  int cpu{-1};
+};
+
+/** @brief Overflow counters of AsyncWriter, in lines. */
+struct AsyncWriterStatistics {
+  /** Lost under drop_newest, or after block_timeout under block. */
+  uint64_t dropped;
+  /** Writes which had to wait for room under block. */
+  uint64_t blocked;
+  /** Queued lines discarded under overwrite_oldest. */
+  uint64_t overwritten;
+  /** Lines written from the caller thread under write_through. */
+  uint64_t written_through;
+};
+
+/**
+ * @brief A lock-free multi-producer/single-consumer ring-buffer writer.
+ *
+ * Log lines are stored as variable-length records in a byte ring, each
+ * one an 8 byte header holding the length followed by the line, padded to
+ * 8 bytes.  Producer threads call `write()` which reserves room for its
+ * record with a compare-and-swap on @p write_index, copies the line in and
+ * publishes it by storing the header.  A record which would cross the end
+ * of the ring is preceded by a padding record and starts at offset 0.
+ * A background worker thread drains the records in order, forwards them
+ * to the wrapped downstream writer and zeroes the consumed bytes, so the
+ * next lap only sees headers stored by producers.
+ *
+ * The worker forwards all contiguous ready records in one `write_batch`
+ * call, bounded by `max_batch_lines` and optionally held back for
+ * `linger` to let a batch grow; the lines are passed straight from the
+ * ring, without copying.
+ *
+ * Producers never take a lock; the worker is only woken up (through
+ * @p cv) when it is actually parked, so enqueue cost stays flat as the
+ * number of producer threads grows.  The WaitStrategy decides how soon an
+ * idle worker parks, trading a core for fewer wakeups.  A full ring is
+ * handled according to the OverflowPolicy; lines lost that way are counted
+ * and reported in the stream as "N messages dropped" once the ring has
+ * drained.
  *
  * This class decouples the fast path (producer side) from the slow
  * I/O path, improving latency for log-heavy hot loops.
@@ -124,10 +870,45 @@ class AsyncWriter : public BaseWriter {
 public:
   /**
    * @brief Wrap the given downstream writer.
-   * @param output  Ownership is transferred to AsyncWriter.
+   * @param output      Ownership is transferred to AsyncWriter.
+   * @param parameters  Ring size and overflow behaviour.  Lines longer than
+   *                    `max_line_size()` are truncated.
    */
-  explicit AsyncWriter(std::unique_ptr<BaseWriter> &output);
+  explicit AsyncWriter(std::unique_ptr<BaseWriter> &output,
+                       const AsyncWriterParameters &parameters = {});
+  /** @return 0 when the line was dropped because the ring is full. */
   size_t write(const char *buf, size_t size) const final;
+  /** Fragments are copied straight into the reserved record. */
+  size_t writev(const iovec *fragments, int count) const final;
+  /** Producers only touch atomics; @p output is driven by the worker. */
+  bool is_thread_safe() const final { return true; }
+  /** Longest line stored in one piece, half of the ring minus a header. */
+  inline size_t max_line_size() const {
+    return std::min<size_t>(capacity / 2 - sizeof(RecordHeader), padding - 2);
+  }
+  /**
+   * @brief Wait until every line enqueued before the call has been handed
+   * to @p output, then flush @p output.  The worker keeps running.
+   */
+  using BaseWriter::flush;
+  bool flush(std::chrono::milliseconds timeout) const final;
+  /** @brief Snapshot of the overflow counters. */
+  AsyncWriterStatistics statistics() const;
+  /**
+   * @brief Write the queued lines out when the process crashes.
+   *
+   * Opt-in.  Installs, once per process, handlers for SIGSEGV, SIGBUS,
+   * SIGFPE, SIGILL, SIGABRT and std::terminate.  On a signal the records
+   * still in the ring are written, then the previous handler is restored
+   * and the signal raised again.  On std::terminate the writer is first
+   * flushed normally for up to a second.  Lines the worker was writing at
+   * the time of the crash may show up twice.
+   *
+   * @param fd  Descriptor the lines go to with write(2), the wrapped
+   *            writer is not async-signal-safe.
+   * @throw std::domain_error when too many writers are registered.
+   */
+  void install_crash_handler(int fd = STDERR_FILENO);
   ~AsyncWriter();
 
 protected:
@@ -135,49 +916,433 @@ protected:
   void stop();
   /** @brief Worker thread entry point — drains the queue. */
   void worker();
-  /** @brief Find a free slot in the ring buffer, or -1 if full. */
-  int64_t find_available_entry() const;
+  /** @brief True when the record at byte @p index has been published. */
+  bool is_ready(uint64_t index) const;
+  /** @brief Wake the worker up if it is parked on @p cv. */
+  void notify() const;
+  /** @brief Wait for the record at @p index or stop(), see WaitStrategy. */
+  void wait_for_data(uint64_t index);
+  /**
+   * @brief Reserve room for a line of @p size bytes.
+   * @param[out] offset  Where the record starts in @p data.
+   * @return false when the ring is full.
+   */
+  bool reserve(size_t size, size_t &offset) const;
+  /** @brief Wait on @p space_cv until reserve() succeeds, see the policy. */
+  bool wait_for_room(size_t size, size_t &offset) const;
+  /** @brief True when a zero timeout flush() waits for @p index. */
+  bool is_flush_requested(uint64_t index) const;
+  /** @brief Flush @p output once the worker got past a flush_target. */
+  void flush_output_if_requested(uint64_t index);
+  /** @brief Hand lines to @p output, serialised under write_through. */
+  void forward(const iovec *lines, int count);
+  /** @brief Zero the drained bytes up to @p end and give them back. */
+  void release(uint64_t index, uint64_t end);
+  /**
+   * @brief Write the published records not yet released, from a signal
+   * handler; stops at the first unpublished one.
+   */
+  void drain_on_crash() const;
+  /** @brief Signal handler installed by install_crash_handler(). */
+  static void on_crash_signal(int signal);
+  /** @brief std::terminate handler installed by install_crash_handler(). */
+  static void on_terminate();
 
 protected:
   /**
-   * @brief One slot in the ring buffer.
-   *
-   * `size == 0` means the slot is free; `size > 0` means it holds a
-   * pending log line waiting to be drained by the worker.
-   */
-  struct Entry {
-    /** One ring-bucket: a line buffer plus its length (0 = free). */
-    char line[128 + 1024 + 1];
-    /** Payload length; zero means the slot is free. */
-    size_t size;
-    /** True when the slot holds a pending log line. */
-    inline bool is_taken() { return size != 0; }
-    /** Return the slot to the pool by zeroing its length. */
-    inline void reclaim() { size = 0; }
-    /** Copy @p in bytes from @p in into @p line and record the length. */
-    inline void update(const char *in, size_t size) {
-      std::memcpy(line, in, size);
-      this->size = size;
-    }
+   * @brief Header in front of every record in @p data.
+   *
+   * @p length is 0 while the record is not published, `size + 1` for a
+   * line of `size` bytes and `padding` for the filler in front of a wrap.
+   * It is only accessed through std::atomic_ref.
+   */
+  struct RecordHeader {
+    uint32_t length;
+    uint32_t reserved;
   };
+  static constexpr uint32_t padding{UINT32_MAX};
+
+  /** Bytes taken in the ring by a record carrying @p size bytes. */
+  static constexpr size_t record_size(size_t size) {
+    return (sizeof(RecordHeader) + size + 7) & ~size_t{7};
+  }
+  /** Length word of the record starting at byte @p offset of @p data. */
+  inline std::atomic_ref<uint32_t> length_at(size_t offset) const {
+    return std::atomic_ref<uint32_t>(
+        reinterpret_cast<RecordHeader *>(data + offset)->length);
+  }
 
 protected:
-  /** Number of slots in the ring buffer. */
-  static constexpr int64_t max_entries{1000};
   /** Destination writer (forwarded to in the worker thread). */
   mutable std::unique_ptr<BaseWriter> output;
-  /** Ring buffer of Entry slots shared between producer and worker threads. */
-  mutable std::array<Entry, max_entries> queue;
-  /** Guards @p output, @p queue, @p run, and @p current_entry_index. */
+  const AsyncWriterParameters parameters;
+  /** Size of @p data in bytes, a multiple of 8. */
+  const size_t capacity;
+  /** Backing store of the ring, 8 byte aligned and zeroed. */
+  std::unique_ptr<uint64_t[]> storage;
+  /** Ring bytes shared between producer and worker threads. */
+  char *data;
+  /** Byte position where the next record will be reserved. */
+  alignas(64) mutable std::atomic<uint64_t> write_index;
+  /** Byte position of the next record to drain (written by the worker). */
+  alignas(64) std::atomic<uint64_t> read_index;
+  /** True while the worker is (about to be) parked on @p cv. */
+  alignas(64) mutable std::atomic<bool> sleeping;
+  /** Producers and flush() callers parked on @p space_cv. */
+  mutable std::atomic<uint32_t> waiting_producers{0};
+  /** Records starting below this position are discarded, not written. */
+  mutable std::atomic<uint64_t> discard_until{0};
+  /** Overflow counters, touched on the overflow path only. */
+  mutable std::atomic<uint64_t> dropped{0};
+  mutable std::atomic<uint64_t> blocked{0};
+  mutable std::atomic<uint64_t> overwritten{0};
+  mutable std::atomic<uint64_t> written_through{0};
+  /** Descriptor drain_on_crash() writes to. */
+  std::atomic<int> crash_fd{STDERR_FILENO};
+  /** flush() with a zero timeout wants @p output flushed past here. */
+  mutable std::atomic<uint64_t> flush_target{0};
+  /** Position @p output was last flushed at (worker only). */
+  uint64_t flushed_to{0};
+  /** Lost lines already reported in the stream (worker only). */
+  uint64_t reported_lost{0};
+  /** Guards parking of the worker thread and of waiting producers. */
   mutable std::mutex sync;
-  /** Signalled when a new entry is enqueued. */
+  /** Signalled when a new entry is enqueued while the worker is parked. */
   mutable std::condition_variable cv;
+  /** Signalled when the worker frees room while producers wait for it. */
+  mutable std::condition_variable space_cv;
+  /** Serialises @p output between the worker, flush() and write_through. */
+  mutable std::mutex output_sync;
+  /** Whether the worker loop should keep running. */
+  std::atomic<bool> run;
   /** Worker thread that drains the queue and forwards to @p output. */
   std::thread thread;
-  /** Whether the worker loop should keep running. */
-  bool run;
-  /** Index of the next slot the producer will try to claim. */
-  int64_t current_entry_index;
+};
+
+/** @brief Construction parameters of PerThreadAsyncWriter. */
+struct PerThreadAsyncWriterParameters {
+  /** Size in bytes of each producer thread's queue, a multiple of 8. */
+  size_t queue_capacity{64 * 1024};
+  /**
+   * Lines younger than this are held back, so a line stamped earlier by
+   * another thread but published later still goes out first.  Zero merges
+   * whatever is visible.
+   */
+  std::chrono::microseconds merge_window{50};
+  /** Most lines handed to one `write_batch` call, at most IOV_MAX. */
+  size_t max_batch_lines{256};
+};
+
+/**
+ * @brief AsyncWriter variant with one single-producer/single-consumer queue
+ * per producer thread.
+ *
+ * The first `write()` of a thread registers its own queue, much like the
+ * logger registers a per-thread header formatter; from then on producers
+ * only touch their own queue and never share a cache line, so enqueue cost
+ * does not depend on the number of threads.  Every line is stamped when it
+ * is enqueued.  The worker repeatedly takes the oldest head among all
+ * queues, holding back lines younger than `merge_window`, so the output
+ * follows the enqueue order across threads.  A thread whose queue is full
+ * waits for the worker rather than losing or reordering lines.  Queues of
+ * exited threads are dropped once drained.
+ */
+class PerThreadAsyncWriter : public BaseWriter {
+public:
+  /**
+   * @brief Wrap the given downstream writer.
+   * @param output      Ownership is transferred to PerThreadAsyncWriter.
+   * @param parameters  Queue size and merge window.  Lines longer than
+   *                    `max_line_size()` are truncated.
+   */
+  explicit PerThreadAsyncWriter(
+      std::unique_ptr<BaseWriter> &output,
+      const PerThreadAsyncWriterParameters &parameters = {});
+  size_t write(const char *buf, size_t size) const final;
+  /** Fragments are copied straight into the calling thread's queue. */
+  size_t writev(const iovec *fragments, int count) const final;
+  /** Every producer owns its queue; @p output is driven by the worker. */
+  bool is_thread_safe() const final { return true; }
+  /**
+   * @brief Wait until every line enqueued before the call has been handed
+   * to @p output, then flush @p output.  The merge window is skipped.
+   */
+  using BaseWriter::flush;
+  bool flush(std::chrono::milliseconds timeout) const final;
+  /** Longest line stored in one piece, half of a queue minus a header. */
+  inline size_t max_line_size() const {
+    return capacity / 2 - sizeof(LineHeader);
+  }
+  ~PerThreadAsyncWriter();
+
+protected:
+  /** @brief Header in front of every line of a ThreadQueue. */
+  struct LineHeader {
+    /** Bytes taken by the record, 8 byte aligned; 0 marks a wrap. */
+    uint32_t size;
+    uint32_t length;
+    /** steady_clock nanoseconds at enqueue. */
+    int64_t timestamp;
+  };
+  /** @brief Byte ring written by one producer thread only. */
+  struct ThreadQueue {
+    explicit ThreadQueue(size_t capacity);
+    std::unique_ptr<uint64_t[]> storage;
+    char *data;
+    const size_t capacity;
+    /** Bytes published by the producer. */
+    alignas(64) std::atomic<uint64_t> head{0};
+    /** Bytes consumed by the worker. */
+    alignas(64) std::atomic<uint64_t> tail{0};
+    /** Set when the producer thread exits. */
+    std::atomic<bool> closed{false};
+    inline bool empty() const {
+      return head.load(std::memory_order_acquire) ==
+             tail.load(std::memory_order_relaxed);
+    }
+  };
+  /** Closes the calling thread's queues when it exits. */
+  struct ThreadQueueHandle {
+    /** Queues of this thread, keyed by PerThreadAsyncWriter::id. */
+    std::vector<std::pair<uint64_t, std::shared_ptr<ThreadQueue>>> queues;
+    ~ThreadQueueHandle();
+  };
+
+  /** @brief Queue of the calling thread, registered on first use. */
+  ThreadQueue &thread_queue() const;
+  /** @brief Wake the worker up if it is parked on @p cv. */
+  void notify() const;
+  /** @brief Forget queues of exited threads which have been drained. */
+  void prune_registry();
+  /** @brief Worker thread entry point — merges the queues. */
+  void worker();
+
+  static thread_local ThreadQueueHandle thread_handle;
+
+  /** Destination writer (forwarded to in the worker thread). */
+  mutable std::unique_ptr<BaseWriter> output;
+  const PerThreadAsyncWriterParameters parameters;
+  /** Size of every queue in bytes. */
+  const size_t capacity;
+  /** Tells this writer's queues apart in @p thread_handle. */
+  const uint64_t id;
+  /** Guards @p registry and parking of the worker and of flush(). */
+  mutable std::mutex sync;
+  mutable std::condition_variable cv;
+  /** Signalled by the worker after every round while flush() waits. */
+  mutable std::condition_variable flushed;
+  mutable std::vector<std::shared_ptr<ThreadQueue>> registry;
+  /** Bumped whenever @p registry gains a queue. */
+  mutable std::atomic<uint64_t> registry_version{0};
+  /** True while the worker is (about to be) parked on @p cv. */
+  alignas(64) mutable std::atomic<bool> sleeping{false};
+  /** flush() callers waiting, the worker skips the merge window meanwhile. */
+  mutable std::atomic<uint32_t> flushing{0};
+  /** Set by a zero timeout flush(), taken by the worker's next round. */
+  mutable std::atomic<bool> flush_requested{false};
+  /** Serialises @p output between the worker and flush(). */
+  mutable std::mutex output_sync;
+  std::atomic<bool> run{true};
+  std::thread thread;
+};
+
+/** @brief Construction parameters of CompressedWriter. */
+struct CompressedWriterParameters {
+  /** Input bytes collected into one frame before it is compressed. */
+  size_t frame_size{1024 * 1024};
+  /**
+   * Close a frame once its oldest line is this old, so a quiet log still
+   * reaches the output.  Zero only closes frames on size and `flush()`.
+   */
+  std::chrono::milliseconds frame_interval{1000};
+  /** zlib level, 1 favours speed; log lines compress well even so. */
+  int level{1};
+  /** Closed frames waiting for the worker before writers wait too. */
+  size_t max_pending_frames{4};
+};
+
+/**
+ * @brief A writer that compresses the log stream into gzip members on a
+ * background thread.
+ *
+ * Lines are only copied into the frame being filled.  A frame is closed
+ * when it reaches `frame_size`, when its oldest line is `frame_interval`
+ * old and on `flush()`; the worker compresses every closed frame into a
+ * complete gzip member and hands it to @p output in one write.  gzip
+ * readers take concatenated members as one stream, and each member
+ * decodes on its own, so a file cut short is readable up to its last
+ * complete frame.  Meant for FileWriter, BufferedFileWriter or
+ * NetworkWriter.
+ */
+class CompressedWriter : public BaseWriter {
+public:
+  /**
+   * @brief Wrap the given downstream writer.
+   * @param output      Ownership is transferred to CompressedWriter.
+   * @param parameters  Frame size, interval and compression level.
+   * @throw std::domain_error when micro_logger is built without zlib.
+   */
+  explicit CompressedWriter(std::unique_ptr<BaseWriter> &output,
+                            const CompressedWriterParameters &parameters = {});
+  size_t write(const char *buf, size_t size) const final;
+  size_t writev(const iovec *fragments, int count) const final;
+  size_t write_batch(const iovec *lines, int count) const final;
+  bool is_thread_safe() const final { return true; }
+  /**
+   * @brief Close the current frame, wait until the worker wrote every
+   * frame out, then flush @p output.  A zero timeout does not wait.
+   */
+  using BaseWriter::flush;
+  bool flush(std::chrono::milliseconds timeout) const final;
+  /** @brief Compresses what is left and flushes @p output. */
+  ~CompressedWriter();
+
+private:
+  struct Stream;
+  /** @brief Append one line to the frame, @p lock holds @p sync. */
+  void append(std::unique_lock<std::mutex> &lock, const iovec *fragments,
+              int count) const;
+  /** @brief Queue the frame being filled for the worker. */
+  void close_frame() const;
+  /** @brief Compress @p frame into one gzip member and write it out. */
+  bool write_frame(const std::vector<char> &frame);
+  /** @brief Worker thread entry point — compresses and writes frames. */
+  void worker();
+
+  /** Destination writer, only the worker writes to it. */
+  mutable std::unique_ptr<BaseWriter> output;
+  const CompressedWriterParameters parameters;
+  /** deflate state, used by the worker only. */
+  std::unique_ptr<Stream> stream;
+  /** Guards everything below. */
+  mutable std::mutex sync;
+  /** Wakes the worker. */
+  mutable std::condition_variable cv;
+  /** Signalled when the worker took or wrote a frame. */
+  mutable std::condition_variable progress;
+  /** Frame lines are appended to. */
+  mutable std::vector<char> filling;
+  /** Steady clock time the oldest line of @p filling arrived at. */
+  mutable std::chrono::steady_clock::time_point filling_since;
+  /** Closed frames, oldest first. */
+  mutable std::vector<std::vector<char>> pending;
+  /** Emptied frames kept for reuse. */
+  mutable std::vector<std::vector<char>> spare;
+  /** Bumped by flush(), the worker flushes @p output once frames are out. */
+  mutable uint64_t flush_requests{0};
+  /** Last of @p flush_requests the worker flushed @p output for. */
+  mutable uint64_t flushes{0};
+  /** Latest deadline of the flush() calls waiting for the worker. */
+  mutable std::chrono::steady_clock::time_point flush_deadline;
+  /** Result of the last flush of @p output. */
+  mutable bool flushed{true};
+  /** A frame failed to reach @p output since the last flush. */
+  mutable bool failed{false};
+  bool run{true};
+  std::thread thread;
+};
+
+/** @brief Construction parameters of FlightRecorderWriter. */
+struct FlightRecorderWriterParameters {
+  /** Bytes of recent lines kept, rounded up to whole blocks. */
+  size_t capacity{4 * 1024 * 1024};
+  /** Lines never span blocks; longer ones are truncated to one. */
+  size_t block_size{64 * 1024};
+  /** Dump when an ERROR or CRITICAL line is logged. */
+  bool dump_on_severe{true};
+};
+
+/**
+ * @brief A writer that keeps the most recent lines in memory and writes
+ * them out only when asked to.
+ *
+ * Lines go into a fixed ring of blocks, the oldest block is reused once
+ * the ring is full.  A line costs one compare-and-swap to reserve its room
+ * in the current block and a memcpy; no lock is taken and no thread ever
+ * waits for another, except for the rare thread which rolls over to the
+ * next block while the oldest lap is still being copied into it.  The
+ * ring is dumped to @p output on `dump()`, on an ERROR or CRITICAL line
+ * (after the line itself is recorded) and on the signal given to
+ * `install_signal_handler`.  A dump writes the lines recorded since the
+ * previous one, oldest first, then flushes @p output.
+ */
+class FlightRecorderWriter : public BaseWriter {
+public:
+  /**
+   * @brief Wrap the given downstream writer.
+   * @param output      Ownership is transferred to FlightRecorderWriter.
+   * @param parameters  Ring capacity and block size.
+   */
+  explicit FlightRecorderWriter(
+      std::unique_ptr<BaseWriter> &output,
+      const FlightRecorderWriterParameters &parameters = {});
+  size_t write(const char *buf, size_t size) const final;
+  size_t writev(const iovec *fragments, int count) const final;
+  /** Records the line, then dumps for ERROR and CRITICAL. */
+  size_t write_record(Level level, const iovec *fragments,
+                      int count) const final;
+  bool is_thread_safe() const final { return true; }
+  /**
+   * @brief Write the lines recorded since the last dump to @p output.
+   * @return Number of lines written.
+   */
+  size_t dump() const;
+  /**
+   * @brief Dump whenever the process receives @p signal.
+   *
+   * The handler only wakes a thread of this writer, which does the dump.
+   * Installed once per process and signal; the action it replaced is back
+   * once the last writer dumping on that signal is destroyed.
+   *
+   * @throw std::domain_error when too many writers are registered.
+   */
+  void install_signal_handler(int signal = SIGUSR1);
+  /** @brief Flushes @p output; lines not dumped are dropped. */
+  ~FlightRecorderWriter();
+
+private:
+  /** @brief One block of the ring. */
+  struct Block {
+    /** Generation in the upper half, reserved bytes in the lower one. */
+    std::atomic<uint64_t> reserved{0};
+    /** Bytes of finished records in the current generation. */
+    std::atomic<uint64_t> committed{0};
+    /** Reserved bytes of the previous generation, set when it rolls. */
+    size_t length{0};
+  };
+  /** @brief Copy a line into the ring. */
+  size_t record(const iovec *fragments, int count) const;
+  /** @brief Move on from the block of generation @p full, @p length long. */
+  void roll(uint64_t full, size_t length) const;
+  /** @brief Waits for install_signal_handler()'s signal and dumps. */
+  void signal_worker();
+  /** @brief Handler installed by install_signal_handler(). */
+  static void on_signal(int signal);
+
+  mutable std::unique_ptr<BaseWriter> output;
+  const FlightRecorderWriterParameters parameters;
+  /** `block_size` rounded up to the 8 byte record alignment. */
+  const size_t block_size;
+  const size_t block_count;
+  std::unique_ptr<Block[]> blocks;
+  std::unique_ptr<uint64_t[]> storage;
+  /** Blocks, one after another, block_size each. */
+  char *data;
+  /** Generation of the block being filled, counts every block used. */
+  alignas(64) mutable std::atomic<uint64_t> active{0};
+  /** Serialises dumps. */
+  mutable std::mutex dump_sync;
+  /** Lines go out from here, copied out of the ring first. */
+  mutable std::vector<char> dump_buffer;
+  /** Generation and offset the next dump starts at. */
+  mutable uint64_t dumped_generation{0};
+  mutable size_t dumped_offset{0};
+  /** Signal dumping this writer, 0 without a handler. */
+  int dump_signal{0};
+  /** eventfd the signal handler wakes @p signal_thread with. */
+  int signal_fd{-1};
+  std::atomic<bool> run{true};
+  std::thread signal_thread;
 };
 
 } // namespace micro_logger
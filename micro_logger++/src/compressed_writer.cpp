@@ -0,0 +1,217 @@
+/*
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/.
+ */
+#include "micro_logger/micro_logger_writer.hpp"
+//
+#include <iostream>
+#ifdef MICRO_LOGGER_HAS_ZLIB
+#include <zlib.h>
+#endif
+
+namespace micro_logger {
+
+#ifdef MICRO_LOGGER_HAS_ZLIB
+struct CompressedWriter::Stream {
+  ~Stream() { deflateEnd(&z); }
+  z_stream z{};
+  /** Compressed member, grown to the largest frame's bound. */
+  std::vector<unsigned char> out;
+};
+#else
+struct CompressedWriter::Stream {};
+#endif
+
+CompressedWriter::CompressedWriter(std::unique_ptr<BaseWriter> &output,
+                                   const CompressedWriterParameters &parameters)
+    : output(std::move(output)), parameters(parameters),
+      stream(std::make_unique<Stream>()) {
+#ifdef MICRO_LOGGER_HAS_ZLIB
+  // 15 + 16: zlib's largest window, inside a gzip header and trailer
+  if (deflateInit2(&stream->z, parameters.level, Z_DEFLATED, 15 + 16, 8,
+                   Z_DEFAULT_STRATEGY) != Z_OK) {
+    std::cerr << "failed to initialize deflate, level: " << parameters.level
+              << std::endl;
+    throw std::domain_error("initialize deflate");
+  }
+#else
+  throw std::domain_error("micro_logger built without zlib");
+#endif
+  filling.reserve(parameters.frame_size);
+  thread = std::thread(&CompressedWriter::worker, this);
+}
+
+CompressedWriter::~CompressedWriter() {
+  {
+    std::scoped_lock lock(sync);
+    close_frame();
+    run = false;
+  }
+  cv.notify_all();
+  if (thread.joinable()) {
+    thread.join();
+  }
+  output->flush();
+}
+
+size_t CompressedWriter::write(const char *buf, size_t size) const {
+  iovec fragment{const_cast<char *>(buf), size};
+  std::unique_lock lock(sync);
+  append(lock, &fragment, 1);
+  return size;
+}
+
+size_t CompressedWriter::writev(const iovec *fragments, int count) const {
+  size_t size = 0;
+  for (int i = 0; i < count; ++i) {
+    size += fragments[i].iov_len;
+  }
+  std::unique_lock lock(sync);
+  append(lock, fragments, count);
+  return size;
+}
+
+size_t CompressedWriter::write_batch(const iovec *lines, int count) const {
+  size_t size = 0;
+  std::unique_lock lock(sync);
+  for (int i = 0; i < count; ++i) {
+    append(lock, lines + i, 1);
+    size += lines[i].iov_len;
+  }
+  return size;
+}
+
+void CompressedWriter::append(std::unique_lock<std::mutex> &lock,
+                              const iovec *fragments, int count) const {
+  // the worker is behind, memory stays bounded by waiting for it
+  const auto limit = std::max(parameters.max_pending_frames, size_t{1});
+  progress.wait(lock, [&]() { return pending.size() < limit; });
+  if (filling.empty() and parameters.frame_interval.count()) {
+    filling_since = std::chrono::steady_clock::now();
+    cv.notify_one();
+  }
+  for (int i = 0; i < count; ++i) {
+    const auto *data = static_cast<const char *>(fragments[i].iov_base);
+    filling.insert(filling.end(), data, data + fragments[i].iov_len);
+  }
+  if (filling.size() >= parameters.frame_size) {
+    close_frame();
+  }
+}
+
+void CompressedWriter::close_frame() const {
+  if (filling.empty()) {
+    return;
+  }
+  pending.push_back(std::move(filling));
+  if (spare.empty()) {
+    filling = {};
+    filling.reserve(parameters.frame_size);
+  } else {
+    filling = std::move(spare.back());
+    spare.pop_back();
+  }
+  cv.notify_one();
+}
+
+bool CompressedWriter::flush(std::chrono::milliseconds timeout) const {
+  const bool forever = timeout == timeout.max();
+  const auto deadline = forever ? std::chrono::steady_clock::time_point::max()
+                                : std::chrono::steady_clock::now() + timeout;
+  std::unique_lock lock(sync);
+  close_frame();
+  flush_deadline = flushes < flush_requests
+                       ? std::max(flush_deadline, deadline)
+                       : deadline;
+  const auto request = ++flush_requests;
+  cv.notify_one();
+  if (timeout == timeout.zero()) {
+    return pending.empty();
+  }
+  const auto done = [&]() { return flushes >= request; };
+  if (forever) {
+    progress.wait(lock, done);
+  } else if (not progress.wait_until(lock, deadline, done)) {
+    return false;
+  }
+  return flushed;
+}
+
+#ifdef MICRO_LOGGER_HAS_ZLIB
+bool CompressedWriter::write_frame(const std::vector<char> &frame) {
+  auto &z = stream->z;
+  stream->out.resize(
+      std::max<size_t>(stream->out.size(), deflateBound(&z, frame.size())));
+  z.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(frame.data()));
+  z.avail_in = frame.size();
+  z.next_out = stream->out.data();
+  z.avail_out = stream->out.size();
+  // the bound covers the whole member, one call finishes it
+  const bool finished = deflate(&z, Z_FINISH) == Z_STREAM_END;
+  const size_t size = stream->out.size() - z.avail_out;
+  deflateReset(&z);
+  if (not finished) {
+    return false;
+  }
+  return output->write(reinterpret_cast<const char *>(stream->out.data()),
+                       size) == size;
+}
+#else
+bool CompressedWriter::write_frame(const std::vector<char> &frame) {
+  return false;
+}
+#endif
+
+void CompressedWriter::worker() {
+  std::unique_lock lock(sync);
+  while (true) {
+    if (not pending.empty()) {
+      auto frame = std::move(pending.front());
+      pending.erase(pending.begin());
+      progress.notify_all();
+      lock.unlock();
+      const bool written = write_frame(frame);
+      lock.lock();
+      failed = failed or not written;
+      frame.clear();
+      spare.push_back(std::move(frame));
+      continue;
+    }
+    if (flushes < flush_requests) {
+      // every frame closed before the request is out
+      const auto request = flush_requests;
+      const auto deadline = flush_deadline;
+      lock.unlock();
+      const auto remaining =
+          deadline == std::chrono::steady_clock::time_point::max()
+              ? std::chrono::milliseconds::max()
+              : std::max(
+                    std::chrono::duration_cast<std::chrono::milliseconds>(
+                        deadline - std::chrono::steady_clock::now()),
+                    std::chrono::milliseconds(0));
+      const bool result = output->flush(remaining);
+      lock.lock();
+      flushed = result and not failed;
+      failed = false;
+      flushes = request;
+      progress.notify_all();
+      continue;
+    }
+    if (not run) {
+      return;
+    }
+    if (filling.empty() or parameters.frame_interval.count() == 0) {
+      cv.wait(lock);
+      continue;
+    }
+    const auto due = filling_since + parameters.frame_interval;
+    if (std::chrono::steady_clock::now() >= due) {
+      close_frame();
+    } else {
+      cv.wait_until(lock, due);
+    }
+  }
+}
+
+} // namespace micro_logger
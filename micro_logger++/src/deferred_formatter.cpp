@@ -0,0 +1,668 @@
+/*
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/.
+ */
+
+#include "deferred_formatter.h"
+//
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <sys/types.h>
+
+namespace micro_logger {
+
+namespace {
+/** Length modifier of a printf conversion. */
+enum class Length { none, hh, h, l, ll, j, z, t, L };
+
+/** One parsed printf conversion specification. */
+struct Spec {
+  const char *begin{nullptr};
+  const char *end{nullptr};
+  Length length{Length::none};
+  char conversion{0};
+  bool width_star{false};
+  bool precision_star{false};
+  int precision{-1};
+};
+
+/** Spec text is copied into a small stack buffer while replaying. */
+constexpr size_t max_spec_size{32};
+/** Marks a `nullptr` string argument. */
+constexpr uint32_t null_string{UINT32_MAX};
+
+/**
+ * Parse the conversion starting at @p p (which points to '%').
+ * @return false for truncated or unreasonably long specifications.
+ */
+bool parse_spec(const char *p, Spec &spec) {
+  spec = {.begin = p};
+  const char *q = p + 1;
+  while (*q and std::strchr("-+ #0'", *q)) {
+    ++q;
+  }
+  if (*q == '*') {
+    spec.width_star = true;
+    ++q;
+  }
+  while (*q >= '0' and *q <= '9') {
+    ++q;
+  }
+  if (*q == '.') {
+    ++q;
+    spec.precision = 0;
+    if (*q == '*') {
+      spec.precision_star = true;
+      ++q;
+    }
+    while (*q >= '0' and *q <= '9') {
+      spec.precision = spec.precision * 10 + (*q++ - '0');
+    }
+  }
+  switch (*q) {
+  case 'h':
+    spec.length = *++q == 'h' ? (++q, Length::hh) : Length::h;
+    break;
+  case 'l':
+    spec.length = *++q == 'l' ? (++q, Length::ll) : Length::l;
+    break;
+  case 'q':
+    spec.length = Length::ll;
+    ++q;
+    break;
+  case 'j':
+    spec.length = Length::j;
+    ++q;
+    break;
+  case 'z':
+    spec.length = Length::z;
+    ++q;
+    break;
+  case 't':
+    spec.length = Length::t;
+    ++q;
+    break;
+  case 'L':
+    spec.length = Length::L;
+    ++q;
+    break;
+  }
+  spec.conversion = *q;
+  spec.end = q + 1;
+  return spec.conversion and
+         static_cast<size_t>(spec.end - spec.begin) < max_spec_size;
+}
+
+/** Bounded append-only view over the record scratch buffer. */
+class RecordWriter {
+public:
+  RecordWriter(char *data, size_t capacity) : data(data), capacity(capacity) {}
+  bool put(const void *in, size_t size) {
+    if (size > capacity - position) {
+      return false;
+    }
+    std::memcpy(data + position, in, size);
+    position += size;
+    return true;
+  }
+  template <typename T> bool put(T value) { return put(&value, sizeof(T)); }
+  bool put_string(const char *in, size_t size) {
+    return put(static_cast<uint16_t>(size)) and put(in, size) and put('\0');
+  }
+  size_t size() const { return position; }
+
+private:
+  char *data;
+  size_t capacity;
+  size_t position{0};
+};
+
+/** Sequential reader matching RecordWriter. */
+class RecordReader {
+public:
+  explicit RecordReader(const char *data) : data(data) {}
+  template <typename T> T get() {
+    T value;
+    std::memcpy(&value, data, sizeof(T));
+    data += sizeof(T);
+    return value;
+  }
+  const char *get_string() {
+    auto size = get<uint16_t>();
+    auto out = data;
+    data += size + 1;
+    return out;
+  }
+  const char *get_bytes(size_t size) {
+    auto out = data;
+    data += size;
+    return out;
+  }
+
+private:
+  const char *data;
+};
+
+/** Fixed part of every record, followed by the strings and arguments. */
+struct RecordHeader {
+  /** Whole record size (8-byte aligned); 0 marks a wrap to offset 0. */
+  uint32_t size{0};
+  int32_t line{0};
+  int64_t timestamp{0};
+};
+
+bool encode_arguments(RecordWriter &out, const char *fmt, va_list args) {
+  for (const char *p = std::strchr(fmt, '%'); p; p = std::strchr(p, '%')) {
+    Spec spec;
+    if (not parse_spec(p, spec)) {
+      return false;
+    }
+    p = spec.end;
+    int precision = spec.precision;
+    if (spec.width_star and not out.put<int64_t>(va_arg(args, int))) {
+      return false;
+    }
+    if (spec.precision_star) {
+      precision = va_arg(args, int);
+      if (not out.put<int64_t>(precision)) {
+        return false;
+      }
+    }
+    bool fits = true;
+    switch (spec.conversion) {
+    case '%':
+      break;
+    case 'd':
+    case 'i':
+      switch (spec.length) {
+      case Length::l:
+        fits = out.put<int64_t>(va_arg(args, long));
+        break;
+      case Length::ll:
+        fits = out.put<int64_t>(va_arg(args, long long));
+        break;
+      case Length::j:
+        fits = out.put<int64_t>(va_arg(args, intmax_t));
+        break;
+      case Length::z:
+        fits = out.put<int64_t>(va_arg(args, ssize_t));
+        break;
+      case Length::t:
+        fits = out.put<int64_t>(va_arg(args, ptrdiff_t));
+        break;
+      default:
+        fits = out.put<int64_t>(va_arg(args, int));
+      }
+      break;
+    case 'o':
+    case 'u':
+    case 'x':
+    case 'X':
+      switch (spec.length) {
+      case Length::l:
+        fits = out.put<uint64_t>(va_arg(args, unsigned long));
+        break;
+      case Length::ll:
+        fits = out.put<uint64_t>(va_arg(args, unsigned long long));
+        break;
+      case Length::j:
+        fits = out.put<uint64_t>(va_arg(args, uintmax_t));
+        break;
+      case Length::z:
+        fits = out.put<uint64_t>(va_arg(args, size_t));
+        break;
+      case Length::t:
+        fits = out.put<uint64_t>(va_arg(args, ptrdiff_t));
+        break;
+      default:
+        fits = out.put<uint64_t>(va_arg(args, unsigned int));
+      }
+      break;
+    case 'c':
+      if (spec.length == Length::l) {
+        return false;
+      }
+      fits = out.put<int64_t>(va_arg(args, int));
+      break;
+    case 'e':
+    case 'E':
+    case 'f':
+    case 'F':
+    case 'g':
+    case 'G':
+    case 'a':
+    case 'A':
+      if (spec.length == Length::L) {
+        fits = out.put(va_arg(args, long double));
+      } else {
+        fits = out.put(va_arg(args, double));
+      }
+      break;
+    case 's': {
+      if (spec.length == Length::l) {
+        return false;
+      }
+      auto in = va_arg(args, const char *);
+      if (not in) {
+        fits = out.put(null_string);
+        break;
+      }
+      // precision allows arguments which are not nul-terminated
+      auto limit = precision >= 0 ? static_cast<size_t>(precision)
+                                  : DeferredFormatter::max_record_size;
+      auto size = static_cast<uint32_t>(::strnlen(in, limit));
+      fits = out.put(size) and out.put(in, size);
+      break;
+    }
+    case 'p':
+      fits = out.put(va_arg(args, void *));
+      break;
+    default:
+      // %n, %m and friends need the caller's context
+      return false;
+    }
+    if (not fits) {
+      return false;
+    }
+  }
+  return true;
+}
+
+/** snprintf which never reports more than it actually wrote. */
+template <typename T>
+size_t append(char *out, size_t out_size, const char *spec, T value) {
+  auto size = std::snprintf(out, out_size, spec, value);
+  if (size < 0) {
+    return 0;
+  }
+  return std::min(static_cast<size_t>(size), out_size - 1);
+}
+
+size_t render_spec(const Spec &spec, RecordReader &in, char *out,
+                   size_t out_size) {
+  // rewrite '*' into the captured values so the spec takes one argument
+  char text[max_spec_size * 2];
+  size_t size = 0;
+  for (const char *p = spec.begin; p != spec.end; ++p) {
+    if (*p != '*') {
+      text[size++] = *p;
+      continue;
+    }
+    auto value = in.get<int64_t>();
+    if (p[-1] == '.' and value < 0) {
+      --size; // negative precision is taken as if it was omitted
+      continue;
+    }
+    size += std::snprintf(text + size, sizeof(text) - size, "%d",
+                          static_cast<int>(value));
+  }
+  text[size] = '\0';
+
+  switch (spec.conversion) {
+  case 'd':
+  case 'i':
+  case 'c': {
+    auto value = in.get<int64_t>();
+    switch (spec.length) {
+    case Length::l:
+      return append(out, out_size, text, static_cast<long>(value));
+    case Length::ll:
+      return append(out, out_size, text, static_cast<long long>(value));
+    case Length::j:
+      return append(out, out_size, text, static_cast<intmax_t>(value));
+    case Length::z:
+      return append(out, out_size, text, static_cast<ssize_t>(value));
+    case Length::t:
+      return append(out, out_size, text, static_cast<ptrdiff_t>(value));
+    default:
+      return append(out, out_size, text, static_cast<int>(value));
+    }
+  }
+  case 'o':
+  case 'u':
+  case 'x':
+  case 'X': {
+    auto value = in.get<uint64_t>();
+    switch (spec.length) {
+    case Length::l:
+      return append(out, out_size, text, static_cast<unsigned long>(value));
+    case Length::ll:
+      return append(out, out_size, text,
+                    static_cast<unsigned long long>(value));
+    case Length::j:
+      return append(out, out_size, text, static_cast<uintmax_t>(value));
+    case Length::z:
+      return append(out, out_size, text, static_cast<size_t>(value));
+    case Length::t:
+      return append(out, out_size, text, static_cast<ptrdiff_t>(value));
+    default:
+      return append(out, out_size, text, static_cast<unsigned int>(value));
+    }
+  }
+  case 'e':
+  case 'E':
+  case 'f':
+  case 'F':
+  case 'g':
+  case 'G':
+  case 'a':
+  case 'A':
+    if (spec.length == Length::L) {
+      return append(out, out_size, text, in.get<long double>());
+    }
+    return append(out, out_size, text, in.get<double>());
+  case 's': {
+    auto size = in.get<uint32_t>();
+    if (size == null_string) {
+      return append(out, out_size, text, static_cast<const char *>(nullptr));
+    }
+    // the copy is not nul-terminated, bound it through the precision
+    std::string bounded{text};
+    auto bytes = in.get_bytes(size);
+    auto dot = bounded.find('.');
+    if (dot == std::string::npos) {
+      bounded.insert(bounded.size() - 1, ".*");
+    } else {
+      bounded.replace(dot, bounded.size() - 1 - dot, ".*");
+    }
+    auto written = std::snprintf(out, out_size, bounded.c_str(),
+                                 static_cast<int>(size), bytes);
+    return written < 0 ? 0 : std::min<size_t>(written, out_size - 1);
+  }
+  case 'p':
+    return append(out, out_size, text, in.get<void *>());
+  }
+  return 0;
+}
+
+/** Replay @p fmt against the captured arguments, vsnprintf style. */
+void render(const char *fmt, RecordReader &in, char *out, size_t out_size) {
+  size_t size = 0;
+  while (*fmt and size + 1 < out_size) {
+    const char *p = std::strchr(fmt, '%');
+    size_t literal = p ? p - fmt : std::strlen(fmt);
+    literal = std::min(literal, out_size - 1 - size);
+    std::memcpy(out + size, fmt, literal);
+    size += literal;
+    if (not p) {
+      break;
+    }
+    Spec spec;
+    parse_spec(p, spec);
+    fmt = spec.end;
+    if (spec.conversion == '%') {
+      if (size + 1 < out_size) {
+        out[size++] = '%';
+      }
+      continue;
+    }
+    size += render_spec(spec, in, out + size, out_size - size);
+  }
+  out[size] = '\0';
+}
+} // namespace
+
+thread_local DeferredFormatter::ThreadBufferHandle
+    DeferredFormatter::thread_handle;
+
+DeferredFormatter::ThreadBuffer::ThreadBuffer(
+    size_t capacity, const HeaderFormatter &header_formatter)
+    : data(std::make_unique<char[]>(capacity)), capacity(capacity),
+      header_formatter(header_formatter) {}
+
+DeferredFormatter::ThreadBufferHandle::~ThreadBufferHandle() {
+  if (buffer) {
+    buffer->closed.store(true, std::memory_order_release);
+  }
+}
+
+DeferredFormatter &DeferredFormatter::get_instance() {
+  static DeferredFormatter obj;
+  return obj;
+}
+
+void DeferredFormatter::enable(size_t size) {
+  // records must stay 8-byte aligned and at least two of them must fit
+  size = std::max(size, 2 * max_record_size) & ~size_t{7};
+  buffer_size.store(size, std::memory_order_relaxed);
+  {
+    std::scoped_lock lock(sync);
+    if (not thread.joinable()) {
+      thread = std::thread(&DeferredFormatter::worker, this);
+    }
+  }
+  enabled.store(true, std::memory_order_release);
+}
+
+void DeferredFormatter::disable() {
+  enabled.store(false, std::memory_order_release);
+  std::unique_lock lock(sync);
+  if (not thread.joinable()) {
+    return;
+  }
+  drained.wait(lock, [&]() {
+    return std::all_of(registry.begin(), registry.end(),
+                       [](const auto &buffer) { return buffer->empty(); });
+  });
+}
+
+bool DeferredFormatter::flush(std::chrono::steady_clock::time_point deadline) {
+  std::vector<std::pair<std::shared_ptr<ThreadBuffer>, size_t>> targets;
+  std::unique_lock lock(sync);
+  if (not thread.joinable()) {
+    return true;
+  }
+  for (const auto &buffer : registry) {
+    targets.emplace_back(buffer, buffer->head.load(std::memory_order_acquire));
+  }
+  const auto passed = [&]() {
+    return std::all_of(targets.begin(), targets.end(), [](const auto &target) {
+      return target.first->tail.load(std::memory_order_acquire) >=
+             target.second;
+    });
+  };
+  // pairs with the fence in worker(), either it sees us waiting or we see
+  // the records it wrote
+  flush_waiters.fetch_add(1, std::memory_order_seq_cst);
+  bool result;
+  if (deadline == std::chrono::steady_clock::time_point::max()) {
+    drained.wait(lock, passed);
+    result = true;
+  } else {
+    result = drained.wait_until(lock, deadline, passed);
+  }
+  flush_waiters.fetch_sub(1, std::memory_order_relaxed);
+  return result;
+}
+
+DeferredFormatter::~DeferredFormatter() {
+  {
+    std::scoped_lock lock(sync);
+    run = false;
+  }
+  cv.notify_all();
+  if (thread.joinable()) {
+    thread.join();
+  }
+}
+
+DeferredFormatter::ThreadBuffer &
+DeferredFormatter::thread_buffer(const HeaderFormatter &header_formatter) {
+  if (not thread_handle.buffer) {
+    thread_handle.buffer = std::make_shared<ThreadBuffer>(
+        buffer_size.load(std::memory_order_relaxed), header_formatter);
+    std::scoped_lock lock(sync);
+    registry.emplace_back(thread_handle.buffer);
+    registry_version.fetch_add(1, std::memory_order_release);
+  }
+  return *thread_handle.buffer;
+}
+
+bool DeferredFormatter::push(const HeaderFormatter &header_formatter,
+                             const char *level, const char *file,
+                             const char *func, int line, const char *fmt,
+                             va_list args) {
+  alignas(8) char record[max_record_size];
+  RecordWriter out(record, sizeof(record));
+  RecordHeader header{
+      .line = line,
+      .timestamp = std::chrono::system_clock::now().time_since_epoch().count(),
+  };
+  va_list args_copy;
+  va_copy(args_copy, args);
+  bool encoded = out.put(header) and
+                 out.put_string(level, std::strlen(level)) and
+                 out.put_string(file, std::strlen(file)) and
+                 out.put_string(func, std::strlen(func)) and
+                 out.put_string(fmt, std::strlen(fmt)) and
+                 encode_arguments(out, fmt, args_copy);
+  va_end(args_copy);
+  if (not encoded) {
+    return false;
+  }
+  header.size = (out.size() + 7) & ~size_t{7};
+  std::memcpy(record, &header.size, sizeof(header.size));
+  publish(thread_buffer(header_formatter), record, header.size);
+  return true;
+}
+
+void DeferredFormatter::publish(ThreadBuffer &buffer, const char *record,
+                                size_t size) {
+  const auto head = buffer.head.load(std::memory_order_relaxed);
+  const auto offset = head % buffer.capacity;
+  const auto to_end = buffer.capacity - offset;
+  const auto needed = to_end < size ? to_end + size : size;
+  // full buffer means the producer outpaces formatting, wait rather than
+  // reorder or lose lines
+  while (buffer.capacity -
+             (head - buffer.tail.load(std::memory_order_acquire)) <
+         needed) {
+    notify();
+    std::this_thread::yield();
+  }
+  auto position = offset;
+  if (to_end < size) {
+    const uint32_t wrap{0};
+    std::memcpy(buffer.data.get() + offset, &wrap, sizeof(wrap));
+    position = 0;
+  }
+  std::memcpy(buffer.data.get() + position, record, size);
+  buffer.head.store(head + needed, std::memory_order_release);
+  notify();
+}
+
+void DeferredFormatter::drain_thread() {
+  const auto &buffer = thread_handle.buffer;
+  if (not buffer) {
+    return;
+  }
+  const auto head = buffer->head.load(std::memory_order_relaxed);
+  while (buffer->tail.load(std::memory_order_acquire) != head) {
+    notify();
+    std::this_thread::yield();
+  }
+}
+
+void DeferredFormatter::notify() {
+  // pairs with the fence in worker(), either the worker sees the record or
+  // we see it parked
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  if (sleeping.load(std::memory_order_relaxed)) {
+    { std::scoped_lock lock(sync); }
+    cv.notify_one();
+  }
+}
+
+bool DeferredFormatter::drain(ThreadBuffer &buffer) {
+  auto tail = buffer.tail.load(std::memory_order_relaxed);
+  const auto head = buffer.head.load(std::memory_order_acquire);
+  if (tail == head) {
+    return false;
+  }
+  char message[custom_parameters->message_size];
+  while (tail != head) {
+    const auto offset = tail % buffer.capacity;
+    const char *record = buffer.data.get() + offset;
+    uint32_t size;
+    std::memcpy(&size, record, sizeof(size));
+    if (size == 0) {
+      tail += buffer.capacity - offset;
+      continue;
+    }
+    RecordReader in(record);
+    auto header = in.get<RecordHeader>();
+    auto level = in.get_string();
+    auto file = in.get_string();
+    auto func = in.get_string();
+    auto fmt = in.get_string();
+    render(fmt, in, message, sizeof(message));
+    write_line(buffer.header_formatter,
+               std::chrono::system_clock::time_point(
+                   std::chrono::system_clock::duration(header.timestamp)),
+               level, file, func, header.line, message);
+    tail += header.size;
+    buffer.tail.store(tail, std::memory_order_release);
+  }
+  buffer.tail.store(tail, std::memory_order_release);
+  return true;
+}
+
+bool DeferredFormatter::refresh(
+    std::vector<std::shared_ptr<ThreadBuffer>> &buffers) {
+  std::erase_if(registry, [](const auto &buffer) {
+    return buffer->closed.load(std::memory_order_acquire) and buffer->empty();
+  });
+  if (buffers.size() == registry.size() and
+      std::equal(buffers.begin(), buffers.end(), registry.begin())) {
+    return false;
+  }
+  buffers = registry;
+  return true;
+}
+
+bool DeferredFormatter::is_idle(
+    const std::vector<std::shared_ptr<ThreadBuffer>> &buffers) {
+  return std::all_of(buffers.begin(), buffers.end(),
+                     [](const auto &buffer) { return buffer->empty(); });
+}
+
+void DeferredFormatter::worker() {
+  std::vector<std::shared_ptr<ThreadBuffer>> buffers;
+  uint64_t version = 0;
+  while (true) {
+    bool drained_any = false;
+    for (auto &buffer : buffers) {
+      drained_any |= drain(*buffer);
+    }
+    if (drained_any) {
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+      if (flush_waiters.load(std::memory_order_relaxed)) {
+        { std::scoped_lock lock(sync); }
+        drained.notify_all();
+      }
+      continue;
+    }
+    std::unique_lock lock(sync);
+    version = registry_version.load(std::memory_order_acquire);
+    if (refresh(buffers)) {
+      continue;
+    }
+    drained.notify_all();
+    if (not run) {
+      return;
+    }
+    sleeping.store(true, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    cv.wait(lock, [&]() {
+      return not run or
+             registry_version.load(std::memory_order_acquire) != version or
+             not is_idle(buffers);
+    });
+    sleeping.store(false, std::memory_order_relaxed);
+  }
+}
+
+} // namespace micro_logger
@@ -0,0 +1,141 @@
+/*
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/.
+ */
+
+#ifndef MICRO_LOGGER_DEFERRED_FORMATTER_H
+#define MICRO_LOGGER_DEFERRED_FORMATTER_H
+
+#include "header_formatter.h"
+#include "micro_logger/micro_logger_custom_parameters.h"
+//
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdarg>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace micro_logger {
+
+extern const micro_logger_CustomParameters *custom_parameters;
+
+/**
+ * Render one complete log line and hand it to the active writer.
+ * Defined in micro_logger.cpp, shared by the immediate and deferred paths.
+ */
+void write_line(const HeaderFormatter &header_formatter,
+                std::chrono::system_clock::time_point time_point,
+                const char *level, const char *file, const char *func,
+                int line, const char *message);
+
+/**
+ * Moves printf-style formatting off the calling thread.
+ *
+ * The producer only walks the format string to learn the argument types
+ * and stores a compact binary copy of the call site, the raw timestamp and
+ * the arguments in its own single-producer/single-consumer buffer.  A
+ * background thread replays the records through `snprintf` and writes them
+ * with `write_line`.
+ */
+class DeferredFormatter {
+public:
+  /** Largest record accepted, bigger ones are formatted immediately. */
+  static constexpr size_t max_record_size{4096};
+
+  static DeferredFormatter &get_instance();
+
+  /** Start the background thread on first use and route calls to it. */
+  void enable(size_t buffer_size);
+  /** Route calls back to the caller thread and wait until drained. */
+  void disable();
+  /**
+   * Wait until every record pushed before the call has been written.
+   * @return false when @p deadline passed first.
+   */
+  bool flush(std::chrono::steady_clock::time_point deadline);
+  /**
+   * Wait until the calling thread's records have been written, a line it
+   * writes itself must not overtake them.
+   */
+  void drain_thread();
+  inline bool is_enabled() const {
+    return enabled.load(std::memory_order_relaxed);
+  }
+
+  /**
+   * Enqueue a record for the current thread.
+   *
+   * @return false when the format string uses a conversion that can not be
+   *         deferred (`%n`, `%m`, wide strings); @p args is left untouched
+   *         and the caller has to format the line itself.
+   */
+  bool push(const HeaderFormatter &header_formatter, const char *level,
+            const char *file, const char *func, int line, const char *fmt,
+            va_list args);
+
+  ~DeferredFormatter();
+  DeferredFormatter(const DeferredFormatter &) = delete;
+  DeferredFormatter(DeferredFormatter &&) = delete;
+  DeferredFormatter &operator=(const DeferredFormatter &) = delete;
+  DeferredFormatter &operator=(DeferredFormatter &&) = delete;
+
+private:
+  /** Single-producer/single-consumer byte ring owned by one thread. */
+  struct ThreadBuffer {
+    explicit ThreadBuffer(size_t capacity,
+                          const HeaderFormatter &header_formatter);
+    std::unique_ptr<char[]> data;
+    const size_t capacity;
+    /** Copy of the producer's header formatter, it outlives the thread. */
+    const HeaderFormatter header_formatter;
+    alignas(64) std::atomic<size_t> head{0};
+    alignas(64) std::atomic<size_t> tail{0};
+    /** Set when the owning thread exits. */
+    std::atomic<bool> closed{false};
+    inline bool empty() const {
+      return head.load(std::memory_order_acquire) ==
+             tail.load(std::memory_order_relaxed);
+    }
+  };
+  /** Releases the per-thread buffer to the consumer on thread exit. */
+  struct ThreadBufferHandle {
+    std::shared_ptr<ThreadBuffer> buffer;
+    ~ThreadBufferHandle();
+  };
+
+  DeferredFormatter() = default;
+  ThreadBuffer &thread_buffer(const HeaderFormatter &header_formatter);
+  void publish(ThreadBuffer &buffer, const char *record, size_t size);
+  bool drain(ThreadBuffer &buffer);
+  bool refresh(std::vector<std::shared_ptr<ThreadBuffer>> &buffers);
+  bool is_idle(const std::vector<std::shared_ptr<ThreadBuffer>> &buffers);
+  void notify();
+  void worker();
+
+  static thread_local ThreadBufferHandle thread_handle;
+
+  std::atomic<bool> enabled{false};
+  std::atomic<size_t> buffer_size{0};
+  /** Guards @p registry and parking of the worker thread. */
+  std::mutex sync;
+  std::condition_variable cv;
+  std::vector<std::shared_ptr<ThreadBuffer>> registry;
+  /** Bumped whenever @p registry gains a buffer. */
+  std::atomic<uint64_t> registry_version{0};
+  alignas(64) std::atomic<bool> sleeping{false};
+  /** Signalled by the worker every time it runs out of records. */
+  std::condition_variable drained;
+  /** flush() callers parked on @p drained, woken after every pass. */
+  std::atomic<uint32_t> flush_waiters{0};
+  bool run{true};
+  std::thread thread;
+};
+
+} // namespace micro_logger
+
+#endif // MICRO_LOGGER_DEFERRED_FORMATTER_H
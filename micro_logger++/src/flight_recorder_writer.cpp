@@ -0,0 +1,288 @@
+/*
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/.
+ */
+#include "micro_logger/micro_logger.hpp"
+//
+#include <cerrno>
+#include <climits>
+#include <format>
+#include <iostream>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+namespace micro_logger {
+
+namespace {
+/** Lower half of a block word or record header. */
+constexpr uint64_t lower = 0xffffffff;
+/** Lines handed to one write_batch() of a dump. */
+constexpr int dump_batch = 256;
+
+/** Every record starts with a header and is 8 byte aligned. */
+constexpr size_t record_size(size_t length) {
+  return (sizeof(uint64_t) + length + 7) & ~size_t{7};
+}
+
+/** Writers registered by install_signal_handler(), woken by on_signal. */
+std::atomic<FlightRecorderWriter *> signal_writers[8];
+/** on_signal calls still running, a writer is only gone once it is 0. */
+std::atomic<int> running_handlers{0};
+std::mutex signal_sync;
+/** Signals with on_signal installed, with the action it replaced. */
+std::vector<std::pair<int, struct sigaction>> installed_signals;
+} // namespace
+
+FlightRecorderWriter::FlightRecorderWriter(
+    std::unique_ptr<BaseWriter> &output,
+    const FlightRecorderWriterParameters &parameters)
+    : output(std::move(output)), parameters(parameters),
+      block_size((std::max(parameters.block_size, size_t{256}) + 7) &
+                 ~size_t{7}),
+      block_count(std::max<size_t>(
+          (parameters.capacity + block_size - 1) / block_size, 2)),
+      blocks(std::make_unique<Block[]>(block_count)),
+      storage(std::make_unique<uint64_t[]>(block_count * block_size / 8)),
+      data(reinterpret_cast<char *>(storage.get())) {
+  // room for the whole ring, copying it out never reallocates
+  dump_buffer.reserve(block_count * block_size);
+}
+
+FlightRecorderWriter::~FlightRecorderWriter() {
+  if (dump_signal) {
+    std::scoped_lock lock(signal_sync);
+    for (auto &slot : signal_writers) {
+      FlightRecorderWriter *self = this;
+      slot.compare_exchange_strong(self, nullptr);
+    }
+    // a handler may have read the slot before it was cleared
+    while (running_handlers.load() != 0) {
+      std::this_thread::yield();
+    }
+    // the last writer of a signal gives it back
+    std::erase_if(installed_signals, [](const auto &installed) {
+      for (auto &slot : signal_writers) {
+        auto *writer = slot.load();
+        if (writer and writer->dump_signal == installed.first) {
+          return false;
+        }
+      }
+      sigaction(installed.first, &installed.second, nullptr);
+      return true;
+    });
+  }
+  if (signal_thread.joinable()) {
+    run.store(false, std::memory_order_relaxed);
+    const uint64_t wake = 1;
+    ::write(signal_fd, &wake, sizeof(wake));
+    signal_thread.join();
+  }
+  if (signal_fd >= 0) {
+    close(signal_fd);
+  }
+  output->flush();
+}
+
+size_t FlightRecorderWriter::write(const char *buf, size_t size) const {
+  iovec fragment{const_cast<char *>(buf), size};
+  return record(&fragment, 1);
+}
+
+size_t FlightRecorderWriter::writev(const iovec *fragments, int count) const {
+  return record(fragments, count);
+}
+
+size_t FlightRecorderWriter::write_record(Level level, const iovec *fragments,
+                                          int count) const {
+  const auto size = record(fragments, count);
+  if (parameters.dump_on_severe and level >= Level::error) [[unlikely]] {
+    dump();
+  }
+  return size;
+}
+
+size_t FlightRecorderWriter::record(const iovec *fragments, int count) const {
+  size_t size = 0;
+  for (int i = 0; i < count; ++i) {
+    size += fragments[i].iov_len;
+  }
+  size = std::min(size, block_size - sizeof(uint64_t));
+  const size_t room = record_size(size);
+  while (true) {
+    const auto generation = active.load(std::memory_order_acquire);
+    auto &block = blocks[generation % block_count];
+    auto word = block.reserved.load(std::memory_order_acquire);
+    // a compare-and-swap, so a failed attempt takes no room from the block
+    while ((word >> 32) == (generation & lower)) {
+      const size_t start = word & lower;
+      if (start > block_size) {
+        // full, another thread is rolling over
+        std::this_thread::yield();
+        break;
+      }
+      if (start + room > block_size) {
+        if (block.reserved.compare_exchange_weak(
+                word, (word & ~lower) | (block_size + 1),
+                std::memory_order_relaxed)) {
+          roll(generation, start);
+          break;
+        }
+        continue;
+      }
+      if (not block.reserved.compare_exchange_weak(
+              word, word + room, std::memory_order_relaxed)) {
+        continue;
+      }
+      char *target = data + generation % block_count * block_size + start;
+      char *line = target + sizeof(uint64_t);
+      size_t copied = 0;
+      for (int i = 0; i < count and copied < size; ++i) {
+        const auto chunk = std::min(fragments[i].iov_len, size - copied);
+        std::memcpy(line + copied, fragments[i].iov_base, chunk);
+        copied += chunk;
+      }
+      // length + 1, a zero header is never a record
+      std::atomic_ref(*reinterpret_cast<uint64_t *>(target))
+          .store(((generation & lower) << 32) | (size + 1),
+                 std::memory_order_release);
+      block.committed.fetch_add(room, std::memory_order_release);
+      return size;
+    }
+  }
+}
+
+void FlightRecorderWriter::roll(uint64_t full, size_t length) const {
+  blocks[full % block_count].length = length;
+  const auto next = full + 1;
+  auto &block = blocks[next % block_count];
+  // lines of the lap before may still be copying into the oldest block
+  while (block.committed.load(std::memory_order_acquire) < block.length) {
+    std::this_thread::yield();
+  }
+  block.committed.store(0, std::memory_order_relaxed);
+  block.reserved.store((next & lower) << 32, std::memory_order_release);
+  active.store(next, std::memory_order_release);
+}
+
+size_t FlightRecorderWriter::dump() const {
+  std::scoped_lock lock(dump_sync);
+  const auto newest = active.load(std::memory_order_acquire);
+  const auto oldest = newest + 1 >= block_count ? newest + 1 - block_count : 0;
+  auto generation = std::max(oldest, dumped_generation);
+  size_t offset = generation == dumped_generation ? dumped_offset : 0;
+  dump_buffer.clear();
+  std::vector<size_t> ends;
+  for (; generation <= newest; ++generation, offset = 0) {
+    auto &block = blocks[generation % block_count];
+    const char *base = data + generation % block_count * block_size;
+    const auto buffer_mark = dump_buffer.size();
+    const auto ends_mark = ends.size();
+    while (offset + sizeof(uint64_t) <= block_size) {
+      const auto header =
+          std::atomic_ref(*reinterpret_cast<uint64_t *>(
+                              const_cast<char *>(base + offset)))
+              .load(std::memory_order_acquire);
+      if ((header >> 32) != (generation & lower) or (header & lower) == 0) {
+        break;
+      }
+      const size_t length = (header & lower) - 1;
+      const char *line = base + offset + sizeof(uint64_t);
+      dump_buffer.insert(dump_buffer.end(), line, line + length);
+      ends.push_back(dump_buffer.size());
+      offset += record_size(length);
+    }
+    // reused while we copied, what we took may be torn
+    if ((block.reserved.load(std::memory_order_acquire) >> 32) !=
+        (generation & lower)) {
+      dump_buffer.resize(buffer_mark);
+      ends.resize(ends_mark);
+    }
+    if (generation == newest) {
+      dumped_generation = generation;
+      dumped_offset = offset;
+    }
+  }
+  iovec batch[dump_batch];
+  size_t begin = 0;
+  for (size_t i = 0; i < ends.size();) {
+    int count = 0;
+    for (; count < dump_batch and i < ends.size(); ++count, ++i) {
+      batch[count] = {dump_buffer.data() + begin, ends[i] - begin};
+      begin = ends[i];
+    }
+    output->write_batch(batch, count);
+  }
+  output->flush();
+  return ends.size();
+}
+
+void FlightRecorderWriter::install_signal_handler(int signal) {
+  std::scoped_lock lock(signal_sync);
+  if (signal_fd < 0) {
+    signal_fd = eventfd(0, EFD_CLOEXEC);
+    if (signal_fd < 0) {
+      std::cerr << "failed to create eventfd" << std::endl;
+      throw std::domain_error(std::format("{}", strerrordesc_np(errno)));
+    }
+    signal_thread = std::thread(&FlightRecorderWriter::signal_worker, this);
+  }
+  dump_signal = signal;
+  if (std::none_of(
+          installed_signals.begin(), installed_signals.end(),
+          [&](const auto &installed) { return installed.first == signal; })) {
+    struct sigaction action = {};
+    action.sa_handler = &FlightRecorderWriter::on_signal;
+    action.sa_flags = SA_RESTART;
+    sigemptyset(&action.sa_mask);
+    struct sigaction previous;
+    if (sigaction(signal, &action, &previous) == -1) {
+      std::cerr << "failed to install handler for signal: " << signal
+                << std::endl;
+      throw std::domain_error(std::format("{}", strerrordesc_np(errno)));
+    }
+    installed_signals.emplace_back(signal, previous);
+  }
+  for (auto &slot : signal_writers) {
+    if (slot.load() == this) {
+      return;
+    }
+  }
+  for (auto &slot : signal_writers) {
+    FlightRecorderWriter *empty = nullptr;
+    if (slot.compare_exchange_strong(empty, this)) {
+      return;
+    }
+  }
+  throw std::domain_error("too many writers with a signal handler");
+}
+
+void FlightRecorderWriter::on_signal(int signal) {
+  const int saved = errno;
+  // counted before the slots are read, see ~FlightRecorderWriter
+  running_handlers.fetch_add(1);
+  for (auto &slot : signal_writers) {
+    auto *writer = slot.load();
+    if (writer and writer->dump_signal == signal) {
+      const uint64_t wake = 1;
+      ::write(writer->signal_fd, &wake, sizeof(wake));
+    }
+  }
+  running_handlers.fetch_sub(1);
+  errno = saved;
+}
+
+void FlightRecorderWriter::signal_worker() {
+  uint64_t wakes;
+  while (true) {
+    if (::read(signal_fd, &wakes, sizeof(wakes)) < 0 and errno == EINTR) {
+      continue;
+    }
+    if (not run.load(std::memory_order_relaxed)) {
+      return;
+    }
+    dump();
+  }
+}
+
+} // namespace micro_logger
@@ -0,0 +1,40 @@
+/*
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/.
+ */
+
+#ifndef MICRO_LOGGER_HEADER_FORMATTER_H
+#define MICRO_LOGGER_HEADER_FORMATTER_H
+
+#include <string>
+
+namespace micro_logger {
+
+/**
+ * Per-thread header pattern with the thread info already rendered in.
+ *
+ * @p pattern takes level, file, line, func and message.  The std::format
+ * path writes the message itself, so the pattern is also kept split
+ * around the message placeholder.
+ */
+struct HeaderFormatter {
+  std::string pattern;
+  /** @p pattern up to the message placeholder. */
+  std::string prefix;
+  /** Literal remainder of @p pattern after the message. */
+  std::string suffix;
+};
+
+/**
+ * Header formatter of the calling thread.
+ *
+ * Rendered on the first call of each thread and reached through a
+ * thread_local pointer afterwards, without any lock or lookup.  It is
+ * released when the thread exits.
+ */
+const HeaderFormatter &init_header_formatter();
+
+} // namespace micro_logger
+
+#endif // MICRO_LOGGER_HEADER_FORMATTER_H
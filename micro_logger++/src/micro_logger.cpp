@@ -4,119 +4,282 @@
  * file, You can obtain one at https://mozilla.org/MPL/2.0/.
  */
 #include "micro_logger/micro_logger.hpp"
+#include "deferred_formatter.h"
+#include "header_formatter.h"
 #include "thread_info.h"
+#include "timestamp.h"
 //
+#include <algorithm>
 #include <chrono>
 #include <cstring>
+#include <iterator>
 #include <memory>
 #include <mutex>
-#include <shared_mutex>
 #include <stdarg.h>
-#include <unordered_map>
+#include <string>
+
+// unmangled, the C API reads it as an `_Atomic int`
+static_assert(sizeof(std::atomic<int>) == sizeof(int) and
+              std::atomic<int>::is_always_lock_free);
+std::atomic<int> micro_logger_level_threshold{MICRO_LOGGER_LEVEL_TRACE};
 
 namespace micro_logger {
 const BaseWriter *custom_writer = nullptr;
 const micro_logger_CustomParameters *custom_parameters = nullptr;
 std::mutex sync_write;
-std::shared_mutex sync_init_header_formatter;
-
-using CachePattern =
-    std::unordered_map<std::thread::id, std::unique_ptr<char[]>>;
+/** Cached `custom_writer->is_thread_safe()`; skips @p sync_write when set. */
+bool writer_is_thread_safe = false;
 
-struct CachePatternReclaimMemory {
-  CachePattern *ptr;
-  std::thread::id id;
-
-  ~CachePatternReclaimMemory() {
-    if (ptr) {
-      std::unique_lock lock(sync_init_header_formatter);
-      ptr->erase(id);
-    }
-  }
+/**
+ * Owns the calling thread's HeaderFormatter.  The hot path only reads the
+ * trivially initialised @p thread_header_formatter, which needs no TLS guard.
+ */
+struct HeaderFormatterOwner {
+  std::unique_ptr<HeaderFormatter> formatter;
+  ~HeaderFormatterOwner();
 };
 
-thread_local CachePatternReclaimMemory cached_pattern_reclaim;
+thread_local const HeaderFormatter *thread_header_formatter = nullptr;
+thread_local bool thread_header_formatter_released = false;
+thread_local HeaderFormatterOwner header_formatter_owner;
+
+HeaderFormatterOwner::~HeaderFormatterOwner() {
+  thread_header_formatter = nullptr;
+  thread_header_formatter_released = true;
+}
 
 void initialize(const BaseWriter &writer,
                 const micro_logger_CustomParameters *parameters) {
   if (not custom_writer) {
     custom_writer = &writer;
+    writer_is_thread_safe = writer.is_thread_safe();
   }
   if (not custom_parameters) {
     custom_parameters = parameters ? parameters : &default_parameters;
   }
 }
 
-const char *init_header_formatter() {
-  auto thread_id = std::this_thread::get_id();
-  static CachePattern cached_patterns;
-  {
-    std::shared_lock lock(sync_init_header_formatter);
-    if (auto it = cached_patterns.find(thread_id);
-        it != cached_patterns.end()) {
-      return &it->second[0];
-    }
+bool flush(std::chrono::milliseconds timeout) {
+  if (not custom_writer) {
+    return true;
+  }
+  const bool forever = timeout == timeout.max();
+  const auto deadline = forever ? std::chrono::steady_clock::time_point::max()
+                                : std::chrono::steady_clock::now() + timeout;
+  // lines still waiting for deferred formatting are not in the writer yet
+  if (not DeferredFormatter::get_instance().flush(deadline)) {
+    return false;
+  }
+  if (not forever) {
+    timeout = std::max(std::chrono::duration_cast<std::chrono::milliseconds>(
+                           deadline - std::chrono::steady_clock::now()),
+                       std::chrono::milliseconds(0));
+  }
+  if (writer_is_thread_safe) {
+    return custom_writer->flush(timeout);
+  }
+  const std::lock_guard<std::mutex> lock(sync_write);
+  return custom_writer->flush(timeout);
+}
+
+void set_level(Level level) {
+  micro_logger_level_threshold.store(static_cast<int>(level),
+                                     std::memory_order_relaxed);
+}
+
+Level get_level() {
+  return static_cast<Level>(
+      micro_logger_level_threshold.load(std::memory_order_relaxed));
+}
+
+const HeaderFormatter &init_header_formatter() {
+  if (thread_header_formatter) [[likely]] {
+    return *thread_header_formatter;
   }
-  std::unique_lock lock(sync_init_header_formatter);
   ThreadInfo thread_info;
-  cached_patterns[thread_id] =
-      std::make_unique<char[]>(custom_parameters->header_size);
-  auto &buf = cached_patterns[thread_id];
-  // at this point we are ready only from cached_patterns perspective
-  lock.unlock();
-  //
-  cached_pattern_reclaim.ptr = &cached_patterns;
-  cached_pattern_reclaim.id = thread_id;
-  //
-  std::snprintf(&buf[0], custom_parameters->header_size,
-                custom_parameters->header_pattern, thread_info.info.c_str(),
+  auto formatter = std::make_unique<HeaderFormatter>();
+  char buf[custom_parameters->header_size];
+  std::snprintf(buf, sizeof(buf), custom_parameters->header_pattern,
+                thread_info.info.c_str(),
                 custom_parameters->align_filename_length,
                 custom_parameters->align_lines_length);
-  return &buf[0];
+  formatter->pattern = buf;
+  auto message = formatter->pattern.rfind("%s");
+  formatter->prefix = formatter->pattern.substr(0, message);
+  for (size_t i = message + 2; i < formatter->pattern.size(); ++i) {
+    formatter->suffix += formatter->pattern[i];
+    if (formatter->pattern[i] == '%' and formatter->pattern[i + 1] == '%') {
+      ++i;
+    }
+  }
+  thread_header_formatter = formatter.get();
+  if (thread_header_formatter_released) {
+    // logging from a thread_local destructor that ran after the owner;
+    // nothing is left to free it, keep it alive until the process exits
+    formatter.release();
+  } else {
+    header_formatter_owner.formatter = std::move(formatter);
+  }
+  return *thread_header_formatter;
 }
 
-size_t get_time(char *output) {
-  const auto current_time_point{std::chrono::system_clock::now()};
-  const auto t{std::chrono::system_clock::to_time_t(current_time_point)};
-  const auto current_time_since_epoch{current_time_point.time_since_epoch()};
-  const auto current_milliseconds{
-      std::chrono::duration_cast<std::chrono::milliseconds>(
-          current_time_since_epoch)
-          .count() %
-      1000};
-  std::tm tm{};
-  auto time_info = ::localtime_r(&t, &tm);
-  size_t size = 0;
-  if (time_info) {
-    size = std::strftime(output, custom_parameters->header_size,
-                         custom_parameters->time_format, time_info);
-  }
-  if (size and custom_parameters->milliseconds_format) {
-    size += std::snprintf(output + size, custom_parameters->header_size - size,
-                          custom_parameters->milliseconds_format,
-                          current_milliseconds);
-  }
-  return size;
+/**
+ * Level of a line from its `LVL_*` name.  Compared by content, the C library
+ * passes its own copies of the names; their first letters differ.
+ */
+inline Level to_level(const char *level) {
+  switch (level[0]) {
+  case 'T':
+    return Level::trace;
+  case 'D':
+    return Level::debug;
+  case 'W':
+    return Level::warn;
+  case 'E':
+    return Level::error;
+  case 'C':
+    return Level::critical;
+  default:
+    return Level::info;
+  }
+}
+
+/**
+ * Hand a complete line to the writer, serialised unless it is thread safe.
+ * What the level means, e.g. pushing buffers for ERROR, is up to the writer.
+ */
+void write_output(const iovec *fragments, int count, Level level) {
+  if (writer_is_thread_safe) {
+    custom_writer->write_record(level, fragments, count);
+    return;
+  }
+  const std::lock_guard<std::mutex> lock(sync_write);
+  custom_writer->write_record(level, fragments, count);
+}
+
+/**
+ * Render timestamp and header up to the message into @p output.
+ * @return number of bytes written, always less than @p output_size.
+ */
+size_t write_header(char *output, size_t output_size,
+                    const HeaderFormatter &header_formatter,
+                    std::chrono::system_clock::time_point time_point,
+                    const char *level, const char *file, const char *func,
+                    int line) {
+  auto size = get_time(output, time_point, *custom_parameters);
+  auto header_size =
+      std::snprintf(output + size, output_size - size,
+                    header_formatter.prefix.c_str(), level, file, line, func);
+  return std::min(size + std::max(header_size, 0), output_size - 1);
+}
+
+void set_deferred_formatting(bool enabled, size_t buffer_size) {
+  auto &deferred = DeferredFormatter::get_instance();
+  if (enabled) {
+    deferred.enable(buffer_size);
+  } else {
+    deferred.disable();
+  }
+}
+
+void write_line(const HeaderFormatter &header_formatter,
+                std::chrono::system_clock::time_point time_point,
+                const char *level, const char *file, const char *func,
+                int line, const char *message) {
+  // long file or function names used to eat into the message space, keep
+  // the same room for them
+  static size_t output_size{custom_parameters->message_size +
+                            custom_parameters->header_size};
+  char header[output_size];
+  auto header_size = write_header(header, sizeof(header), header_formatter,
+                                  time_point, level, file, func, line);
+  // the message is passed on as is, no copy into a contiguous line
+  const auto &suffix = header_formatter.suffix;
+  iovec fragments[]{
+      {header, header_size},
+      {const_cast<char *>(message),
+       strnlen(message, custom_parameters->message_size - 1)},
+      {const_cast<char *>(suffix.data()), suffix.size()},
+  };
+  write_output(fragments, std::size(fragments), to_level(level));
 }
 
 void __logme(const char *level, const char *file, const char *func, int line,
              const char *fmt, ...) {
-  const char *header_formatter{init_header_formatter()};
-  char message[custom_parameters->message_size];
-  static size_t output_size{sizeof(message) + custom_parameters->header_size};
-  // message
+  const auto &header_formatter{init_header_formatter()};
   va_list args;
   va_start(args, fmt);
+  if (auto &deferred = DeferredFormatter::get_instance();
+      deferred.is_enabled()) {
+    if (deferred.push(header_formatter, level, file, func, line, fmt, args)) {
+      va_end(args);
+      return;
+    }
+    // formatted here, after the lines still queued for this thread
+    deferred.drain_thread();
+  }
+  // message
+  char message[custom_parameters->message_size];
   std::vsnprintf(message, sizeof(message), fmt, args);
   va_end(args);
   //
+  write_line(header_formatter, std::chrono::system_clock::now(), level, file,
+             func, line, message);
+}
+namespace {
+/** Output iterator which silently drops everything past @p end. */
+struct TruncatingIterator {
+  using iterator_category = std::output_iterator_tag;
+  using value_type = char;
+  using difference_type = std::ptrdiff_t;
+  using pointer = char *;
+  using reference = char &;
+  char *position;
+  char *end;
+  char overflow{};
+  char &operator*() { return position != end ? *position : overflow; }
+  TruncatingIterator &operator++() {
+    if (position != end) {
+      ++position;
+    }
+    return *this;
+  }
+  TruncatingIterator operator++(int) {
+    auto out = *this;
+    ++*this;
+    return out;
+  }
+};
+} // namespace
+
+void __logme_format(const char *level, const char *file, const char *func,
+                    int line, std::string_view fmt, std::format_args args) {
+  const auto &header_formatter{init_header_formatter()};
+  if (auto &deferred = DeferredFormatter::get_instance();
+      deferred.is_enabled()) {
+    deferred.drain_thread();
+  }
+  static size_t output_size{custom_parameters->message_size +
+                            custom_parameters->header_size};
   char output[output_size];
-  auto current_time_size = get_time(output);
   auto size =
-      std::snprintf(output + current_time_size, output_size - current_time_size,
-                    header_formatter, level, file, line, func, message);
+      write_header(output, output_size, header_formatter,
+                   std::chrono::system_clock::now(), level, file, func, line);
+  // message goes straight into the line, bounded like the printf path but
+  // never at the cost of the suffix
+  const auto &suffix = header_formatter.suffix;
+  const auto suffix_size = std::min(suffix.size(), output_size - size);
+  const auto message_size = std::min(custom_parameters->message_size - 1,
+                                     output_size - size - suffix_size);
+  auto message_end =
+      std::vformat_to(TruncatingIterator{output + size,
+                                         output + size + message_size},
+                      fmt, args)
+          .position;
+  std::memcpy(message_end, suffix.data(), suffix_size);
+  size = message_end + suffix_size - output;
   //
-  const std::lock_guard<std::mutex> lock(sync_write);
-  custom_writer->write(output, size + current_time_size);
+  iovec fragment{output, size};
+  write_output(&fragment, 1, to_level(level));
 }
 } // namespace micro_logger
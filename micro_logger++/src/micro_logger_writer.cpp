@@ -3,26 +3,91 @@
  * License, v. 2.0. If a copy of the MPL was not distributed with this
  * file, You can obtain one at https://mozilla.org/MPL/2.0/.
  */
-#include "micro_logger/micro_logger_writer.hpp"
+#include "micro_logger/micro_logger.hpp"
 //
 #include <arpa/inet.h>
+#include <climits>
+#include <cstddef>
 #include <csignal>
 #include <cstring>
 #include <errno.h>
+#include <exception>
+#include <fcntl.h>
 #include <format>
+#include <functional>
 #include <iostream>
 #include <mutex>
+#include <poll.h>
+#include <pthread.h>
+#include <sched.h>
 #include <sys/socket.h>
+#include <sys/un.h>
+#include <time.h>
 #include <unistd.h>
+#include <vector>
 
 namespace micro_logger {
+size_t BaseWriter::writev(const iovec *fragments, int count) const {
+  size_t size = 0;
+  for (int i = 0; i < count; ++i) {
+    size += fragments[i].iov_len;
+  }
+  // log lines are bounded by header_size + message_size, so the stack
+  // buffer covers the default parameters; larger ones take the heap
+  char stack[2048];
+  std::unique_ptr<char[]> heap;
+  char *line = stack;
+  if (size > sizeof(stack)) {
+    heap = std::make_unique<char[]>(size);
+    line = heap.get();
+  }
+  size_t offset = 0;
+  for (int i = 0; i < count; ++i) {
+    std::memcpy(line + offset, fragments[i].iov_base, fragments[i].iov_len);
+    offset += fragments[i].iov_len;
+  }
+  return write(line, size);
+}
+
+size_t BaseWriter::write_record(Level /*level*/, const iovec *fragments,
+                                int count) const {
+  if (count == 1) {
+    return write(static_cast<const char *>(fragments[0].iov_base),
+                 fragments[0].iov_len);
+  }
+  return writev(fragments, count);
+}
+
+size_t BaseWriter::write_batch(const iovec *lines, int count) const {
+  size_t size = 0;
+  for (int i = 0; i < count; ++i) {
+    size += write(static_cast<const char *>(lines[i].iov_base),
+                  lines[i].iov_len);
+  }
+  return size;
+}
+
 size_t StandardOutWriter::write(const char *buf, size_t size) const {
   std::cout.write(buf, size);
   return size;
 }
 
+bool StandardOutWriter::flush(std::chrono::milliseconds /*timeout*/) const {
+  return static_cast<bool>(std::cout.flush());
+}
+
 size_t SilentWriter::write(const char *data, size_t size) const { return 0; }
 
+size_t SilentWriter::writev(const iovec * /*fragments*/,
+                            int /*count*/) const {
+  return 0;
+}
+
+size_t SilentWriter::write_batch(const iovec * /*lines*/,
+                                 int /*count*/) const {
+  return 0;
+}
+
 FileWriter::FileWriter(const char *path) : outfile(path) {
   if (not outfile.is_open()) {
     std::cerr << "failed to open file: " << path << std::endl;
@@ -35,121 +100,1258 @@ size_t FileWriter::write(const char *data, size_t size) const {
   return size;
 }
 
+size_t FileWriter::writev(const iovec *fragments, int count) const {
+  size_t size = 0;
+  for (int i = 0; i < count; ++i) {
+    outfile.write(static_cast<const char *>(fragments[i].iov_base),
+                  fragments[i].iov_len);
+    size += fragments[i].iov_len;
+  }
+  return size;
+}
+
+size_t FileWriter::write_batch(const iovec *lines, int count) const {
+  return writev(lines, count);
+}
+
+bool FileWriter::flush(std::chrono::milliseconds /*timeout*/) const {
+  return static_cast<bool>(outfile.flush());
+}
+
 FileWriter::~FileWriter() { outfile.close(); }
 
-NetworkWriter *instance = nullptr;
-std::mutex instance_mutex;
-NetworkWriter::NetworkWriter(const std::string &address, int port)
-    : address(address), port(port), sock(socket(AF_INET, SOCK_STREAM, 0)) {
-  instance = this;
-  reconnect();
+namespace {
+/** Cheap clock for the flush interval, a few milliseconds coarse at most. */
+int64_t coarse_now_ns() {
+  timespec now;
+  clock_gettime(CLOCK_MONOTONIC_COARSE, &now);
+  return now.tv_sec * 1000000000LL + now.tv_nsec;
+}
+} // namespace
 
-  struct sigaction action = {};
-  action.sa_handler = [](int) { // simple not beautiful solution to reconnect
-    std::lock_guard<std::mutex> lock(instance_mutex);
-    if (instance) {
-      try {
-        instance->reset_socket();
-        instance->reconnect();
-      } catch (const std::exception &e) {
-        std::cerr << e.what() << std::endl;
+BufferedFileWriter::BufferedFileWriter(
+    const char *path, const BufferedFileWriterParameters &parameters)
+    : parameters(parameters),
+      fd(::open(path, O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0644)),
+      buffer(std::make_unique<char[]>(parameters.buffer_size)),
+      threshold(parameters.flush_bytes
+                    ? std::min(parameters.flush_bytes, parameters.buffer_size)
+                    : parameters.buffer_size),
+      interval_ns(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                      parameters.flush_interval)
+                      .count()) {
+  if (fd < 0) {
+    std::cerr << "failed to open file: " << path << std::endl;
+    throw std::domain_error("open file");
+  }
+}
+
+bool BufferedFileWriter::write_fd(const iovec *fragments, int count) const {
+  ssize_t written;
+  do {
+    written = ::writev(fd, fragments, std::min(count, IOV_MAX));
+  } while (written < 0 and errno == EINTR);
+  if (written < 0) {
+    return false;
+  }
+  // finish whatever a short write or IOV_MAX left behind
+  size_t skip = written;
+  for (int i = 0; i < count; ++i) {
+    const auto *data = static_cast<const char *>(fragments[i].iov_base);
+    size_t size = fragments[i].iov_len;
+    if (skip >= size) {
+      skip -= size;
+      continue;
+    }
+    data += skip;
+    size -= skip;
+    skip = 0;
+    while (size) {
+      auto chunk = ::write(fd, data, size);
+      if (chunk < 0 and errno == EINTR) {
+        continue;
+      }
+      if (chunk < 0) {
+        return false;
       }
+      data += chunk;
+      size -= chunk;
     }
-  };
+  }
+  return true;
+}
 
-  if (sigaction(SIGPIPE, &action, nullptr) == -1) {
-    throw std::domain_error(std::format("{}", strerrordesc_np(errno)));
+bool BufferedFileWriter::write_buffer() const {
+  if (used == 0) {
+    return true;
   }
+  iovec content{buffer.get(), used};
+  used = 0;
+  return write_fd(&content, 1);
 }
 
-void NetworkWriter::reconnect() {
-  if (sock < 0) {
-    throw std::domain_error(
-        std::format("{} {}:{}", strerrordesc_np(errno), address, port));
+size_t BufferedFileWriter::write(const char *buf, size_t size) const {
+  iovec fragment{const_cast<char *>(buf), size};
+  return writev(&fragment, 1);
+}
+
+size_t BufferedFileWriter::writev(const iovec *fragments, int count) const {
+  size_t size = 0;
+  for (int i = 0; i < count; ++i) {
+    size += fragments[i].iov_len;
+  }
+  if (used + size > parameters.buffer_size) {
+    write_buffer();
+  }
+  if (size > parameters.buffer_size) {
+    return write_fd(fragments, count) ? size : 0;
   }
+  if (used == 0 and interval_ns) {
+    oldest_ns = coarse_now_ns();
+  }
+  for (int i = 0; i < count; ++i) {
+    std::memcpy(buffer.get() + used, fragments[i].iov_base,
+                fragments[i].iov_len);
+    used += fragments[i].iov_len;
+  }
+  if (used >= threshold or
+      (interval_ns and coarse_now_ns() - oldest_ns >= interval_ns)) {
+    write_buffer();
+  }
+  return size;
+}
 
-  sockaddr_in serv_addr = {};
-  serv_addr.sin_family = AF_INET;
-  serv_addr.sin_port = htons(port);
+size_t BufferedFileWriter::write_batch(const iovec *lines, int count) const {
+  return writev(lines, count);
+}
 
-  if (inet_pton(AF_INET, address.c_str(), &serv_addr.sin_addr) <= 0) {
-    throw std::domain_error(
-        std::format("{} {}:{}", strerrordesc_np(errno), address, port));
+size_t BufferedFileWriter::write_record(Level level, const iovec *fragments,
+                                        int count) const {
+  const auto size = writev(fragments, count);
+  if (parameters.flush_on_severe and level >= Level::error) [[unlikely]] {
+    write_buffer();
+  }
+  return size;
+}
+
+bool BufferedFileWriter::flush(std::chrono::milliseconds timeout) const {
+  bool written = write_buffer();
+  // a zero timeout must not stall the caller on the disk
+  if (parameters.sync and timeout != timeout.zero()) {
+    written = ::fdatasync(fd) == 0 and written;
   }
+  return written;
+}
 
-  if ((client_fd = connect(sock, (struct sockaddr *)&serv_addr,
-                           sizeof(serv_addr))) < 0) {
+BufferedFileWriter::~BufferedFileWriter() {
+  write_buffer();
+  close(fd);
+}
+
+namespace {
+std::pair<sockaddr_storage, socklen_t> inet_address(const std::string &address,
+                                                    int port) {
+  std::pair<sockaddr_storage, socklen_t> destination{{}, sizeof(sockaddr_in)};
+  auto &inet = reinterpret_cast<sockaddr_in &>(destination.first);
+  inet.sin_family = AF_INET;
+  inet.sin_port = htons(port);
+  if (inet_pton(AF_INET, address.c_str(), &inet.sin_addr) <= 0) {
+    std::cerr << "failed to parse address: " << address << std::endl;
     throw std::domain_error(
-        std::format("{} {}:{}", strerrordesc_np(errno), address, port));
+        std::format("invalid address {}:{}", address, port));
   }
+  return destination;
 }
 
-void NetworkWriter::reset_socket() {
-  close(client_fd);
-  sock = socket(AF_INET, SOCK_STREAM, 0);
+std::pair<sockaddr_storage, socklen_t> unix_address(const std::string &path) {
+  std::pair<sockaddr_storage, socklen_t> destination{};
+  auto &local = reinterpret_cast<sockaddr_un &>(destination.first);
+  local.sun_family = AF_UNIX;
+  // the abstract namespace starts with a NUL and is not terminated
+  const bool abstract = path.starts_with('@');
+  const size_t limit = sizeof(local.sun_path) - (abstract ? 0 : 1);
+  if (path.empty() or path.size() > limit) {
+    std::cerr << "failed to use socket path: " << path << std::endl;
+    throw std::domain_error(std::format("invalid socket path {}", path));
+  }
+  std::memcpy(local.sun_path, path.data(), path.size());
+  if (abstract) {
+    local.sun_path[0] = '\0';
+  }
+  destination.second = offsetof(sockaddr_un, sun_path) + path.size() +
+                       (abstract ? 0 : 1);
+  return destination;
 }
 
-size_t NetworkWriter::write(const char *data, size_t size) const {
-  return send(sock, data, size, 0);
+int unix_socket_type(UnixSocketType type) {
+  switch (type) {
+  case UnixSocketType::seqpacket:
+    return SOCK_SEQPACKET;
+  case UnixSocketType::datagram:
+    return SOCK_DGRAM;
+  default:
+    return SOCK_STREAM;
+  }
 }
+} // namespace
 
-NetworkWriter::~NetworkWriter() {
-  std::lock_guard<std::mutex> lock(instance_mutex);
-  close(client_fd);
-  instance = nullptr;
+NetworkWriter::NetworkWriter(const std::string &address, int port,
+                             const NetworkWriterParameters &parameters)
+    : NetworkWriter(inet_address(address, port), SOCK_STREAM, parameters) {}
+
+NetworkWriter::NetworkWriter(
+    const std::pair<sockaddr_storage, socklen_t> &destination, int type,
+    const NetworkWriterParameters &parameters)
+    : parameters(parameters), destination(destination), type(type) {
+  pending.reserve(parameters.buffer_size);
+  thread = std::thread(&NetworkWriter::sender, this);
 }
 
-AsyncWriter::AsyncWriter(std::unique_ptr<BaseWriter> &output)
-    : output(std::move(output)),
-      thread(std::thread(&AsyncWriter::worker, this)), run(true) {}
+UnixSocketWriter::UnixSocketWriter(const std::string &path,
+                                   UnixSocketType type,
+                                   const NetworkWriterParameters &parameters)
+    : NetworkWriter(unix_address(path), unix_socket_type(type), parameters) {}
 
-int64_t AsyncWriter::find_available_entry() const {
-  for (size_t i = 0; i < queue.size(); ++i) {
-    if (not queue[i].is_taken()) {
-      return i;
+NetworkWriter::~NetworkWriter() {
+  {
+    std::scoped_lock lock(sync);
+    run = false;
+  }
+  cv.notify_all();
+  if (thread.joinable()) {
+    thread.join();
+  }
+}
+
+int NetworkWriter::connect_socket() const {
+  int sock = socket(destination.first.ss_family,
+                    type | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if (sock < 0) {
+    return -1;
+  }
+  if (connect(sock, reinterpret_cast<const sockaddr *>(&destination.first),
+              destination.second) == 0) {
+    return sock;
+  }
+  if (errno == EINPROGRESS) {
+    pollfd ready{sock, POLLOUT, 0};
+    int error = 0;
+    socklen_t length = sizeof(error);
+    if (poll(&ready, 1, parameters.connect_timeout.count()) == 1 and
+        getsockopt(sock, SOL_SOCKET, SO_ERROR, &error, &length) == 0 and
+        error == 0) {
+      return sock;
     }
   }
+  close(sock);
   return -1;
 }
 
-size_t AsyncWriter::write(const char *buf, size_t size) const {
+bool NetworkWriter::wait_writable(int sock) const {
+  // a collector which stopped reading only holds up shutdown for a while
+  bool stopping;
   {
     std::scoped_lock lock(sync);
-    auto index = find_available_entry();
-    if (index == -1) {
+    stopping = not run;
+  }
+  pollfd ready{sock, POLLOUT, 0};
+  const int timeout = stopping ? parameters.connect_timeout.count() : 100;
+  return poll(&ready, 1, timeout) != 0 or not stopping;
+}
+
+bool NetworkWriter::send_all(int sock, const char *data, size_t size,
+                             size_t &sent) const {
+  while (sent < size) {
+    auto written = send(sock, data + sent, size - sent, MSG_NOSIGNAL);
+    if (written > 0) {
+      sent += written;
+      continue;
+    }
+    if (written < 0 and errno == EINTR) {
+      continue;
+    }
+    if ((written < 0 and errno != EAGAIN and errno != EWOULDBLOCK) or
+        not wait_writable(sock)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool NetworkWriter::send_messages(int sock, const std::vector<char> &data,
+                                  const std::vector<size_t> &ends,
+                                  size_t &sent) const {
+  constexpr size_t batch = 64;
+  iovec lines[batch];
+  mmsghdr messages[batch];
+  while (sent < ends.size()) {
+    const size_t count = std::min(batch, ends.size() - sent);
+    for (size_t i = 0; i < count; ++i) {
+      const size_t begin = sent + i ? ends[sent + i - 1] : 0;
+      lines[i] = {const_cast<char *>(data.data()) + begin,
+                  ends[sent + i] - begin};
+      messages[i] = {};
+      messages[i].msg_hdr.msg_iov = &lines[i];
+      messages[i].msg_hdr.msg_iovlen = 1;
+    }
+    auto written = sendmmsg(sock, messages, count, MSG_NOSIGNAL);
+    if (written > 0) {
+      sent += written;
+      continue;
+    }
+    if (written < 0 and errno == EINTR) {
+      continue;
+    }
+    if (written < 0 and errno == EMSGSIZE) {
+      std::scoped_lock lock(sync);
+      ++lost;
+      ++sent;
+      continue;
+    }
+    if ((written < 0 and errno != EAGAIN and errno != EWOULDBLOCK) or
+        not wait_writable(sock)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+void NetworkWriter::sender() {
+  const bool messages = type != SOCK_STREAM;
+  std::vector<char> sending;
+  sending.reserve(parameters.buffer_size);
+  std::vector<size_t> sending_ends;
+  // bytes sent on a stream, lines sent on a message socket
+  size_t sent = 0;
+  uint64_t reported_lost = 0;
+  auto backoff = parameters.min_backoff;
+  int sock = -1;
+  const auto done = [&]() {
+    return messages ? sent == sending_ends.size() : sent == sending.size();
+  };
+  const auto unsent = [&]() {
+    if (not messages) {
+      return sending.size() - sent;
+    }
+    return sending.size() - (sent ? sending_ends[sent - 1] : 0);
+  };
+  const auto discard = [&]() {
+    if (messages) {
+      lost += sending_ends.size() - sent + pending_ends.size();
+      sending.resize(sent ? sending_ends[sent - 1] : 0);
+      sending_ends.resize(sent);
+    } else {
+      lost += std::count(sending.begin() + sent, sending.end(), '\n') +
+              std::count(pending.begin(), pending.end(), '\n');
+      sending.resize(sent);
+    }
+    pending.clear();
+    pending_ends.clear();
+    in_flight = 0;
+    flushed.notify_all();
+  };
+  std::unique_lock lock(sync);
+  while (true) {
+    if (sock < 0) {
+      // on shutdown there is one more attempt for what is still queued
+      const bool stopping = not run;
+      if (stopping and done() and pending.empty()) {
+        break;
+      }
+      lock.unlock();
+      sock = connect_socket();
+      lock.lock();
+      if (sock < 0) {
+        if (stopping) {
+          break;
+        }
+        if (parameters.disconnected == DisconnectedPolicy::drop) {
+          discard();
+        }
+        cv.wait_for(lock, backoff, [&]() { return not run; });
+        backoff = std::min(backoff * 2, parameters.max_backoff);
+        continue;
+      }
+      connected = true;
+      backoff = parameters.min_backoff;
+    }
+    if (done()) {
+      sending.clear();
+      sending_ends.clear();
+      sent = 0;
+      in_flight = 0;
+      flushed.notify_all();
+      sender_waiting = true;
+      cv.wait(lock, [&]() { return not run or not pending.empty(); });
+      sender_waiting = false;
+      if (pending.empty()) {
+        break;
+      }
+      std::swap(sending, pending);
+      std::swap(sending_ends, pending_ends);
+      if (lost != reported_lost) {
+        auto line = std::format("[micro_logger] {} messages dropped\n",
+                                lost - reported_lost);
+        sending.insert(sending.end(), line.begin(), line.end());
+        sending_ends.push_back(sending.size());
+        reported_lost = lost;
+      }
+      in_flight = sending.size();
+    }
+    lock.unlock();
+    const bool ok = messages
+                        ? send_messages(sock, sending, sending_ends, sent)
+                        : send_all(sock, sending.data(), sending.size(), sent);
+    lock.lock();
+    if (not ok) {
+      close(sock);
+      sock = -1;
+      connected = false;
+      // the next connection gets the cut line again, from its start
+      while (not messages and sent and sending[sent - 1] != '\n') {
+        --sent;
+      }
+    }
+    in_flight = unsent();
+  }
+  if (sock >= 0) {
+    close(sock);
+  }
+  connected = false;
+  flushed.notify_all();
+}
+
+size_t NetworkWriter::write(const char *buf, size_t size) const {
+  iovec fragment{const_cast<char *>(buf), size};
+  return writev(&fragment, 1);
+}
+
+size_t NetworkWriter::writev(const iovec *fragments, int count) const {
+  size_t size = 0;
+  for (int i = 0; i < count; ++i) {
+    size += fragments[i].iov_len;
+  }
+  std::scoped_lock lock(sync);
+  if (pending.size() + size > parameters.buffer_size or
+      (not connected and
+       parameters.disconnected == DisconnectedPolicy::drop)) {
+    ++lost;
+    return 0;
+  }
+  for (int i = 0; i < count; ++i) {
+    const auto *data = static_cast<const char *>(fragments[i].iov_base);
+    pending.insert(pending.end(), data, data + fragments[i].iov_len);
+  }
+  if (type != SOCK_STREAM) {
+    pending_ends.push_back(pending.size());
+  }
+  if (sender_waiting) {
+    sender_waiting = false;
+    cv.notify_one();
+  }
+  return size;
+}
+
+size_t NetworkWriter::write_batch(const iovec *lines, int count) const {
+  size_t size = 0;
+  for (int i = 0; i < count; ++i) {
+    size += writev(&lines[i], 1);
+  }
+  return size;
+}
+
+bool NetworkWriter::flush(std::chrono::milliseconds timeout) const {
+  std::unique_lock lock(sync);
+  const auto handed_over = [&]() {
+    return (pending.empty() and in_flight == 0) or not run;
+  };
+  if (timeout == std::chrono::milliseconds::max()) {
+    flushed.wait(lock, handed_over);
+    return pending.empty() and in_flight == 0;
+  }
+  return flushed.wait_for(lock, timeout, handed_over) and pending.empty() and
+         in_flight == 0;
+}
+
+uint64_t NetworkWriter::dropped() const {
+  std::scoped_lock lock(sync);
+  return lost;
+}
+
+AsyncWriter::AsyncWriter(std::unique_ptr<BaseWriter> &output,
+                         const AsyncWriterParameters &parameters)
+    : output(std::move(output)), parameters(parameters),
+      capacity((std::max(parameters.capacity, size_t{64}) + 7) & ~size_t{7}),
+      storage(std::make_unique<uint64_t[]>(capacity / 8)),
+      data(reinterpret_cast<char *>(storage.get())), write_index(0),
+      read_index(0), sleeping(false), run(true) {
+  thread = std::thread(&AsyncWriter::worker, this);
+}
+
+bool AsyncWriter::is_ready(uint64_t index) const {
+  return length_at(index % capacity).load(std::memory_order_acquire) != 0;
+}
+
+void AsyncWriter::notify() const {
+  // pairs with the fence in worker(), either the worker sees the published
+  // entry or we see it parked
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  if (sleeping.load(std::memory_order_relaxed)) {
+    { std::scoped_lock lock(sync); }
+    cv.notify_one();
+  }
+}
+
+namespace {
+/** Tell the core we are spinning, eases the sibling hyperthread. */
+inline void cpu_relax() {
+#if defined(__x86_64__) || defined(__i386__)
+  __builtin_ia32_pause();
+#elif defined(__aarch64__)
+  asm volatile("yield");
+#endif
+}
+} // namespace
+
+void AsyncWriter::wait_for_data(uint64_t index) {
+  // a burst seldom leaves a gap longer than a few microseconds, catch the
+  // next line before paying for a park and the producer for a wakeup
+  constexpr int spin_limit = 1000;
+  constexpr int yield_limit = 100;
+  switch (parameters.wait) {
+  case WaitStrategy::busy_spin:
+    while (not is_ready(index) and run and not is_flush_requested(index)) {
+      cpu_relax();
+    }
+    return;
+  case WaitStrategy::spin_yield_park:
+    for (int i = 0; i < spin_limit; ++i) {
+      if (is_ready(index) or not run or is_flush_requested(index)) {
+        return;
+      }
+      cpu_relax();
+    }
+    for (int i = 0; i < yield_limit; ++i) {
+      if (is_ready(index) or not run or is_flush_requested(index)) {
+        return;
+      }
+      std::this_thread::yield();
+    }
+    break;
+  case WaitStrategy::block:
+    break;
+  }
+  std::unique_lock lock(sync);
+  sleeping.store(true, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  cv.wait(lock, [&]() {
+    return is_ready(index) or not run or is_flush_requested(index);
+  });
+  sleeping.store(false, std::memory_order_relaxed);
+}
+
+size_t AsyncWriter::write(const char *buf, size_t size) const {
+  iovec fragment{const_cast<char *>(buf), size};
+  return writev(&fragment, 1);
+}
+
+bool AsyncWriter::reserve(size_t size, size_t &offset) const {
+  const auto record = record_size(size);
+  // reserve the record, together with the padding up to the end of the ring
+  // when it does not fit in front of it
+  auto index = write_index.load(std::memory_order_relaxed);
+  size_t claim;
+  do {
+    offset = index % capacity;
+    claim = offset + record > capacity ? capacity - offset + record : record;
+    if (index + claim - read_index.load(std::memory_order_acquire) >
+        capacity) {
+      return false;
+    }
+  } while (not write_index.compare_exchange_weak(index, index + claim,
+                                                 std::memory_order_relaxed));
+  if (claim != record) {
+    length_at(offset).store(padding, std::memory_order_release);
+    offset = 0;
+  }
+  return true;
+}
+
+bool AsyncWriter::wait_for_room(size_t size, size_t &offset) const {
+  const auto deadline =
+      std::chrono::steady_clock::now() + parameters.block_timeout;
+  // pairs with the fence in worker(), either we see the room it made or it
+  // sees us waiting
+  waiting_producers.fetch_add(1, std::memory_order_seq_cst);
+  bool reserved = false;
+  while (run) {
+    if (parameters.overflow == OverflowPolicy::overwrite_oldest) {
+      // everything below target has to go for a worst case claim to fit
+      const auto claim_end =
+          write_index.load(std::memory_order_relaxed) + 2 * record_size(size);
+      const auto target = claim_end > capacity ? claim_end - capacity : 0;
+      auto current = discard_until.load(std::memory_order_relaxed);
+      while (current < target and
+             not discard_until.compare_exchange_weak(
+                 current, target, std::memory_order_relaxed)) {
+      }
+      notify();
+    }
+    std::unique_lock lock(sync);
+    if ((reserved = reserve(size, offset))) {
+      break;
+    }
+    // the worker may be stuck in @p output with the oldest records still
+    // in its batch, only it can make room
+    if (space_cv.wait_until(lock, deadline) == std::cv_status::timeout) {
+      reserved = reserve(size, offset);
+      break;
+    }
+  }
+  waiting_producers.fetch_sub(1, std::memory_order_relaxed);
+  return reserved;
+}
+
+size_t AsyncWriter::writev(const iovec *fragments, int count) const {
+  size_t size = 0;
+  for (int i = 0; i < count; ++i) {
+    size += fragments[i].iov_len;
+  }
+  size = std::min(size, max_line_size());
+  size_t offset;
+  if (not reserve(size, offset)) [[unlikely]] {
+    switch (parameters.overflow) {
+    case OverflowPolicy::drop_newest:
+      dropped.fetch_add(1, std::memory_order_relaxed);
       return 0;
+    case OverflowPolicy::write_through: {
+      written_through.fetch_add(1, std::memory_order_relaxed);
+      std::scoped_lock lock(output_sync);
+      return output->writev(fragments, count);
+    }
+    case OverflowPolicy::block:
+      blocked.fetch_add(1, std::memory_order_relaxed);
+      [[fallthrough]];
+    case OverflowPolicy::overwrite_oldest:
+      if (not wait_for_room(size, offset)) {
+        dropped.fetch_add(1, std::memory_order_relaxed);
+        return 0;
+      }
+      break;
     }
-    queue[index].update(buf, size);
   }
-  cv.notify_all();
+  auto *line = data + offset + sizeof(RecordHeader);
+  size_t copied = 0;
+  for (int i = 0; i < count and copied < size; ++i) {
+    auto chunk = std::min(fragments[i].iov_len, size - copied);
+    std::memcpy(line + copied, fragments[i].iov_base, chunk);
+    copied += chunk;
+  }
+  length_at(offset).store(size + 1, std::memory_order_release);
+  notify();
   return size;
 }
 
-AsyncWriter::~AsyncWriter() { stop(); }
+AsyncWriterStatistics AsyncWriter::statistics() const {
+  return {
+      .dropped = dropped.load(std::memory_order_relaxed),
+      .blocked = blocked.load(std::memory_order_relaxed),
+      .overwritten = overwritten.load(std::memory_order_relaxed),
+      .written_through = written_through.load(std::memory_order_relaxed),
+  };
+}
+
+bool AsyncWriter::flush(std::chrono::milliseconds timeout) const {
+  const auto target = write_index.load(std::memory_order_acquire);
+  if (timeout == timeout.zero()) {
+    // the worker flushes @p output once it is past the lines queued so far
+    auto current = flush_target.load(std::memory_order_relaxed);
+    while (current < target and
+           not flush_target.compare_exchange_weak(current, target,
+                                                  std::memory_order_relaxed)) {
+    }
+    notify();
+    return read_index.load(std::memory_order_acquire) >= target;
+  }
+  const bool forever = timeout == timeout.max();
+  const auto deadline = forever ? std::chrono::steady_clock::time_point::max()
+                                : std::chrono::steady_clock::now() + timeout;
+  const auto passed = [&]() {
+    return read_index.load(std::memory_order_acquire) >= target;
+  };
+  // pairs with the fence in release(), like wait_for_room(); it also cuts
+  // the worker's linger short
+  waiting_producers.fetch_add(1, std::memory_order_seq_cst);
+  {
+    std::unique_lock lock(sync);
+    if (forever) {
+      space_cv.wait(lock, passed);
+    } else {
+      space_cv.wait_until(lock, deadline, passed);
+    }
+  }
+  waiting_producers.fetch_sub(1, std::memory_order_relaxed);
+  if (not passed()) {
+    return false;
+  }
+  const auto remaining =
+      forever ? timeout
+              : std::max(std::chrono::duration_cast<std::chrono::milliseconds>(
+                             deadline - std::chrono::steady_clock::now()),
+                         std::chrono::milliseconds(0));
+  std::scoped_lock lock(output_sync);
+  return output->flush(remaining);
+}
+
+bool AsyncWriter::is_flush_requested(uint64_t index) const {
+  const auto target = flush_target.load(std::memory_order_relaxed);
+  return target > flushed_to and index >= target;
+}
+
+void AsyncWriter::flush_output_if_requested(uint64_t index) {
+  if (is_flush_requested(index)) [[unlikely]] {
+    std::scoped_lock lock(output_sync);
+    output->flush(std::chrono::milliseconds::zero());
+    flushed_to = index;
+  }
+}
+
+void AsyncWriter::forward(const iovec *lines, int count) {
+  // uncontended unless write_through or flush() are busy with @p output
+  std::scoped_lock lock(output_sync);
+  output->write_batch(lines, count);
+}
+
+void AsyncWriter::release(uint64_t index, uint64_t end) {
+  // a later lap may place a header anywhere in here
+  const auto offset = index % capacity;
+  const auto size = end - index;
+  const auto first = std::min(size, capacity - offset);
+  std::memset(data + offset, 0, first);
+  std::memset(data, 0, size - first);
+  read_index.store(end, std::memory_order_release);
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  if (waiting_producers.load(std::memory_order_relaxed)) {
+    { std::scoped_lock lock(sync); }
+    space_cv.notify_all();
+  }
+}
+
+namespace {
+/** Writers registered by install_crash_handler(), taken by the handlers. */
+std::atomic<AsyncWriter *> crash_writers[8];
+constexpr int crash_signals[]{SIGSEGV, SIGBUS, SIGFPE, SIGILL, SIGABRT};
+struct sigaction previous_actions[std::size(crash_signals)];
+std::terminate_handler previous_terminate = nullptr;
+std::once_flag crash_handlers_installed;
+/** Serialises install_crash_handler(), the handlers only read the slots. */
+std::mutex crash_writers_sync;
+} // namespace
+
+void AsyncWriter::install_crash_handler(int fd) {
+  crash_fd.store(fd, std::memory_order_relaxed);
+  std::call_once(crash_handlers_installed, []() {
+    struct sigaction action = {};
+    action.sa_handler = &AsyncWriter::on_crash_signal;
+    sigemptyset(&action.sa_mask);
+    for (size_t i = 0; i < std::size(crash_signals); ++i) {
+      if (sigaction(crash_signals[i], &action, &previous_actions[i]) == -1) {
+        throw std::domain_error(std::format("{}", strerrordesc_np(errno)));
+      }
+    }
+    previous_terminate = std::set_terminate(&AsyncWriter::on_terminate);
+  });
+  // one pass under the lock, a concurrent call for the same writer must
+  // not take a second slot
+  std::scoped_lock lock(crash_writers_sync);
+  std::atomic<AsyncWriter *> *empty = nullptr;
+  for (auto &slot : crash_writers) {
+    const auto *writer = slot.load();
+    if (writer == this) {
+      return;
+    }
+    if (not writer and not empty) {
+      empty = &slot;
+    }
+  }
+  if (not empty) {
+    throw std::domain_error("too many writers with a crash handler");
+  }
+  empty->store(this);
+}
+
+void AsyncWriter::drain_on_crash() const {
+  // whatever the worker had not released yet, it may be half way through
+  // writing some of it
+  // write(2) only, @p output may be the very thing that crashed or hold a
+  // lock the crashed thread owns
+  const int fd = crash_fd.load(std::memory_order_relaxed);
+  auto index = read_index.load(std::memory_order_acquire);
+  const auto end = write_index.load(std::memory_order_acquire);
+  while (index < end and is_ready(index)) {
+    const auto offset = index % capacity;
+    const auto length = length_at(offset).load(std::memory_order_relaxed);
+    if (length == padding) {
+      index += capacity - offset;
+      continue;
+    }
+    const auto *line = data + offset + sizeof(RecordHeader);
+    const size_t size = length - 1;
+    for (size_t written = 0; written < size;) {
+      auto chunk = ::write(fd, line + written, size - written);
+      if (chunk < 0 and errno == EINTR) {
+        continue;
+      }
+      if (chunk <= 0) {
+        return;
+      }
+      written += chunk;
+    }
+    index += record_size(size);
+  }
+}
+
+void AsyncWriter::on_crash_signal(int signal) {
+  for (auto &slot : crash_writers) {
+    if (auto *writer = slot.exchange(nullptr)) {
+      writer->drain_on_crash();
+    }
+  }
+  // the signal stays blocked until we return, then the previous handler
+  // (by default the core dump) gets it
+  for (size_t i = 0; i < std::size(crash_signals); ++i) {
+    if (crash_signals[i] == signal) {
+      sigaction(signal, &previous_actions[i], nullptr);
+    }
+  }
+  raise(signal);
+}
+
+void AsyncWriter::on_terminate() {
+  // not a signal handler, the worker may still write everything properly
+  for (auto &slot : crash_writers) {
+    if (auto *writer = slot.exchange(nullptr);
+        writer and not writer->flush(std::chrono::seconds(1))) {
+      writer->drain_on_crash();
+    }
+  }
+  if (previous_terminate) {
+    previous_terminate();
+  }
+  std::abort();
+}
+
+AsyncWriter::~AsyncWriter() {
+  for (auto &slot : crash_writers) {
+    AsyncWriter *self = this;
+    slot.compare_exchange_strong(self, nullptr);
+  }
+  stop();
+}
 void AsyncWriter::stop() {
   {
     std::scoped_lock lock(sync);
     run = false;
   }
   cv.notify_all();
+  space_cv.notify_all();
   if (thread.joinable())
     thread.join();
 }
 
 void AsyncWriter::worker() {
+  if (parameters.cpu >= 0) {
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    CPU_SET(parameters.cpu, &cpus);
+    if (pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus) != 0) {
+      std::cerr << "failed to pin async writer to cpu " << parameters.cpu
+                << std::endl;
+    }
+  }
+  auto index = read_index.load(std::memory_order_relaxed);
+  const auto max_batch = static_cast<int>(
+      std::clamp<size_t>(parameters.max_batch_lines, 1, IOV_MAX));
+  std::vector<iovec> batch(max_batch);
+  while (true) {
+    // collect the contiguous ready records, they stay reserved until the
+    // batch has been written; a full lap would see them again
+    int count = 0;
+    auto end = index;
+    const auto linger_until =
+        std::chrono::steady_clock::now() + parameters.linger;
+    while (true) {
+      while (count < max_batch and end - index < capacity and
+             is_ready(end)) {
+        const auto offset = end % capacity;
+        const auto length = length_at(offset).load(std::memory_order_relaxed);
+        if (length == padding) {
+          end += capacity - offset;
+          continue;
+        }
+        if (end < discard_until.load(std::memory_order_relaxed)) [[unlikely]] {
+          overwritten.fetch_add(1, std::memory_order_relaxed);
+        } else {
+          batch[count++] = {data + offset + sizeof(RecordHeader), length - 1};
+        }
+        end += record_size(length - 1);
+      }
+      if (count == 0 or count == max_batch or
+          parameters.linger.count() == 0 or not run or
+          waiting_producers.load(std::memory_order_relaxed) or
+          std::chrono::steady_clock::now() >= linger_until) {
+        break;
+      }
+      std::unique_lock lock(sync);
+      sleeping.store(true, std::memory_order_relaxed);
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+      cv.wait_until(lock, linger_until,
+                    [&]() { return is_ready(end) or not run; });
+      sleeping.store(false, std::memory_order_relaxed);
+    }
+    if (end != index) {
+      if (count) {
+        forward(batch.data(), count);
+      }
+      release(index, end);
+      index = end;
+      flush_output_if_requested(index);
+      continue;
+    }
+    const bool drained = index == write_index.load(std::memory_order_acquire);
+    if (drained) {
+      // pressure is gone, tell the reader about the lines it will not see
+      const auto lost = dropped.load(std::memory_order_relaxed) +
+                        overwritten.load(std::memory_order_relaxed);
+      if (lost != reported_lost) {
+        auto line = std::format("[micro_logger] {} messages dropped\n",
+                                lost - reported_lost);
+        iovec report{line.data(), line.size()};
+        forward(&report, 1);
+        reported_lost = lost;
+      }
+    }
+    flush_output_if_requested(index);
+    if (not run and drained) {
+      return;
+    }
+    wait_for_data(index);
+  }
+}
+namespace {
+/** Source of PerThreadAsyncWriter::id, addresses get reused. */
+std::atomic<uint64_t> per_thread_writer_ids{0};
+
+int64_t steady_now() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+} // namespace
+
+thread_local PerThreadAsyncWriter::ThreadQueueHandle
+    PerThreadAsyncWriter::thread_handle;
+
+PerThreadAsyncWriter::ThreadQueue::ThreadQueue(size_t capacity)
+    : storage(std::make_unique<uint64_t[]>(capacity / 8)),
+      data(reinterpret_cast<char *>(storage.get())), capacity(capacity) {}
+
+PerThreadAsyncWriter::ThreadQueueHandle::~ThreadQueueHandle() {
+  for (auto &[id, queue] : queues) {
+    queue->closed.store(true, std::memory_order_release);
+  }
+}
+
+PerThreadAsyncWriter::PerThreadAsyncWriter(
+    std::unique_ptr<BaseWriter> &output,
+    const PerThreadAsyncWriterParameters &parameters)
+    : output(std::move(output)), parameters(parameters),
+      capacity((std::max(parameters.queue_capacity, size_t{256}) + 7) &
+               ~size_t{7}),
+      id(per_thread_writer_ids.fetch_add(1, std::memory_order_relaxed)) {
+  thread = std::thread(&PerThreadAsyncWriter::worker, this);
+}
+
+PerThreadAsyncWriter::~PerThreadAsyncWriter() {
+  {
+    std::scoped_lock lock(sync);
+    run = false;
+  }
+  cv.notify_all();
+  if (thread.joinable()) {
+    thread.join();
+  }
+}
+
+PerThreadAsyncWriter::ThreadQueue &
+PerThreadAsyncWriter::thread_queue() const {
+  auto &queues = thread_handle.queues;
+  if (not queues.empty() and queues.front().first == id) [[likely]] {
+    return *queues.front().second;
+  }
+  for (auto &[owner, queue] : queues) {
+    if (owner == id) {
+      return *queue;
+    }
+  }
+  // the registry of a destroyed writer no longer holds its queues
+  std::erase_if(queues, [](const auto &entry) {
+    return entry.second.use_count() == 1;
+  });
+  auto queue = std::make_shared<ThreadQueue>(capacity);
+  {
+    std::scoped_lock lock(sync);
+    registry.emplace_back(queue);
+    registry_version.fetch_add(1, std::memory_order_release);
+  }
+  queues.emplace_back(id, std::move(queue));
+  return *queues.back().second;
+}
+
+void PerThreadAsyncWriter::notify() const {
+  // pairs with the fence in worker(), either the worker sees the line or
+  // we see it parked
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  if (sleeping.load(std::memory_order_relaxed)) {
+    { std::scoped_lock lock(sync); }
+    cv.notify_one();
+  }
+}
+
+size_t PerThreadAsyncWriter::write(const char *buf, size_t size) const {
+  iovec fragment{const_cast<char *>(buf), size};
+  return writev(&fragment, 1);
+}
+
+size_t PerThreadAsyncWriter::writev(const iovec *fragments, int count) const {
+  size_t size = 0;
+  for (int i = 0; i < count; ++i) {
+    size += fragments[i].iov_len;
+  }
+  size = std::min(size, max_line_size());
+  auto &queue = thread_queue();
+  const uint32_t record = (sizeof(LineHeader) + size + 7) & ~size_t{7};
+  const auto head = queue.head.load(std::memory_order_relaxed);
+  const auto offset = head % capacity;
+  const auto to_end = capacity - offset;
+  const auto needed = to_end < record ? to_end + record : record;
+  // a full queue means this thread outpaces the output, wait rather than
+  // reorder or lose lines
+  while (capacity - (head - queue.tail.load(std::memory_order_acquire)) <
+         needed) {
+    notify();
+    std::this_thread::yield();
+  }
+  auto position = offset;
+  if (to_end < record) {
+    const uint32_t wrap{0};
+    std::memcpy(queue.data + offset, &wrap, sizeof(wrap));
+    position = 0;
+  }
+  // stamped last, the closer to publishing the smaller the merge window
+  // has to be
+  const LineHeader header{
+      .size = record,
+      .length = static_cast<uint32_t>(size),
+      .timestamp = steady_now(),
+  };
+  std::memcpy(queue.data + position, &header, sizeof(header));
+  auto *line = queue.data + position + sizeof(header);
+  size_t copied = 0;
+  for (int i = 0; i < count and copied < size; ++i) {
+    auto chunk = std::min(fragments[i].iov_len, size - copied);
+    std::memcpy(line + copied, fragments[i].iov_base, chunk);
+    copied += chunk;
+  }
+  queue.head.store(head + needed, std::memory_order_release);
+  notify();
+  return size;
+}
+
+bool PerThreadAsyncWriter::flush(std::chrono::milliseconds timeout) const {
+  if (timeout == timeout.zero()) {
+    // the worker skips the merge window and flushes @p output next round
+    flush_requested.store(true, std::memory_order_release);
+    notify();
+    std::scoped_lock lock(sync);
+    return std::all_of(registry.begin(), registry.end(),
+                       [](const auto &queue) { return queue->empty(); });
+  }
+  const bool forever = timeout == timeout.max();
+  const auto deadline = forever ? std::chrono::steady_clock::time_point::max()
+                                : std::chrono::steady_clock::now() + timeout;
+  std::vector<std::pair<std::shared_ptr<ThreadQueue>, uint64_t>> targets;
+  {
+    std::scoped_lock lock(sync);
+    for (const auto &queue : registry) {
+      targets.emplace_back(queue, queue->head.load(std::memory_order_acquire));
+    }
+  }
+  const auto passed = [&]() {
+    return std::all_of(targets.begin(), targets.end(), [](const auto &target) {
+      return target.first->tail.load(std::memory_order_acquire) >=
+             target.second;
+    });
+  };
+  flushing.fetch_add(1, std::memory_order_seq_cst);
+  bool reached;
+  {
+    std::unique_lock lock(sync);
+    cv.notify_one();
+    reached = forever ? (flushed.wait(lock, passed), true)
+                      : flushed.wait_until(lock, deadline, passed);
+  }
+  flushing.fetch_sub(1, std::memory_order_relaxed);
+  if (not reached) {
+    return false;
+  }
+  const auto remaining =
+      forever ? timeout
+              : std::max(std::chrono::duration_cast<std::chrono::milliseconds>(
+                             deadline - std::chrono::steady_clock::now()),
+                         std::chrono::milliseconds(0));
+  std::scoped_lock lock(output_sync);
+  return output->flush(remaining);
+}
+
+void PerThreadAsyncWriter::prune_registry() {
+  std::erase_if(registry, [](const auto &queue) {
+    return queue->closed.load(std::memory_order_acquire) and queue->empty();
+  });
+}
+
+void PerThreadAsyncWriter::worker() {
+  const auto max_batch = static_cast<int>(
+      std::clamp<size_t>(parameters.max_batch_lines, 1, IOV_MAX));
+  const int64_t window =
+      std::chrono::duration_cast<std::chrono::nanoseconds>(
+          parameters.merge_window)
+          .count();
+  std::vector<iovec> batch(max_batch);
+  std::vector<std::shared_ptr<ThreadQueue>> queues;
+  std::vector<uint64_t> cursors;
+  std::vector<uint64_t> heads;
+  // min-heap of (timestamp, queue) over the queues with a line pending
+  std::vector<std::pair<int64_t, size_t>> oldest;
+  uint64_t version = 0;
   while (true) {
+    if (registry_version.load(std::memory_order_acquire) != version) {
+      std::scoped_lock lock(sync);
+      version = registry_version.load(std::memory_order_relaxed);
+      queues = registry;
+    }
+    const bool stopping = not run.load(std::memory_order_acquire);
+    // read before the heads, the line asking for it is then visible
+    const bool flush_output =
+        flush_requested.load(std::memory_order_relaxed) and
+        flush_requested.exchange(false, std::memory_order_acquire);
+    const auto horizon =
+        stopping or flush_output or flushing.load(std::memory_order_relaxed)
+            ? INT64_MAX
+            : steady_now() - window;
+    // header of the next line of queue @p i, skipping a wrap marker
+    const auto peek = [&](size_t i, LineHeader &header) {
+      const auto &queue = *queues[i];
+      while (cursors[i] != heads[i]) {
+        // a wrap marker may sit in the last 8 bytes, only its size is there
+        const auto offset = cursors[i] % capacity;
+        std::memcpy(&header.size, queue.data + offset, sizeof(header.size));
+        if (header.size != 0) {
+          std::memcpy(&header, queue.data + offset, sizeof(header));
+          return true;
+        }
+        cursors[i] += capacity - offset;
+      }
+      return false;
+    };
+    cursors.resize(queues.size());
+    heads.resize(queues.size());
+    oldest.clear();
+    for (size_t i = 0; i < queues.size(); ++i) {
+      cursors[i] = queues[i]->tail.load(std::memory_order_relaxed);
+      heads[i] = queues[i]->head.load(std::memory_order_acquire);
+      if (LineHeader header; peek(i, header)) {
+        oldest.emplace_back(header.timestamp, i);
+      }
+    }
+    // merge: take the oldest head until the batch is full or the oldest
+    // one is still inside the window
+    std::make_heap(oldest.begin(), oldest.end(), std::greater<>());
+    int count = 0;
+    auto next_due = INT64_MAX;
+    while (count < max_batch and not oldest.empty()) {
+      const auto [timestamp, i] = oldest.front();
+      if (timestamp > horizon) {
+        next_due = timestamp + window;
+        break;
+      }
+      std::pop_heap(oldest.begin(), oldest.end(), std::greater<>());
+      oldest.pop_back();
+      LineHeader header;
+      peek(i, header);
+      batch[count++] = {queues[i]->data + cursors[i] % capacity +
+                            sizeof(LineHeader),
+                        header.length};
+      cursors[i] += header.size;
+      if (peek(i, header)) {
+        oldest.emplace_back(header.timestamp, i);
+        std::push_heap(oldest.begin(), oldest.end(), std::greater<>());
+      }
+    }
+    if (count or flush_output) {
+      std::scoped_lock lock(output_sync);
+      if (count) {
+        output->write_batch(batch.data(), count);
+      }
+      if (flush_output) [[unlikely]] {
+        output->flush(std::chrono::milliseconds::zero());
+      }
+    }
+    bool advanced = false;
+    for (size_t i = 0; i < queues.size(); ++i) {
+      if (cursors[i] != queues[i]->tail.load(std::memory_order_relaxed)) {
+        queues[i]->tail.store(cursors[i], std::memory_order_release);
+        advanced = true;
+      }
+    }
+    if (flushing.load(std::memory_order_seq_cst)) {
+      { std::scoped_lock lock(sync); }
+      flushed.notify_all();
+    }
+    if (advanced) {
+      continue;
+    }
     std::unique_lock lock(sync);
-    cv.wait(lock,
-            [&]() { return queue[current_entry_index].is_taken() or not run; });
-    auto &entry = queue[current_entry_index];
-    if (not run and not entry.is_taken()) {
+    prune_registry();
+    if (registry.size() != queues.size()) {
+      version = registry_version.load(std::memory_order_relaxed);
+      queues = registry;
+      continue;
+    }
+    if (stopping) {
       return;
     }
-    if (++current_entry_index == max_entries or not queue[current_entry_index].is_taken())
-      current_entry_index = 0;
-    lock.unlock();
-    output->write(entry.line, entry.size);
-    entry.reclaim();
+    if (next_due != INT64_MAX) {
+      // only older lines, a stop or a flush can change the plan
+      cv.wait_until(lock,
+                    std::chrono::steady_clock::time_point(
+                        std::chrono::nanoseconds(next_due)),
+                    [&]() {
+                      return not run or
+                             flushing.load(std::memory_order_relaxed) or
+                             flush_requested.load(std::memory_order_relaxed);
+                    });
+      continue;
+    }
+    sleeping.store(true, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    cv.wait(lock, [&]() {
+      return not run or flush_requested.load(std::memory_order_relaxed) or
+             registry_version.load(std::memory_order_acquire) != version or
+             std::any_of(queues.begin(), queues.end(),
+                         [](const auto &queue) { return not queue->empty(); });
+    });
+    sleeping.store(false, std::memory_order_relaxed);
   }
 }
 } // namespace micro_logger
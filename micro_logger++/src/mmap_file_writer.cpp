@@ -0,0 +1,262 @@
+/*
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/.
+ */
+#include "micro_logger/micro_logger_writer.hpp"
+//
+#include <algorithm>
+#include <charconv>
+#include <cerrno>
+#include <fcntl.h>
+#include <filesystem>
+#include <format>
+#include <iostream>
+#include <string_view>
+#include <sys/mman.h>
+#include <unistd.h>
+
+namespace micro_logger {
+
+namespace {
+/**
+ * One past the highest `<path>.NNNNNN` on disk, also counting archived ones
+ * such as `<path>.NNNNNN.gz`, so names keep sorting by age.
+ */
+unsigned first_free_index(const std::string &path) {
+  const std::filesystem::path file{path};
+  auto directory = file.parent_path();
+  if (directory.empty()) {
+    directory = ".";
+  }
+  const auto prefix = file.filename().string() + ".";
+  unsigned next = 0;
+  std::error_code error;
+  for (const auto &entry :
+       std::filesystem::directory_iterator(directory, error)) {
+    const auto name = entry.path().filename().string();
+    if (not name.starts_with(prefix)) {
+      continue;
+    }
+    std::string_view index{name};
+    index.remove_prefix(prefix.size());
+    index = index.substr(0, index.find('.'));
+    unsigned value;
+    const auto end = index.data() + index.size();
+    const auto parsed = std::from_chars(index.data(), end, value);
+    if (index.size() < 6 or parsed.ptr != end or parsed.ec != std::errc()) {
+      continue;
+    }
+    next = std::max(next, value + 1);
+  }
+  return next;
+}
+} // namespace
+
+MmapFileWriter::MmapFileWriter(const char *path,
+                               const MmapFileWriterParameters &parameters)
+    : path(path), parameters(parameters), next_index(first_free_index(path)) {
+  auto first = open_segment();
+  if (not first) {
+    throw std::domain_error("open segment");
+  }
+  active.store(first.get(), std::memory_order_release);
+  segments.push_back(std::move(first));
+  thread = std::thread(&MmapFileWriter::housekeeping, this);
+}
+
+MmapFileWriter::~MmapFileWriter() {
+  {
+    std::scoped_lock lock(sync);
+    run = false;
+  }
+  cv.notify_all();
+  if (thread.joinable()) {
+    thread.join();
+  }
+  auto *segment = active.load(std::memory_order_acquire);
+  if (segment) {
+    close_segment(*segment, segment->committed.load(std::memory_order_acquire));
+  }
+  if (next) {
+    close_segment(*next, 0);
+    ::unlink(next->name.c_str());
+  }
+}
+
+std::unique_ptr<MmapFileWriter::Segment> MmapFileWriter::open_segment() {
+  auto segment = std::make_unique<Segment>();
+  segment->capacity = parameters.segment_size;
+  auto &name = segment->name;
+  do {
+    name = std::format("{}.{:06}", path, next_index++);
+    segment->fd =
+        ::open(name.c_str(), O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+  } while (segment->fd < 0 and errno == EEXIST);
+  if (segment->fd < 0) {
+    std::cerr << "failed to open segment: " << name << std::endl;
+    return nullptr;
+  }
+  // allocated up front, a full disk shows up here and not as SIGBUS later
+  if (posix_fallocate(segment->fd, 0, segment->capacity) != 0) {
+    std::cerr << "failed to allocate segment: " << name << std::endl;
+    ::close(segment->fd);
+    ::unlink(name.c_str());
+    return nullptr;
+  }
+  void *base = mmap(nullptr, segment->capacity, PROT_READ | PROT_WRITE,
+                    MAP_SHARED, segment->fd, 0);
+  if (base == MAP_FAILED) {
+    std::cerr << "failed to map segment: " << name << std::endl;
+    ::close(segment->fd);
+    ::unlink(name.c_str());
+    return nullptr;
+  }
+  segment->base = static_cast<char *>(base);
+  return segment;
+}
+
+void MmapFileWriter::close_segment(Segment &segment, size_t length) const {
+  if (not segment.base) {
+    return;
+  }
+  msync(segment.base, segment.capacity, MS_ASYNC);
+  munmap(segment.base, segment.capacity);
+  segment.base = nullptr;
+  if (ftruncate(segment.fd, length) != 0) {
+    std::cerr << "failed to truncate segment: " << segment.name << std::endl;
+  }
+  ::close(segment.fd);
+  segment.fd = -1;
+}
+
+void MmapFileWriter::roll(Segment *segment, size_t length) const {
+  // lines reserved before ours may still be copying into the old mapping
+  while (segment->committed.load(std::memory_order_acquire) < length) {
+    std::this_thread::yield();
+  }
+  std::unique_lock lock(sync);
+  // only waits when segments fill up faster than they are allocated
+  ready.wait(lock, [&]() { return next or failed; });
+  if (not next) {
+    broken.store(true, std::memory_order_release);
+    return;
+  }
+  active.store(next.get(), std::memory_order_release);
+  segments.push_back(std::move(next));
+  full.emplace_back(segment, length);
+  ++unclosed;
+  prepare = true;
+  lock.unlock();
+  cv.notify_one();
+}
+
+void MmapFileWriter::housekeeping() {
+  std::unique_lock lock(sync);
+  while (true) {
+    cv.wait(lock, [&]() { return not run or prepare or not full.empty(); });
+    if (prepare and run) {
+      prepare = false;
+      lock.unlock();
+      auto segment = open_segment();
+      lock.lock();
+      failed = not segment;
+      next = std::move(segment);
+      ready.notify_all();
+      continue;
+    }
+    if (full.empty()) {
+      return;
+    }
+    auto closing = std::move(full);
+    full.clear();
+    lock.unlock();
+    for (auto [segment, length] : closing) {
+      close_segment(*segment, length);
+    }
+    lock.lock();
+    unclosed -= closing.size();
+    ready.notify_all();
+  }
+}
+
+size_t MmapFileWriter::append(const iovec *fragments, int count,
+                              size_t size) const {
+  if (size > parameters.segment_size) {
+    return 0;
+  }
+  while (not broken.load(std::memory_order_relaxed)) {
+    auto *segment = active.load(std::memory_order_acquire);
+    const size_t start =
+        segment->reserved.fetch_add(size, std::memory_order_relaxed);
+    if (start + size <= segment->capacity) [[likely]] {
+      char *target = segment->base + start;
+      for (int i = 0; i < count; ++i) {
+        std::memcpy(target, fragments[i].iov_base, fragments[i].iov_len);
+        target += fragments[i].iov_len;
+      }
+      segment->committed.fetch_add(size, std::memory_order_release);
+      return size;
+    }
+    if (start <= segment->capacity) {
+      // ours is the reservation crossing the end, everything before it
+      // stays in this segment and we open the next one
+      roll(segment, start);
+      continue;
+    }
+    while (active.load(std::memory_order_acquire) == segment and
+           not broken.load(std::memory_order_relaxed)) {
+      std::this_thread::yield();
+    }
+  }
+  return 0;
+}
+
+size_t MmapFileWriter::write(const char *buf, size_t size) const {
+  iovec fragment{const_cast<char *>(buf), size};
+  return append(&fragment, 1, size);
+}
+
+size_t MmapFileWriter::writev(const iovec *fragments, int count) const {
+  size_t size = 0;
+  for (int i = 0; i < count; ++i) {
+    size += fragments[i].iov_len;
+  }
+  return append(fragments, count, size);
+}
+
+size_t MmapFileWriter::write_batch(const iovec *lines, int count) const {
+  size_t size = 0;
+  for (int i = 0; i < count; ++i) {
+    size += lines[i].iov_len;
+  }
+  if (size <= parameters.segment_size) [[likely]] {
+    return append(lines, count, size);
+  }
+  return BaseWriter::write_batch(lines, count);
+}
+
+bool MmapFileWriter::flush(std::chrono::milliseconds timeout) const {
+  const bool forever = timeout == timeout.max();
+  const auto deadline = forever ? std::chrono::steady_clock::time_point::max()
+                                : std::chrono::steady_clock::now() + timeout;
+  // the lock keeps the background thread from unmapping the segment
+  std::unique_lock lock(sync);
+  auto *segment = active.load(std::memory_order_acquire);
+  const size_t length = segment->committed.load(std::memory_order_acquire);
+  const bool wait = parameters.sync and timeout.count();
+  const bool written =
+      length == 0 or
+      msync(segment->base, length, wait ? MS_SYNC : MS_ASYNC) == 0;
+  const auto closed = [&]() { return unclosed == 0; };
+  if (timeout == timeout.zero()) {
+    return closed() and written;
+  }
+  if (forever) {
+    ready.wait(lock, closed);
+    return written;
+  }
+  return ready.wait_until(lock, deadline, closed) and written;
+}
+
+} // namespace micro_logger
@@ -0,0 +1,384 @@
+/*
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/.
+ */
+#include "micro_logger/micro_logger_writer.hpp"
+//
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <climits>
+#include <cstdio>
+#include <ctime>
+#include <fcntl.h>
+#include <filesystem>
+#include <format>
+#include <fstream>
+#include <iostream>
+#include <system_error>
+#include <unistd.h>
+#ifdef MICRO_LOGGER_HAS_ZLIB
+#include <zlib.h>
+#endif
+
+namespace micro_logger {
+namespace {
+constexpr std::string_view compressed_suffix{".gz"};
+
+/** Wall clock seconds, coarse is plenty for a rotation boundary. */
+int64_t coarse_wall_seconds() {
+  timespec now;
+  clock_gettime(CLOCK_REALTIME_COARSE, &now);
+  return now.tv_sec;
+}
+
+/**
+ * Segment name without @p prefix and without the compressed suffix, when
+ * @p name is one of ours: `YYYYmmdd-HHMMSS` optionally followed by `.N`.
+ */
+bool segment_key(std::string_view name, std::string_view prefix,
+                 std::string_view &key) {
+  if (not name.starts_with(prefix)) {
+    return false;
+  }
+  name.remove_prefix(prefix.size());
+  if (name.ends_with(compressed_suffix)) {
+    name.remove_suffix(compressed_suffix.size());
+  }
+  constexpr std::string_view pattern{"dddddddd-dddddd"};
+  if (name.size() < pattern.size()) {
+    return false;
+  }
+  for (size_t i = 0; i < pattern.size(); ++i) {
+    if (pattern[i] == 'd' ? not std::isdigit(name[i]) : name[i] != '-') {
+      return false;
+    }
+  }
+  auto clash = name.substr(pattern.size());
+  if (not clash.empty() and
+      (clash[0] != '.' or clash.size() == 1 or
+       not std::all_of(clash.begin() + 1, clash.end(),
+                       [](char c) { return std::isdigit(c); }))) {
+    return false;
+  }
+  key = name;
+  return true;
+}
+
+/** Order of segments: timestamp, then the clash counter as a number. */
+bool segment_before(std::string_view lhs, std::string_view rhs) {
+  constexpr size_t stamp = 15;
+  if (auto order = lhs.substr(0, stamp).compare(rhs.substr(0, stamp))) {
+    return order < 0;
+  }
+  auto counter = [](std::string_view key) {
+    return key.size() > stamp ? std::stoul(std::string(key.substr(stamp + 1)))
+                              : 0;
+  };
+  return counter(lhs) < counter(rhs);
+}
+
+#ifdef MICRO_LOGGER_HAS_ZLIB
+/** Gzip @p segment next to it and remove it; keeps it on failure. */
+void compress(const std::string &segment) {
+  const auto target = segment + std::string(compressed_suffix);
+  const auto partial = target + ".tmp";
+  std::ifstream in(segment, std::ios::binary);
+  gzFile out = gzopen(partial.c_str(), "wb");
+  if (not in or not out) {
+    std::cerr << "failed to compress: " << segment << std::endl;
+    if (out) {
+      gzclose(out);
+    }
+    return;
+  }
+  char chunk[64 * 1024];
+  bool written = true;
+  while (written and in.read(chunk, sizeof(chunk)).gcount() > 0) {
+    written = gzwrite(out, chunk, in.gcount()) == in.gcount();
+  }
+  written = gzclose(out) == Z_OK and written;
+  if (not written) {
+    std::cerr << "failed to compress: " << segment << std::endl;
+    std::remove(partial.c_str());
+    return;
+  }
+  std::rename(partial.c_str(), target.c_str());
+  std::remove(segment.c_str());
+}
+#endif
+} // namespace
+
+RotatingFileWriter::RotatingFileWriter(
+    const char *path, const RotatingFileWriterParameters &parameters)
+    : path(path), staging(std::format("{}.next", path)),
+      parameters(parameters),
+      active(std::make_unique<BufferedFileWriter>(path, parameters.buffering)) {
+#ifndef MICRO_LOGGER_HAS_ZLIB
+  if (parameters.compress) {
+    throw std::domain_error("micro_logger built without zlib");
+  }
+#endif
+  std::error_code error;
+  written = std::filesystem::file_size(path, error);
+  if (error) {
+    written = 0;
+  }
+  rotate_at = next_boundary();
+  // also applies the retention to segments of earlier runs
+  rotated.emplace_back();
+  thread = std::thread(&RotatingFileWriter::housekeeping, this);
+}
+
+RotatingFileWriter::~RotatingFileWriter() {
+  {
+    std::scoped_lock lock(sync);
+    run = false;
+  }
+  cv.notify_all();
+  if (thread.joinable()) {
+    thread.join();
+  }
+  if (next) {
+    next.reset();
+    std::remove(staging.c_str());
+  }
+}
+
+int64_t RotatingFileWriter::next_boundary() const {
+  const auto interval = parameters.interval.count();
+  if (interval <= 0) {
+    return INT64_MAX;
+  }
+  // boundaries are aligned to local time, a day rolls over at midnight
+  const time_t now = coarse_wall_seconds();
+  tm local;
+  localtime_r(&now, &local);
+  const int64_t offset = local.tm_gmtoff;
+  return ((now + offset) / interval + 1) * interval - offset;
+}
+
+bool RotatingFileWriter::is_due(size_t size) const {
+  if (parameters.max_size and written and
+      written + size > parameters.max_size) {
+    return true;
+  }
+  if (rotate_at == INT64_MAX or coarse_wall_seconds() < rotate_at) {
+    return false;
+  }
+  if (not written) {
+    // nothing to roll over, the empty file stays for the next interval
+    rotate_at = next_boundary();
+    return false;
+  }
+  return true;
+}
+
+std::string RotatingFileWriter::rename_active() const {
+  const time_t now = coarse_wall_seconds();
+  tm local;
+  localtime_r(&now, &local);
+  char stamp[32];
+  std::strftime(stamp, sizeof(stamp), "%Y%m%d-%H%M%S", &local);
+  // segments of the same second keep counting up, even after the older
+  // ones were deleted, so the names still sort by age
+  clash = last_stamp == stamp ? clash + 1 : 0;
+  last_stamp = stamp;
+  for (;; ++clash) {
+    auto segment = clash ? std::format("{}.{}.{}", path, stamp, clash)
+                         : std::format("{}.{}", path, stamp);
+    if (access((segment + std::string(compressed_suffix)).c_str(), F_OK) ==
+        0) {
+      continue;
+    }
+    // a segment of an earlier run is never replaced
+    if (renameat2(AT_FDCWD, path.c_str(), AT_FDCWD, segment.c_str(),
+                  RENAME_NOREPLACE) == 0) {
+      return segment;
+    }
+    if (errno == EEXIST) {
+      continue;
+    }
+    if (errno == EINVAL and access(segment.c_str(), F_OK) != 0 and
+        std::rename(path.c_str(), segment.c_str()) == 0) {
+      // the file system does not know RENAME_NOREPLACE
+      return segment;
+    }
+    std::cerr << "failed to rotate: " << path << std::endl;
+    return {};
+  }
+}
+
+void RotatingFileWriter::rotate() const {
+  written = 0;
+  rotate_at = next_boundary();
+  std::unique_ptr<BufferedFileWriter> prepared;
+  {
+    std::scoped_lock lock(sync);
+    prepared = std::move(next);
+  }
+  auto segment = rename_active();
+  if (segment.empty()) {
+    // keep writing to the file we have, the next boundary tries again
+    std::scoped_lock lock(sync);
+    next = std::move(prepared);
+    return;
+  }
+  if (prepared and std::rename(staging.c_str(), path.c_str()) != 0) {
+    prepared.reset();
+  }
+  if (not prepared) {
+    // the background thread is behind, open it here
+    try {
+      prepared = std::make_unique<BufferedFileWriter>(path.c_str(),
+                                                      parameters.buffering);
+    } catch (const std::domain_error &) {
+      // keep writing to the renamed file rather than losing lines
+      return;
+    }
+  }
+  std::swap(active, prepared);
+  {
+    std::scoped_lock lock(sync);
+    // its buffer is written out, and synced, on the background thread
+    rotated.push_back({std::move(prepared), std::move(segment)});
+    ++unflushed;
+    prepare = true;
+  }
+  cv.notify_one();
+}
+
+size_t RotatingFileWriter::write(const char *buf, size_t size) const {
+  iovec fragment{const_cast<char *>(buf), size};
+  return writev(&fragment, 1);
+}
+
+size_t RotatingFileWriter::writev(const iovec *fragments, int count) const {
+  size_t size = 0;
+  for (int i = 0; i < count; ++i) {
+    size += fragments[i].iov_len;
+  }
+  if (is_due(size)) [[unlikely]] {
+    rotate();
+  }
+  written += size;
+  return active->writev(fragments, count);
+}
+
+size_t RotatingFileWriter::write_batch(const iovec *lines, int count) const {
+  size_t size = 0;
+  for (int i = 0; i < count; ++i) {
+    size += lines[i].iov_len;
+  }
+  const bool fits = not parameters.max_size or
+                    written + size <= parameters.max_size;
+  if (fits and not is_due(size)) [[likely]] {
+    written += size;
+    return active->write_batch(lines, count);
+  }
+  // a rotation somewhere in the batch, never split a line across files
+  size = 0;
+  for (int i = 0; i < count; ++i) {
+    size += writev(&lines[i], 1);
+  }
+  return size;
+}
+
+bool RotatingFileWriter::flush(std::chrono::milliseconds timeout) const {
+  const bool forever = timeout == timeout.max();
+  const auto deadline = forever ? std::chrono::steady_clock::time_point::max()
+                                : std::chrono::steady_clock::now() + timeout;
+  const bool written = active->flush(timeout);
+  const auto passed = [&]() { return unflushed == 0; };
+  std::unique_lock lock(sync);
+  if (timeout == timeout.zero()) {
+    return passed() and written;
+  }
+  if (forever) {
+    retired.wait(lock, passed);
+    return written;
+  }
+  return retired.wait_until(lock, deadline, passed) and written;
+}
+
+void RotatingFileWriter::housekeeping() {
+  const std::filesystem::path active_path{path};
+  auto directory = active_path.parent_path();
+  if (directory.empty()) {
+    directory = ".";
+  }
+  const auto prefix = active_path.filename().string() + ".";
+  std::unique_lock lock(sync);
+  while (true) {
+    cv.wait(lock, [&]() { return not run or prepare or not rotated.empty(); });
+    if (prepare and run) {
+      prepare = false;
+      if (next) {
+        // the writing thread opened its own while this one was prepared
+        continue;
+      }
+      lock.unlock();
+      std::unique_ptr<BufferedFileWriter> prepared;
+      // an earlier run may have left one behind
+      std::remove(staging.c_str());
+      try {
+        prepared = std::make_unique<BufferedFileWriter>(staging.c_str(),
+                                                        parameters.buffering);
+      } catch (const std::domain_error &) {
+        // the writing thread opens the file itself at the next rollover
+      }
+      lock.lock();
+      next = std::move(prepared);
+      continue;
+    }
+    if (rotated.empty()) {
+      return;
+    }
+    auto segments = std::move(rotated);
+    rotated.clear();
+    lock.unlock();
+    for (auto &segment : segments) {
+      if (segment.writer) {
+        segment.writer->flush();
+        segment.writer.reset();
+        {
+          std::scoped_lock flushed(sync);
+          --unflushed;
+        }
+        retired.notify_all();
+      }
+    }
+#ifdef MICRO_LOGGER_HAS_ZLIB
+    if (parameters.compress) {
+      for (const auto &segment : segments) {
+        if (not segment.segment.empty()) {
+          compress(segment.segment);
+        }
+      }
+    }
+#endif
+    if (parameters.max_segments) {
+      std::vector<std::pair<std::string, std::filesystem::path>> found;
+      std::error_code error;
+      for (const auto &entry :
+           std::filesystem::directory_iterator(directory, error)) {
+        auto name = entry.path().filename().string();
+        std::string_view key;
+        if (segment_key(name, prefix, key)) {
+          found.emplace_back(key, entry.path());
+        }
+      }
+      std::sort(found.begin(), found.end(),
+                [](const auto &lhs, const auto &rhs) {
+                  return segment_before(lhs.first, rhs.first);
+                });
+      for (size_t i = 0; i + parameters.max_segments < found.size(); ++i) {
+        std::filesystem::remove(found[i].second, error);
+      }
+    }
+    lock.lock();
+  }
+}
+
+} // namespace micro_logger
@@ -0,0 +1,331 @@
+/*
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/.
+ */
+#include "micro_logger/micro_logger.hpp"
+//
+#include <arpa/inet.h>
+#include <cerrno>
+#include <cstddef>
+#include <endian.h>
+#include <fcntl.h>
+#include <format>
+#include <iostream>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+namespace micro_logger {
+
+namespace {
+/** Room for a line and the fields around it. */
+constexpr int max_parts = 16;
+
+/** Syslog severity of @p level, journald uses the same numbers. */
+int severity(Level level) {
+  switch (level) {
+  case Level::trace:
+  case Level::debug:
+    return 7;
+  case Level::warn:
+    return 4;
+  case Level::error:
+    return 3;
+  case Level::critical:
+    return 2;
+  default:
+    return 6;
+  }
+}
+
+/** @p name with spaces replaced, "-" when empty, as a header field. */
+std::string field(std::string name, size_t limit) {
+  if (name.empty()) {
+    return "-";
+  }
+  name.resize(std::min(name.size(), limit));
+  for (auto &c : name) {
+    if (c <= ' ' or c > '~') {
+      c = '_';
+    }
+  }
+  return name;
+}
+
+std::string host_name(const std::string &name) {
+  if (not name.empty()) {
+    return name;
+  }
+  char host[256]{};
+  gethostname(host, sizeof(host) - 1);
+  return host;
+}
+
+std::string program_name(const std::string &name) {
+  return name.empty() ? program_invocation_short_name : name;
+}
+
+std::pair<sockaddr_storage, socklen_t> local_address(const std::string &path) {
+  std::pair<sockaddr_storage, socklen_t> destination{};
+  auto &local = reinterpret_cast<sockaddr_un &>(destination.first);
+  local.sun_family = AF_UNIX;
+  if (path.empty() or path.size() >= sizeof(local.sun_path)) {
+    std::cerr << "failed to use socket path: " << path << std::endl;
+    throw std::domain_error(std::format("invalid socket path {}", path));
+  }
+  std::memcpy(local.sun_path, path.data(), path.size());
+  destination.second = offsetof(sockaddr_un, sun_path) + path.size() + 1;
+  return destination;
+}
+
+std::pair<sockaddr_storage, socklen_t>
+syslog_address(const SyslogWriterParameters &parameters) {
+  if (parameters.port == 0) {
+    return local_address(parameters.path);
+  }
+  std::pair<sockaddr_storage, socklen_t> destination{{}, sizeof(sockaddr_in)};
+  auto &inet = reinterpret_cast<sockaddr_in &>(destination.first);
+  inet.sin_family = AF_INET;
+  inet.sin_port = htons(parameters.port);
+  if (inet_pton(AF_INET, parameters.address.c_str(), &inet.sin_addr) <= 0) {
+    std::cerr << "failed to parse address: " << parameters.address
+              << std::endl;
+    throw std::domain_error(std::format("invalid address {}:{}",
+                                        parameters.address, parameters.port));
+  }
+  return destination;
+}
+
+int datagram_socket(const std::pair<sockaddr_storage, socklen_t> &address) {
+  int sock = socket(address.first.ss_family, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+  if (sock < 0) {
+    std::cerr << "failed to create socket" << std::endl;
+    throw std::domain_error("create socket");
+  }
+  return sock;
+}
+
+/**
+ * Copy @p fragments to @p parts without the line's trailing newline.
+ * @return number of entries in @p parts.
+ */
+int without_newline(const iovec *fragments, int count, iovec *parts) {
+  std::copy(fragments, fragments + count, parts);
+  while (count and parts[count - 1].iov_len == 0) {
+    --count;
+  }
+  if (count and static_cast<const char *>(
+                    parts[count - 1].iov_base)[parts[count - 1].iov_len - 1] ==
+                    '\n') {
+    if (--parts[count - 1].iov_len == 0) {
+      --count;
+    }
+  }
+  return count;
+}
+
+size_t total_size(const iovec *fragments, int count) {
+  size_t size = 0;
+  for (int i = 0; i < count; ++i) {
+    size += fragments[i].iov_len;
+  }
+  return size;
+}
+
+/** @p fragments in one string, for lines in too many pieces. */
+std::string joined(const iovec *fragments, int count) {
+  std::string line;
+  for (int i = 0; i < count; ++i) {
+    line.append(static_cast<const char *>(fragments[i].iov_base),
+                fragments[i].iov_len);
+  }
+  return line;
+}
+
+/** Send @p parts as one datagram, false when it did not go out. */
+bool send_datagram(int sock,
+                   const std::pair<sockaddr_storage, socklen_t> &destination,
+                   const iovec *parts, int count) {
+  msghdr message{};
+  message.msg_name = const_cast<sockaddr_storage *>(&destination.first);
+  message.msg_namelen = destination.second;
+  message.msg_iov = const_cast<iovec *>(parts);
+  message.msg_iovlen = count;
+  while (sendmsg(sock, &message, MSG_NOSIGNAL) < 0) {
+    if (errno != EINTR) {
+      return false;
+    }
+  }
+  return true;
+}
+} // namespace
+
+SyslogWriter::SyslogWriter(const SyslogWriterParameters &parameters)
+    : facility(std::clamp(parameters.facility, 0, 23)),
+      destination(syslog_address(parameters)),
+      fields(std::format(" {} {} {} - - ",
+                         field(host_name(parameters.hostname), 255),
+                         field(program_name(parameters.app_name), 48),
+                         getpid())),
+      sock(datagram_socket(destination)) {}
+
+SyslogWriter::~SyslogWriter() { close(sock); }
+
+size_t SyslogWriter::write(const char *buf, size_t size) const {
+  iovec fragment{const_cast<char *>(buf), size};
+  return send(6, &fragment, 1);
+}
+
+size_t SyslogWriter::writev(const iovec *fragments, int count) const {
+  return send(6, fragments, count);
+}
+
+size_t SyslogWriter::write_record(Level level, const iovec *fragments,
+                                  int count) const {
+  return send(severity(level), fragments, count);
+}
+
+size_t SyslogWriter::send(int severity, const iovec *fragments,
+                          int count) const {
+  const size_t size = total_size(fragments, count);
+  if (count > max_parts - 2) [[unlikely]] {
+    auto line = joined(fragments, count);
+    iovec fragment{line.data(), line.size()};
+    return send(severity, &fragment, 1);
+  }
+  timespec now;
+  clock_gettime(CLOCK_REALTIME, &now);
+  tm utc;
+  gmtime_r(&now.tv_sec, &utc);
+  char timestamp[64];
+  const int timestamp_size = std::snprintf(
+      timestamp, sizeof(timestamp),
+      "<%d>1 %04d-%02d-%02dT%02d:%02d:%02d.%06ldZ", facility * 8 + severity,
+      utc.tm_year + 1900, utc.tm_mon + 1, utc.tm_mday, utc.tm_hour,
+      utc.tm_min, utc.tm_sec, now.tv_nsec / 1000);
+  iovec parts[max_parts];
+  parts[0] = {timestamp, static_cast<size_t>(timestamp_size)};
+  parts[1] = {const_cast<char *>(fields.data()), fields.size()};
+  const int message = without_newline(fragments, count, parts + 2);
+  if (not send_datagram(sock, destination, parts, message + 2)) {
+    lost.fetch_add(1, std::memory_order_relaxed);
+    return 0;
+  }
+  return size;
+}
+
+uint64_t SyslogWriter::dropped() const {
+  return lost.load(std::memory_order_relaxed);
+}
+
+JournalWriter::JournalWriter(const JournalWriterParameters &parameters)
+    : destination(local_address(parameters.path)),
+      sock(datagram_socket(destination)) {
+  auto identifier = program_name(parameters.identifier);
+  std::replace(identifier.begin(), identifier.end(), '\n', ' ');
+  for (int priority = 0; priority < 8; ++priority) {
+    headers[priority] = std::format(
+        "PRIORITY={}\nSYSLOG_IDENTIFIER={}\nMESSAGE\n", priority, identifier);
+  }
+}
+
+JournalWriter::~JournalWriter() { close(sock); }
+
+size_t JournalWriter::write(const char *buf, size_t size) const {
+  iovec fragment{const_cast<char *>(buf), size};
+  return send(6, &fragment, 1);
+}
+
+size_t JournalWriter::writev(const iovec *fragments, int count) const {
+  return send(6, fragments, count);
+}
+
+size_t JournalWriter::write_record(Level level, const iovec *fragments,
+                                   int count) const {
+  return send(severity(level), fragments, count);
+}
+
+size_t JournalWriter::send(int priority, const iovec *fragments,
+                           int count) const {
+  const size_t size = total_size(fragments, count);
+  if (count > max_parts - 3) [[unlikely]] {
+    auto line = joined(fragments, count);
+    iovec fragment{line.data(), line.size()};
+    return send(priority, &fragment, 1);
+  }
+  // MESSAGE in the binary form: little endian length, then the raw bytes
+  iovec parts[max_parts];
+  const int message = without_newline(fragments, count, parts + 2);
+  const uint64_t length = htole64(total_size(parts + 2, message));
+  const auto &header = headers[priority];
+  parts[0] = {const_cast<char *>(header.data()), header.size()};
+  parts[1] = {const_cast<uint64_t *>(&length), sizeof(length)};
+  parts[message + 2] = {const_cast<char *>("\n"), 1};
+  const int parts_count = message + 3;
+  if (send_datagram(sock, destination, parts, parts_count)) {
+    return size;
+  }
+  if ((errno == EMSGSIZE or errno == ENOBUFS) and
+      send_memfd(parts, parts_count)) {
+    return size;
+  }
+  lost.fetch_add(1, std::memory_order_relaxed);
+  return 0;
+}
+
+bool JournalWriter::send_memfd(const iovec *parts, int count) const {
+  const int fd = memfd_create("micro_logger", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+  if (fd < 0) {
+    return false;
+  }
+  bool written = true;
+  for (int i = 0; i < count and written; ++i) {
+    const auto *data = static_cast<const char *>(parts[i].iov_base);
+    size_t left = parts[i].iov_len;
+    while (left) {
+      const auto done = ::write(fd, data, left);
+      if (done < 0 and errno == EINTR) {
+        continue;
+      }
+      if (done < 0) {
+        written = false;
+        break;
+      }
+      data += done;
+      left -= done;
+    }
+  }
+  // journald only takes a memfd which can no longer change
+  written = written and fcntl(fd, F_ADD_SEALS,
+                              F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE |
+                                  F_SEAL_SEAL) == 0;
+  if (written) {
+    alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int))]{};
+    msghdr message{};
+    message.msg_name = const_cast<sockaddr_storage *>(&destination.first);
+    message.msg_namelen = destination.second;
+    message.msg_control = control;
+    message.msg_controllen = sizeof(control);
+    auto *rights = CMSG_FIRSTHDR(&message);
+    rights->cmsg_level = SOL_SOCKET;
+    rights->cmsg_type = SCM_RIGHTS;
+    rights->cmsg_len = CMSG_LEN(sizeof(int));
+    std::memcpy(CMSG_DATA(rights), &fd, sizeof(int));
+    ssize_t sent;
+    do {
+      sent = sendmsg(sock, &message, MSG_NOSIGNAL);
+    } while (sent < 0 and errno == EINTR);
+    written = sent >= 0;
+  }
+  close(fd);
+  return written;
+}
+
+uint64_t JournalWriter::dropped() const {
+  return lost.load(std::memory_order_relaxed);
+}
+
+} // namespace micro_logger
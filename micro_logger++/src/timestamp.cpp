@@ -0,0 +1,110 @@
+/*
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/.
+ */
+
+#include "timestamp.h"
+//
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <limits>
+
+namespace micro_logger {
+
+namespace {
+/** Milliseconds format rendered without snprintf. */
+constexpr const char *default_milliseconds_format = ".%03ld]";
+
+struct TimeCache {
+  /** Epoch second rendered in @p prefix. */
+  time_t second{std::numeric_limits<time_t>::min()};
+  /** Parameters @p prefix was rendered with. */
+  const micro_logger_CustomParameters *parameters{nullptr};
+  /** Whether milliseconds_format is the default one. */
+  bool default_milliseconds{false};
+  size_t size{0};
+  char prefix[128];
+};
+
+thread_local TimeCache time_cache;
+
+size_t render_seconds(char *output, size_t output_size, time_t t,
+                      const micro_logger_CustomParameters &parameters) {
+  std::tm tm{};
+  if (not ::localtime_r(&t, &tm)) {
+    return 0;
+  }
+  return std::strftime(output, output_size, parameters.time_format, &tm);
+}
+
+size_t render_milliseconds(char *output, size_t output_size, long milliseconds,
+                           const micro_logger_CustomParameters &parameters) {
+  if (not parameters.milliseconds_format) {
+    return 0;
+  }
+  auto size = std::snprintf(output, output_size,
+                            parameters.milliseconds_format, milliseconds);
+  return size < 0 ? 0 : std::min<size_t>(size, output_size - 1);
+}
+} // namespace
+
+size_t get_time_uncached(char *output,
+                         std::chrono::system_clock::time_point time_point,
+                         const micro_logger_CustomParameters &parameters) {
+  const auto t{std::chrono::system_clock::to_time_t(time_point)};
+  const auto milliseconds{std::chrono::duration_cast<std::chrono::milliseconds>(
+                              time_point.time_since_epoch())
+                              .count() %
+                          1000};
+  auto size = render_seconds(output, parameters.header_size, t, parameters);
+  if (size) {
+    size += render_milliseconds(output + size, parameters.header_size - size,
+                                milliseconds, parameters);
+  }
+  return size;
+}
+
+size_t get_time(char *output, std::chrono::system_clock::time_point time_point,
+                const micro_logger_CustomParameters &parameters) {
+  const auto since_epoch{
+      std::chrono::duration_cast<std::chrono::milliseconds>(
+          time_point.time_since_epoch())
+          .count()};
+  const auto t{std::chrono::system_clock::to_time_t(time_point)};
+  auto &cache = time_cache;
+  if (cache.second != t or cache.parameters != &parameters) {
+    cache.size = render_seconds(
+        cache.prefix, std::min(sizeof(cache.prefix), parameters.header_size),
+        t, parameters);
+    if (not cache.size) {
+      cache.parameters = nullptr;
+      return get_time_uncached(output, time_point, parameters);
+    }
+    cache.second = t;
+    cache.parameters = &parameters;
+    cache.default_milliseconds =
+        parameters.milliseconds_format and
+        std::strcmp(parameters.milliseconds_format,
+                    default_milliseconds_format) == 0;
+  }
+  std::memcpy(output, cache.prefix, cache.size);
+  auto size = cache.size;
+  const long milliseconds = since_epoch % 1000;
+  if (cache.default_milliseconds and parameters.header_size - size > 5) {
+    output[size++] = '.';
+    output[size++] = '0' + milliseconds / 100;
+    output[size++] = '0' + milliseconds / 10 % 10;
+    output[size++] = '0' + milliseconds % 10;
+    output[size++] = ']';
+    output[size] = '\0';
+    return size;
+  }
+  return size + render_milliseconds(output + size,
+                                    parameters.header_size - size,
+                                    milliseconds, parameters);
+}
+
+} // namespace micro_logger
@@ -0,0 +1,36 @@
+/*
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/.
+ */
+
+#ifndef MICRO_LOGGER_TIMESTAMP_H
+#define MICRO_LOGGER_TIMESTAMP_H
+
+#include "micro_logger/micro_logger_custom_parameters.h"
+//
+#include <chrono>
+
+namespace micro_logger {
+
+/**
+ * Render @p time_point with `time_format` followed by `milliseconds_format`.
+ *
+ * The `time_format` part only changes once per second, so it is rendered
+ * with localtime_r/strftime once per second and thread and copied from a
+ * thread_local cache otherwise; only the milliseconds are formatted per
+ * call.
+ *
+ * @return number of bytes written to @p output (at most `header_size`).
+ */
+size_t get_time(char *output, std::chrono::system_clock::time_point time_point,
+                const micro_logger_CustomParameters &parameters);
+
+/** Same as get_time but without the cache, kept as a reference. */
+size_t get_time_uncached(char *output,
+                         std::chrono::system_clock::time_point time_point,
+                         const micro_logger_CustomParameters &parameters);
+
+} // namespace micro_logger
+
+#endif // MICRO_LOGGER_TIMESTAMP_H
@@ -0,0 +1,329 @@
+/*
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/.
+ */
+#include "micro_logger/micro_logger_writer.hpp"
+//
+#include <cerrno>
+#include <fcntl.h>
+#include <iostream>
+#include <unistd.h>
+#ifdef MICRO_LOGGER_HAS_IO_URING
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#endif
+
+namespace micro_logger {
+
+#ifdef MICRO_LOGGER_HAS_IO_URING
+/**
+ * The ring is driven with the raw syscalls, two buffers and one write in
+ * flight need nothing of liburing.
+ */
+struct UringWriter::Ring {
+  ~Ring() {
+    if (sq_map != MAP_FAILED) {
+      munmap(sq_map, sq_map_size);
+    }
+    if (cq_map != MAP_FAILED and cq_map != sq_map) {
+      munmap(cq_map, cq_map_size);
+    }
+    if (sqes != MAP_FAILED) {
+      munmap(sqes, sizeof(io_uring_sqe) * entries);
+    }
+    if (fd >= 0) {
+      close(fd);
+    }
+  }
+  int enter(unsigned submit, unsigned wait) const {
+    return syscall(__NR_io_uring_enter, fd, submit, wait,
+                   wait ? IORING_ENTER_GETEVENTS : 0, nullptr, 0);
+  }
+
+  int fd{-1};
+  unsigned entries{0};
+  void *sq_map{MAP_FAILED};
+  size_t sq_map_size{0};
+  void *cq_map{MAP_FAILED};
+  size_t cq_map_size{0};
+  void *sqes{MAP_FAILED};
+  unsigned *sq_tail{nullptr};
+  unsigned *sq_mask{nullptr};
+  unsigned *sq_array{nullptr};
+  unsigned *cq_head{nullptr};
+  unsigned *cq_tail{nullptr};
+  unsigned *cq_mask{nullptr};
+  io_uring_cqe *cqes{nullptr};
+  /** Buffers are registered, writes use IORING_OP_WRITE_FIXED. */
+  bool fixed{false};
+  std::unique_ptr<char[]> buffers[2];
+  size_t used[2]{0, 0};
+  /** Buffer lines are copied into, the other one may be in flight. */
+  int fill{0};
+  bool in_flight{false};
+  /** Bytes of the buffer in flight already written. */
+  size_t done{0};
+};
+#else
+struct UringWriter::Ring {};
+#endif
+
+UringWriter::UringWriter(const char *path,
+                         const UringWriterParameters &parameters)
+    : parameters(parameters),
+      fd(::open(path, O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0644)),
+      owns_fd(true) {
+  if (fd < 0) {
+    std::cerr << "failed to open file: " << path << std::endl;
+    throw std::domain_error("open file");
+  }
+  setup();
+}
+
+UringWriter::UringWriter(int fd, const UringWriterParameters &parameters)
+    : parameters(parameters), fd(fd), owns_fd(false) {
+  setup();
+}
+
+UringWriter::~UringWriter() {
+  flush();
+  ring.reset();
+  if (owns_fd) {
+    close(fd);
+  }
+}
+
+bool UringWriter::is_async() const { return ring != nullptr; }
+
+bool UringWriter::write_fd(const iovec *fragments, int count) const {
+  for (int i = 0; i < count; ++i) {
+    const auto *data = static_cast<const char *>(fragments[i].iov_base);
+    size_t size = fragments[i].iov_len;
+    while (size) {
+      auto written = ::write(fd, data, size);
+      if (written < 0 and errno == EINTR) {
+        continue;
+      }
+      if (written < 0) {
+        return false;
+      }
+      data += written;
+      size -= written;
+    }
+  }
+  return true;
+}
+
+size_t UringWriter::write(const char *buf, size_t size) const {
+  iovec fragment{const_cast<char *>(buf), size};
+  return writev(&fragment, 1);
+}
+
+size_t UringWriter::writev(const iovec *fragments, int count) const {
+  size_t size = 0;
+  for (int i = 0; i < count; ++i) {
+    size += fragments[i].iov_len;
+  }
+  return append(fragments, count, size);
+}
+
+size_t UringWriter::write_batch(const iovec *lines, int count) const {
+  // every line is whole, so the batch is just more fragments
+  return writev(lines, count);
+}
+
+#ifdef MICRO_LOGGER_HAS_IO_URING
+void UringWriter::setup() {
+  auto candidate = std::make_unique<Ring>();
+  io_uring_params params{};
+  // one write in flight, the second entry is slack
+  candidate->fd = syscall(__NR_io_uring_setup, 2, &params);
+  if (candidate->fd < 0 or not(params.features & IORING_FEAT_RW_CUR_POS)) {
+    return;
+  }
+  candidate->entries = params.sq_entries;
+  candidate->sq_map_size =
+      params.sq_off.array + params.sq_entries * sizeof(unsigned);
+  candidate->cq_map_size =
+      params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+  const bool single = params.features & IORING_FEAT_SINGLE_MMAP;
+  if (single) {
+    candidate->sq_map_size = candidate->cq_map_size =
+        std::max(candidate->sq_map_size, candidate->cq_map_size);
+  }
+  candidate->sq_map =
+      mmap(nullptr, candidate->sq_map_size, PROT_READ | PROT_WRITE,
+           MAP_SHARED | MAP_POPULATE, candidate->fd, IORING_OFF_SQ_RING);
+  if (candidate->sq_map == MAP_FAILED) {
+    return;
+  }
+  candidate->cq_map =
+      single ? candidate->sq_map
+             : mmap(nullptr, candidate->cq_map_size, PROT_READ | PROT_WRITE,
+                    MAP_SHARED | MAP_POPULATE, candidate->fd,
+                    IORING_OFF_CQ_RING);
+  candidate->sqes =
+      mmap(nullptr, sizeof(io_uring_sqe) * params.sq_entries,
+           PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, candidate->fd,
+           IORING_OFF_SQES);
+  if (candidate->cq_map == MAP_FAILED or candidate->sqes == MAP_FAILED) {
+    return;
+  }
+  auto *sq = static_cast<char *>(candidate->sq_map);
+  auto *cq = static_cast<char *>(candidate->cq_map);
+  candidate->sq_tail = reinterpret_cast<unsigned *>(sq + params.sq_off.tail);
+  candidate->sq_mask =
+      reinterpret_cast<unsigned *>(sq + params.sq_off.ring_mask);
+  candidate->sq_array = reinterpret_cast<unsigned *>(sq + params.sq_off.array);
+  candidate->cq_head = reinterpret_cast<unsigned *>(cq + params.cq_off.head);
+  candidate->cq_tail = reinterpret_cast<unsigned *>(cq + params.cq_off.tail);
+  candidate->cq_mask =
+      reinterpret_cast<unsigned *>(cq + params.cq_off.ring_mask);
+  candidate->cqes = reinterpret_cast<io_uring_cqe *>(cq + params.cq_off.cqes);
+
+  iovec registered[2];
+  for (int i = 0; i < 2; ++i) {
+    candidate->buffers[i] = std::make_unique<char[]>(parameters.buffer_size);
+    registered[i] = {candidate->buffers[i].get(), parameters.buffer_size};
+  }
+  // pinning may exceed RLIMIT_MEMLOCK on older kernels, plain writes
+  // still leave the waiting to the ring
+  candidate->fixed = syscall(__NR_io_uring_register, candidate->fd,
+                             IORING_REGISTER_BUFFERS, registered, 2) == 0;
+  ring = std::move(candidate);
+}
+
+bool UringWriter::start() const {
+  const int flight = ring->fill ^ 1;
+  const unsigned tail = *ring->sq_tail;
+  const unsigned index = tail & *ring->sq_mask;
+  auto *sqe = static_cast<io_uring_sqe *>(ring->sqes) + index;
+  *sqe = {};
+  sqe->opcode = ring->fixed ? IORING_OP_WRITE_FIXED : IORING_OP_WRITE;
+  sqe->fd = fd;
+  sqe->off = -1;
+  sqe->addr = reinterpret_cast<uint64_t>(ring->buffers[flight].get() +
+                                         ring->done);
+  sqe->len = ring->used[flight] - ring->done;
+  sqe->buf_index = flight;
+  ring->sq_array[index] = index;
+  std::atomic_ref(*ring->sq_tail).store(tail + 1, std::memory_order_release);
+  int submitted;
+  while ((submitted = ring->enter(1, 0)) < 0 and errno == EINTR) {
+  }
+  if (submitted > 0) [[likely]] {
+    return true;
+  }
+  // EAGAIN, EBUSY or ENOMEM: the kernel took nothing, take the entry back
+  // so it is not sent later, and write the rest without the ring
+  std::atomic_ref(*ring->sq_tail).store(tail, std::memory_order_release);
+  iovec rest{ring->buffers[flight].get() + ring->done,
+             ring->used[flight] - ring->done};
+  ring->used[flight] = 0;
+  ring->in_flight = false;
+  return write_fd(&rest, 1);
+}
+
+void UringWriter::submit() const {
+  if (ring->used[ring->fill] == 0) {
+    return;
+  }
+  ring->fill ^= 1;
+  ring->in_flight = true;
+  ring->done = 0;
+  start();
+}
+
+bool UringWriter::complete(bool wait) const {
+  while (ring->in_flight) {
+    const unsigned head = *ring->cq_head;
+    if (head ==
+        std::atomic_ref(*ring->cq_tail).load(std::memory_order_acquire)) {
+      if (not wait) {
+        return true;
+      }
+      ring->enter(0, 1);
+      continue;
+    }
+    const int result = ring->cqes[head & *ring->cq_mask].res;
+    std::atomic_ref(*ring->cq_head).store(head + 1, std::memory_order_release);
+    const int flight = ring->fill ^ 1;
+    if (result == -EINTR or result == -EAGAIN) {
+      if (not start()) {
+        return false;
+      }
+      continue;
+    }
+    if (result <= 0) {
+      ring->used[flight] = 0;
+      ring->in_flight = false;
+      return false;
+    }
+    ring->done += result;
+    if (ring->done < ring->used[flight]) {
+      // a short write, the rest has to go before anything newer
+      if (not start()) {
+        return false;
+      }
+      continue;
+    }
+    ring->used[flight] = 0;
+    ring->in_flight = false;
+  }
+  return true;
+}
+
+size_t UringWriter::append(const iovec *fragments, int count,
+                           size_t size) const {
+  if (not ring) {
+    return write_fd(fragments, count) ? size : 0;
+  }
+  complete(false);
+  if (ring->used[ring->fill] + size > parameters.buffer_size) {
+    // both buffers are busy, this is the only place the caller waits
+    complete(true);
+    submit();
+  }
+  if (size > parameters.buffer_size) {
+    complete(true);
+    return write_fd(fragments, count) ? size : 0;
+  }
+  char *target = ring->buffers[ring->fill].get() + ring->used[ring->fill];
+  for (int i = 0; i < count; ++i) {
+    std::memcpy(target, fragments[i].iov_base, fragments[i].iov_len);
+    target += fragments[i].iov_len;
+  }
+  ring->used[ring->fill] += size;
+  if (not ring->in_flight) {
+    submit();
+  }
+  return size;
+}
+
+bool UringWriter::flush(std::chrono::milliseconds timeout) const {
+  if (not ring) {
+    return true;
+  }
+  bool written = complete(true);
+  submit();
+  if (timeout.count()) {
+    written = complete(true) and written;
+  }
+  return written;
+}
+#else
+void UringWriter::setup() {}
+
+size_t UringWriter::append(const iovec *fragments, int count,
+                           size_t size) const {
+  return write_fd(fragments, count) ? size : 0;
+}
+
+bool UringWriter::flush(std::chrono::milliseconds timeout) const {
+  return true;
+}
+#endif
+
+} // namespace micro_logger
@@ -6,9 +6,16 @@
 #pragma once
 #include "micro_logger/micro_logger_writer.hpp"
 //
+#include <algorithm>
+#include <filesystem>
+#include <format>
+#include <fstream>
+#include <gtest/gtest.h>
 #include <ostream>
 #include <sstream>
+#include <string>
 #include <thread>
+#include <unistd.h>
 #include <vector>
 
 class TestWriter : public micro_logger::BaseWriter {
@@ -28,6 +35,54 @@ public:
   mutable std::vector<std::string> line_buffer;
 };
 
+/** Keeps every line it gets in the caller's vector, unsynchronised. */
+class CollectingWriter : public micro_logger::BaseWriter {
+public:
+  explicit CollectingWriter(std::vector<std::string> &lines) : lines(lines) {}
+  size_t write(const char *buf, size_t size) const override {
+    lines.emplace_back(buf, size);
+    return size;
+  }
+
+private:
+  std::vector<std::string> &lines;
+};
+
+/** Gives every test an empty directory of its own, removed afterwards. */
+class FileTest : public ::testing::Test {
+protected:
+  void SetUp() override {
+    const auto *test = ::testing::UnitTest::GetInstance()->current_test_info();
+    directory = std::filesystem::temp_directory_path() /
+                std::format("{}_{}_{}", test->test_suite_name(), getpid(),
+                            test->name());
+    std::filesystem::remove_all(directory);
+    std::filesystem::create_directory(directory);
+    path = directory / "app.log";
+  }
+  void TearDown() override { std::filesystem::remove_all(directory); }
+  std::string content(const std::filesystem::path &file) const {
+    std::ifstream in(file, std::ios::binary);
+    std::stringstream out;
+    out << in.rdbuf();
+    return out.str();
+  }
+  std::string content() const { return content(path); }
+  /** Every other file in @p directory, by name. */
+  std::vector<std::filesystem::path> segments() const {
+    std::vector<std::filesystem::path> found;
+    for (const auto &entry : std::filesystem::directory_iterator(directory)) {
+      if (entry.path() != path) {
+        found.push_back(entry.path());
+      }
+    }
+    std::sort(found.begin(), found.end());
+    return found;
+  }
+  std::filesystem::path directory;
+  std::filesystem::path path;
+};
+
 struct logged_data {
   const std::string &data;
   const std::string &time;
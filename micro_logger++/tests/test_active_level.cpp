@@ -0,0 +1,49 @@
+/*
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/.
+ */
+#define MICRO_LOGGER_ACTIVE_LEVEL MICRO_LOGGER_LEVEL_WARN
+#include "common.h"
+#include "micro_logger/micro_logger.hpp"
+//
+#include <gtest/gtest.h>
+
+void setup_logger() { micro_logger::initialize(TestWriter::get_instance()); }
+
+class TestActiveLevel : public ::testing::Test {
+public:
+protected:
+  static void SetUpTestSuite() { setup_logger(); }
+  void SetUp() override { TestWriter::get_instance().line_buffer.clear(); }
+};
+
+int evaluated(int &counter) { return ++counter; }
+
+TEST_F(TestActiveLevel, stripped_levels_are_not_evaluated) {
+  const auto &line_buffer = TestWriter::get_instance().line_buffer;
+  int counter = 0;
+  micro_logger::set_level(micro_logger::Level::trace);
+
+  MSG_ENTER();
+  MSG_DEBUG("%d", evaluated(counter));
+  MSG_INFO("%d", evaluated(counter));
+  MSG_EXIT();
+  EXPECT_EQ(counter, 0);
+  EXPECT_TRUE(line_buffer.empty());
+
+  MSG_WARN("%d", evaluated(counter));
+  MSG_ERROR("%d", evaluated(counter));
+  MSG_CRITICAL("%d", evaluated(counter));
+  EXPECT_EQ(counter, 3);
+  ASSERT_EQ(line_buffer.size(), 3);
+  EXPECT_NE(line_buffer[0].find("[WARN ]"), std::string::npos);
+}
+
+TEST_F(TestActiveLevel, stripped_macros_are_expressions) {
+  const auto &line_buffer = TestWriter::get_instance().line_buffer;
+  bool verbose = false;
+  verbose ? MSG_DEBUG("debug") : MSG_WARN("warn");
+  ASSERT_EQ(line_buffer.size(), 1);
+  EXPECT_NE(line_buffer[0].find("[warn]"), std::string::npos);
+}
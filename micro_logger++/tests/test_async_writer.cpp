@@ -0,0 +1,508 @@
+/*
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/.
+ */
+#include "common.h"
+#include "micro_logger/micro_logger_writer.hpp"
+//
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <cstring>
+#include <format>
+#include <gtest/gtest.h>
+#include <string>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+class TestAsyncWriter : public ::testing::Test {
+public:
+};
+
+/** Producers wait for the worker instead of dropping lines. */
+constexpr micro_logger::AsyncWriterParameters lossless{
+    .overflow = micro_logger::OverflowPolicy::block,
+    .block_timeout = std::chrono::seconds(10),
+};
+
+TEST_F(TestAsyncWriter, single_producer_keeps_order) {
+  std::vector<std::string> lines;
+  std::unique_ptr<micro_logger::BaseWriter> output =
+      std::make_unique<CollectingWriter>(lines);
+  constexpr size_t data_set_size = 5000;
+  {
+    micro_logger::AsyncWriter writer(output, lossless);
+    for (size_t i = 0; i < data_set_size; ++i) {
+      auto line = std::to_string(i);
+      EXPECT_EQ(writer.write(line.data(), line.size()), line.size());
+    }
+    // destructor drains the remaining entries
+  }
+  ASSERT_EQ(lines.size(), data_set_size);
+  for (size_t i = 0; i < data_set_size; ++i) {
+    EXPECT_EQ(lines[i], std::to_string(i));
+  }
+}
+
+TEST_F(TestAsyncWriter, multiple_producers_lose_nothing) {
+  std::vector<std::string> lines;
+  std::unique_ptr<micro_logger::BaseWriter> output =
+      std::make_unique<CollectingWriter>(lines);
+  constexpr size_t threads_count = 16;
+  constexpr size_t data_set_size = 2000;
+  {
+    micro_logger::AsyncWriter writer(output, lossless);
+    std::vector<std::thread> producers;
+    for (size_t t = 0; t < threads_count; ++t) {
+      producers.emplace_back([&writer, t]() {
+        for (size_t i = 0; i < data_set_size; ++i) {
+          auto line = std::format("{}:{}", t, i);
+          EXPECT_EQ(writer.write(line.data(), line.size()), line.size());
+        }
+      });
+    }
+    for (auto &th : producers) {
+      th.join();
+    }
+  }
+  ASSERT_EQ(lines.size(), threads_count * data_set_size);
+  std::vector<size_t> next(threads_count, 0);
+  for (const auto &line : lines) {
+    auto sep = line.find(':');
+    auto t = std::stoul(line.substr(0, sep));
+    auto i = std::stoul(line.substr(sep + 1));
+    // lines of a single producer are drained in the order they were written
+    EXPECT_EQ(i, next[t]++);
+  }
+}
+
+TEST_F(TestAsyncWriter, fragments_are_joined) {
+  std::vector<std::string> lines;
+  char header[] = "[header]";
+  char message[] = "message";
+  char suffix[] = "\n";
+  iovec fragments[]{{header, std::strlen(header)},
+                    {message, std::strlen(message)},
+                    {suffix, std::strlen(suffix)}};
+  std::unique_ptr<micro_logger::BaseWriter> output =
+      std::make_unique<CollectingWriter>(lines);
+  // default implementation concatenates and forwards to write()
+  EXPECT_EQ(output->writev(fragments, 3), 16);
+  {
+    micro_logger::AsyncWriter writer(output);
+    EXPECT_EQ(writer.writev(fragments, 3), 16);
+  }
+  ASSERT_EQ(lines.size(), 2);
+  EXPECT_EQ(lines[0], "[header]message\n");
+  EXPECT_EQ(lines[1], "[header]message\n");
+}
+
+TEST_F(TestAsyncWriter, variable_length_records) {
+  std::vector<std::string> lines;
+  std::unique_ptr<micro_logger::BaseWriter> output =
+      std::make_unique<CollectingWriter>(lines);
+  constexpr size_t data_set_size = 20000;
+  std::vector<std::string> expected;
+  {
+    // small ring, so records wrap many times at every alignment
+    micro_logger::AsyncWriter writer(
+        output, {.capacity = 4096,
+                 .overflow = lossless.overflow,
+                 .block_timeout = lossless.block_timeout});
+    std::string long_line(writer.max_line_size() + 100, 'x');
+    EXPECT_EQ(writer.write(long_line.data(), long_line.size()),
+              writer.max_line_size());
+    expected.emplace_back(writer.max_line_size(), 'x');
+    for (size_t i = 0; i < data_set_size; ++i) {
+      auto line = std::string(i % 97, 'a' + i % 26) + std::to_string(i);
+      EXPECT_EQ(writer.write(line.data(), line.size()), line.size());
+      expected.emplace_back(line);
+    }
+  }
+  EXPECT_EQ(lines, expected);
+}
+
+TEST_F(TestAsyncWriter, long_lines_above_former_slot_size) {
+  std::vector<std::string> lines;
+  std::unique_ptr<micro_logger::BaseWriter> output =
+      std::make_unique<CollectingWriter>(lines);
+  std::string line(8000, 'y');
+  {
+    micro_logger::AsyncWriter writer(output);
+    EXPECT_EQ(writer.write(line.data(), line.size()), line.size());
+  }
+  ASSERT_EQ(lines.size(), 1);
+  EXPECT_EQ(lines[0], line);
+}
+
+/** Holds the worker inside write() until opened, so the ring fills up. */
+class GatedWriter : public CollectingWriter {
+public:
+  GatedWriter(std::vector<std::string> &lines, std::atomic<bool> &open)
+      : CollectingWriter(lines), open(open) {}
+  size_t write(const char *buf, size_t size) const final {
+    while (not open) {
+      std::this_thread::yield();
+    }
+    return CollectingWriter::write(buf, size);
+  }
+
+private:
+  std::atomic<bool> &open;
+};
+
+/** Write numbered lines until the first one the ring does not take. */
+size_t fill(micro_logger::AsyncWriter &writer, size_t limit = 1000) {
+  for (size_t i = 0; i < limit; ++i) {
+    auto line = std::format("line {:04}", i);
+    if (writer.write(line.data(), line.size()) == 0) {
+      return i;
+    }
+  }
+  return limit;
+}
+
+TEST_F(TestAsyncWriter, overflow_drop_newest_is_reported) {
+  std::vector<std::string> lines;
+  std::atomic<bool> open{false};
+  std::unique_ptr<micro_logger::BaseWriter> output =
+      std::make_unique<GatedWriter>(lines, open);
+  size_t accepted;
+  micro_logger::AsyncWriterStatistics statistics;
+  {
+    micro_logger::AsyncWriter writer(output, {.capacity = 256});
+    accepted = fill(writer);
+    ASSERT_LT(accepted, 1000);
+    EXPECT_EQ(fill(writer, 3), 0);
+    open = true;
+    statistics = writer.statistics();
+  }
+  EXPECT_EQ(statistics.dropped, 2);
+  EXPECT_EQ(statistics.blocked, 0);
+  ASSERT_EQ(lines.size(), accepted + 1);
+  EXPECT_EQ(lines.back(), "[micro_logger] 2 messages dropped\n");
+}
+
+TEST_F(TestAsyncWriter, overflow_block_waits_then_gives_up) {
+  std::vector<std::string> lines;
+  std::atomic<bool> open{false};
+  std::unique_ptr<micro_logger::BaseWriter> output =
+      std::make_unique<GatedWriter>(lines, open);
+  size_t accepted;
+  micro_logger::AsyncWriterStatistics statistics;
+  {
+    micro_logger::AsyncWriter writer(
+        output, {.capacity = 256,
+                 .overflow = micro_logger::OverflowPolicy::block,
+                 .block_timeout = std::chrono::milliseconds(100)});
+    // the last attempt times out while the worker is stuck
+    accepted = fill(writer);
+    ASSERT_LT(accepted, 1000);
+    // room appears within the timeout once the worker moves again
+    std::thread opener([&open, &writer]() {
+      while (writer.statistics().blocked < 2) {
+        std::this_thread::yield();
+      }
+      open = true;
+    });
+    // same length as the numbered lines, so it does not fit in a gap
+    std::string line{"line late"};
+    EXPECT_EQ(writer.write(line.data(), line.size()), line.size());
+    opener.join();
+    statistics = writer.statistics();
+  }
+  EXPECT_EQ(statistics.dropped, 1);
+  EXPECT_EQ(statistics.blocked, 2);
+  ASSERT_EQ(lines.size(), accepted + 2);
+  EXPECT_EQ(std::count(lines.begin(), lines.end(), "line late"), 1);
+  EXPECT_EQ(std::count(lines.begin(), lines.end(),
+                       "[micro_logger] 1 messages dropped\n"),
+            1);
+}
+
+TEST_F(TestAsyncWriter, overflow_overwrite_oldest_keeps_newest) {
+  std::vector<std::string> lines;
+  std::atomic<bool> open{false};
+  std::unique_ptr<micro_logger::BaseWriter> output =
+      std::make_unique<GatedWriter>(lines, open);
+  constexpr size_t data_set_size = 200;
+  micro_logger::AsyncWriterStatistics statistics;
+  {
+    micro_logger::AsyncWriter writer(
+        output, {.capacity = 256,
+                 .overflow = micro_logger::OverflowPolicy::overwrite_oldest});
+    std::thread opener([&open]() {
+      std::this_thread::sleep_for(std::chrono::milliseconds(20));
+      open = true;
+    });
+    EXPECT_EQ(fill(writer, data_set_size), data_set_size);
+    opener.join();
+    statistics = writer.statistics();
+  }
+  EXPECT_GT(statistics.overwritten, 0);
+  EXPECT_EQ(statistics.dropped, 0);
+  // every line is either written or accounted for as overwritten
+  size_t written = 0;
+  size_t reported = 0;
+  for (const auto &line : lines) {
+    if (line.starts_with("line ")) {
+      ++written;
+    } else {
+      reported += std::stoul(line.substr(line.find(']') + 2));
+    }
+  }
+  // the worker may still discard lines after the statistics snapshot
+  EXPECT_GE(reported, statistics.overwritten);
+  EXPECT_EQ(written + reported, data_set_size);
+  // the newest line survives
+  EXPECT_EQ(std::count(lines.begin(), lines.end(),
+                       std::format("line {:04}", data_set_size - 1)),
+            1);
+}
+
+TEST_F(TestAsyncWriter, overflow_overwrite_oldest_gives_up_on_stuck_worker) {
+  std::vector<std::string> lines;
+  std::atomic<bool> open{false};
+  std::unique_ptr<micro_logger::BaseWriter> output =
+      std::make_unique<GatedWriter>(lines, open);
+  micro_logger::AsyncWriterStatistics statistics;
+  {
+    micro_logger::AsyncWriter writer(
+        output, {.capacity = 256,
+                 .overflow = micro_logger::OverflowPolicy::overwrite_oldest,
+                 .block_timeout = std::chrono::milliseconds(20)});
+    // the worker never comes back from write(), nothing can be discarded
+    const auto accepted = fill(writer);
+    EXPECT_LT(accepted, 1000);
+    statistics = writer.statistics();
+    open = true;
+  }
+  EXPECT_EQ(statistics.dropped, 1);
+}
+
+TEST_F(TestAsyncWriter, overflow_write_through_loses_nothing) {
+  std::vector<std::string> lines;
+  std::atomic<bool> open{false};
+  std::unique_ptr<micro_logger::BaseWriter> output =
+      std::make_unique<GatedWriter>(lines, open);
+  constexpr size_t data_set_size = 200;
+  micro_logger::AsyncWriterStatistics statistics;
+  {
+    micro_logger::AsyncWriter writer(
+        output, {.capacity = 256,
+                 .overflow = micro_logger::OverflowPolicy::write_through});
+    std::thread opener([&open]() {
+      std::this_thread::sleep_for(std::chrono::milliseconds(20));
+      open = true;
+    });
+    EXPECT_EQ(fill(writer, data_set_size), data_set_size);
+    opener.join();
+    statistics = writer.statistics();
+  }
+  EXPECT_GT(statistics.written_through, 0);
+  EXPECT_EQ(statistics.dropped, 0);
+  EXPECT_EQ(lines.size(), data_set_size);
+}
+
+/** Records the size of every batch; held closed like GatedWriter. */
+class BatchWriter : public CollectingWriter {
+public:
+  BatchWriter(std::vector<std::string> &lines, std::vector<int> &batches,
+              std::atomic<bool> &open)
+      : CollectingWriter(lines), batches(batches), open(open) {}
+  size_t write_batch(const iovec *lines, int count) const final {
+    while (not open) {
+      std::this_thread::yield();
+    }
+    batches.push_back(count);
+    return BaseWriter::write_batch(lines, count);
+  }
+
+private:
+  std::vector<int> &batches;
+  std::atomic<bool> &open;
+};
+
+TEST_F(TestAsyncWriter, ready_lines_are_batched) {
+  std::vector<std::string> lines;
+  std::vector<int> batches;
+  std::atomic<bool> open{false};
+  std::unique_ptr<micro_logger::BaseWriter> output =
+      std::make_unique<BatchWriter>(lines, batches, open);
+  constexpr size_t data_set_size = 100;
+  {
+    micro_logger::AsyncWriter writer(output, {.max_batch_lines = 16});
+    for (size_t i = 0; i < data_set_size; ++i) {
+      auto line = std::format("line {:04}", i);
+      EXPECT_EQ(writer.write(line.data(), line.size()), line.size());
+    }
+    open = true;
+  }
+  ASSERT_EQ(lines.size(), data_set_size);
+  for (size_t i = 0; i < data_set_size; ++i) {
+    EXPECT_EQ(lines[i], std::format("line {:04}", i));
+  }
+  // whatever queued up behind the held batch goes out in full batches
+  EXPECT_LE(*std::max_element(batches.begin(), batches.end()), 16);
+  EXPECT_LE(batches.size(), 2 + data_set_size / 16);
+}
+
+TEST_F(TestAsyncWriter, linger_lets_batch_grow) {
+  std::vector<std::string> lines;
+  std::vector<int> batches;
+  std::atomic<bool> open{true};
+  std::unique_ptr<micro_logger::BaseWriter> output =
+      std::make_unique<BatchWriter>(lines, batches, open);
+  constexpr size_t data_set_size = 10;
+  {
+    micro_logger::AsyncWriter writer(
+        output, {.linger = std::chrono::milliseconds(200)});
+    for (size_t i = 0; i < data_set_size; ++i) {
+      auto line = std::format("line {:04}", i);
+      EXPECT_EQ(writer.write(line.data(), line.size()), line.size());
+    }
+  }
+  EXPECT_EQ(lines.size(), data_set_size);
+  EXPECT_LT(batches.size(), data_set_size);
+}
+
+TEST_F(TestAsyncWriter, wait_strategies_lose_nothing) {
+  constexpr micro_logger::WaitStrategy strategies[]{
+      micro_logger::WaitStrategy::block,
+      micro_logger::WaitStrategy::spin_yield_park,
+      micro_logger::WaitStrategy::busy_spin,
+  };
+  constexpr size_t data_set_size = 2000;
+  for (auto strategy : strategies) {
+    std::vector<std::string> lines;
+    std::unique_ptr<micro_logger::BaseWriter> output =
+        std::make_unique<CollectingWriter>(lines);
+    {
+      auto parameters = lossless;
+      parameters.wait = strategy;
+      parameters.cpu = strategy == micro_logger::WaitStrategy::busy_spin ? 0
+                                                                           : -1;
+      micro_logger::AsyncWriter writer(output, parameters);
+      for (size_t i = 0; i < data_set_size; ++i) {
+        auto line = std::to_string(i);
+        EXPECT_EQ(writer.write(line.data(), line.size()), line.size());
+        if (i % 500 == 0) {
+          // let the worker run out of lines and wait again
+          std::this_thread::sleep_for(std::chrono::milliseconds(2));
+        }
+      }
+    }
+    ASSERT_EQ(lines.size(), data_set_size);
+    for (size_t i = 0; i < data_set_size; ++i) {
+      EXPECT_EQ(lines[i], std::to_string(i));
+    }
+  }
+}
+
+TEST_F(TestAsyncWriter, flush_waits_for_queued_lines) {
+  std::vector<std::string> lines;
+  std::atomic<bool> open{false};
+  std::unique_ptr<micro_logger::BaseWriter> output =
+      std::make_unique<GatedWriter>(lines, open);
+  micro_logger::AsyncWriter writer(output, lossless);
+  constexpr size_t data_set_size = 100;
+  for (size_t i = 0; i < data_set_size; ++i) {
+    auto line = std::format("line {:04}", i);
+    EXPECT_EQ(writer.write(line.data(), line.size()), line.size());
+  }
+  // the worker is held by the gate
+  EXPECT_FALSE(writer.flush(std::chrono::milliseconds(10)));
+  open = true;
+  EXPECT_TRUE(writer.flush());
+  EXPECT_EQ(lines.size(), data_set_size);
+  // the worker keeps running after a flush
+  std::string line{"after flush"};
+  EXPECT_EQ(writer.write(line.data(), line.size()), line.size());
+  EXPECT_TRUE(writer.flush(std::chrono::seconds(10)));
+  ASSERT_EQ(lines.size(), data_set_size + 1);
+  EXPECT_EQ(lines.back(), line);
+}
+
+/** Lines held in the ring of a writer whose output never opens. */
+void crash_with_queued_lines(void (*crash)()) {
+  static std::vector<std::string> lines;
+  static std::atomic<bool> open{false};
+  std::unique_ptr<micro_logger::BaseWriter> output =
+      std::make_unique<GatedWriter>(lines, open);
+  static micro_logger::AsyncWriter writer(output);
+  writer.install_crash_handler();
+  for (size_t i = 0; i < 10; ++i) {
+    auto line = std::format("line {:04}\n", i);
+    writer.write(line.data(), line.size());
+  }
+  crash();
+}
+
+TEST_F(TestAsyncWriter, crash_signal_drains_ring) {
+  EXPECT_DEATH(crash_with_queued_lines([]() { std::raise(SIGSEGV); }),
+               "line 0000\nline 0001\n(.|\n)*line 0009\n");
+}
+
+TEST_F(TestAsyncWriter, terminate_drains_ring) {
+  EXPECT_DEATH(crash_with_queued_lines([]() { std::terminate(); }),
+               "line 0000\nline 0001\n(.|\n)*line 0009\n");
+}
+
+TEST_F(TestAsyncWriter, crash_handler_registers_a_writer_once) {
+  constexpr size_t slots = 8;
+  std::vector<std::unique_ptr<micro_logger::AsyncWriter>> writers;
+  for (size_t i = 0; i < slots + 1; ++i) {
+    std::unique_ptr<micro_logger::BaseWriter> output =
+        std::make_unique<micro_logger::SilentWriter>();
+    writers.push_back(std::make_unique<micro_logger::AsyncWriter>(output));
+  }
+  {
+    std::vector<std::jthread> installers;
+    for (int t = 0; t < 8; ++t) {
+      installers.emplace_back([&writers]() {
+        writers.front()->install_crash_handler();
+      });
+    }
+  }
+  // the first writer took one slot only
+  for (size_t i = 1; i < slots; ++i) {
+    EXPECT_NO_THROW(writers[i]->install_crash_handler());
+  }
+  EXPECT_THROW(writers.back()->install_crash_handler(), std::domain_error);
+}
+
+/** Counts the flushes reaching the wrapped writer. */
+class FlushCountingWriter : public CollectingWriter {
+public:
+  FlushCountingWriter(std::vector<std::string> &lines,
+                      std::atomic<int> &flushes)
+      : CollectingWriter(lines), flushes(flushes) {}
+  bool flush(std::chrono::milliseconds /*timeout*/) const final {
+    ++flushes;
+    return true;
+  }
+
+private:
+  std::atomic<int> &flushes;
+};
+
+TEST_F(TestAsyncWriter, zero_timeout_flush_reaches_output) {
+  std::vector<std::string> lines;
+  std::atomic<int> flushes{0};
+  std::unique_ptr<micro_logger::BaseWriter> output =
+      std::make_unique<FlushCountingWriter>(lines, flushes);
+  micro_logger::AsyncWriter writer(output);
+  std::string line{"severe line"};
+  writer.write(line.data(), line.size());
+  // does not wait, the worker flushes once the line has been written
+  writer.flush(std::chrono::milliseconds::zero());
+  const auto deadline =
+      std::chrono::steady_clock::now() + std::chrono::seconds(10);
+  while (flushes == 0 and std::chrono::steady_clock::now() < deadline) {
+    std::this_thread::yield();
+  }
+  EXPECT_EQ(flushes, 1);
+}
@@ -0,0 +1,91 @@
+/*
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/.
+ */
+#include "common.h"
+#include "micro_logger/micro_logger.hpp"
+#include "micro_logger/micro_logger_writer.hpp"
+//
+#include <chrono>
+#include <filesystem>
+#include <gtest/gtest.h>
+#include <string>
+#include <thread>
+
+class TestBufferedFileWriter : public FileTest {};
+
+TEST_F(TestBufferedFileWriter, lines_stay_buffered_until_flush) {
+  micro_logger::BufferedFileWriter writer(path.c_str());
+  std::string line{"first line\n"};
+  EXPECT_EQ(writer.write(line.data(), line.size()), line.size());
+  EXPECT_EQ(content(), "");
+  EXPECT_TRUE(writer.flush());
+  EXPECT_EQ(content(), line);
+}
+
+TEST_F(TestBufferedFileWriter, destructor_writes_buffer_out) {
+  {
+    micro_logger::BufferedFileWriter writer(path.c_str());
+    std::string line{"first line\n"};
+    writer.write(line.data(), line.size());
+  }
+  EXPECT_EQ(content(), "first line\n");
+}
+
+TEST_F(TestBufferedFileWriter, flush_bytes_threshold) {
+  micro_logger::BufferedFileWriter writer(path.c_str(), {.flush_bytes = 16});
+  std::string line{"0123456789\n"};
+  writer.write(line.data(), line.size());
+  EXPECT_EQ(content(), "");
+  writer.write(line.data(), line.size());
+  EXPECT_EQ(content(), line + line);
+}
+
+TEST_F(TestBufferedFileWriter, flush_interval) {
+  micro_logger::BufferedFileWriter writer(
+      path.c_str(), {.flush_interval = std::chrono::milliseconds(20)});
+  std::string line{"0123456789\n"};
+  writer.write(line.data(), line.size());
+  EXPECT_EQ(content(), "");
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  writer.write(line.data(), line.size());
+  EXPECT_EQ(content(), line + line);
+}
+
+TEST_F(TestBufferedFileWriter, long_line_bypasses_buffer_in_order) {
+  micro_logger::BufferedFileWriter writer(path.c_str(), {.buffer_size = 64});
+  std::string line{"short\n"};
+  std::string fragment(100, 'x');
+  std::string end{"\n"};
+  writer.write(line.data(), line.size());
+  iovec fragments[]{{fragment.data(), fragment.size()}, {end.data(), 1}};
+  EXPECT_EQ(writer.writev(fragments, std::size(fragments)),
+            fragment.size() + 1);
+  EXPECT_EQ(content(), line + fragment + end);
+}
+
+TEST_F(TestBufferedFileWriter, severe_level_writes_buffer_out) {
+  micro_logger::BufferedFileWriter writer(path.c_str());
+  micro_logger::BufferedFileWriter quiet(
+      (path.string() + ".quiet").c_str(), {.flush_on_severe = false});
+  std::string line{"line\n"};
+  iovec fragment{line.data(), line.size()};
+  writer.write_record(micro_logger::Level::warn, &fragment, 1);
+  EXPECT_EQ(content(), "");
+  writer.write_record(micro_logger::Level::critical, &fragment, 1);
+  EXPECT_EQ(content(), line + line);
+  quiet.write_record(micro_logger::Level::critical, &fragment, 1);
+  EXPECT_EQ(std::filesystem::file_size(path.string() + ".quiet"), 0);
+}
+
+TEST_F(TestBufferedFileWriter, error_line_flushes) {
+  micro_logger::BufferedFileWriter writer(path.c_str());
+  micro_logger::initialize(writer);
+  MSG_INFO("info");
+  EXPECT_EQ(content(), "");
+  MSG_ERROR("error");
+  auto lines = content();
+  EXPECT_NE(lines.find("info"), std::string::npos);
+  EXPECT_NE(lines.find("error"), std::string::npos);
+}
@@ -0,0 +1,246 @@
+/*
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/.
+ */
+#include "micro_logger/micro_logger_writer.hpp"
+//
+#include <chrono>
+#include <filesystem>
+#include <format>
+#include <fstream>
+#include <gtest/gtest.h>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+#include <zlib.h>
+
+using namespace std::chrono_literals;
+
+/** Every write a ChunkWriter got, outlives the writer. */
+class Chunks {
+public:
+  void add(const char *buf, size_t size) {
+    std::scoped_lock lock(sync);
+    chunks.emplace_back(buf, size);
+  }
+  std::vector<std::string> received() const {
+    std::scoped_lock lock(sync);
+    return chunks;
+  }
+  std::string joined() const {
+    std::string all;
+    for (const auto &chunk : received()) {
+      all += chunk;
+    }
+    return all;
+  }
+
+private:
+  mutable std::mutex sync;
+  std::vector<std::string> chunks;
+};
+
+/** Keeps every write it gets as one chunk. */
+class ChunkWriter : public micro_logger::BaseWriter {
+public:
+  explicit ChunkWriter(Chunks &chunks) : chunks(chunks) {}
+  size_t write(const char *buf, size_t size) const final {
+    chunks.add(buf, size);
+    return size;
+  }
+
+private:
+  Chunks &chunks;
+};
+
+/**
+ * Decode the gzip members in @p data one after another.
+ * @param complete  Set when @p data ends with a complete member.
+ */
+std::string gunzip(const std::string &data, bool &complete) {
+  std::string decoded;
+  z_stream z{};
+  inflateInit2(&z, 15 + 16);
+  z.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(data.data()));
+  z.avail_in = data.size();
+  complete = false;
+  // whatever a member decoded to only counts once the member is complete
+  std::string member;
+  while (z.avail_in) {
+    char chunk[4096];
+    z.next_out = reinterpret_cast<Bytef *>(chunk);
+    z.avail_out = sizeof(chunk);
+    const int result = inflate(&z, Z_NO_FLUSH);
+    member.append(chunk, sizeof(chunk) - z.avail_out);
+    if (result == Z_STREAM_END) {
+      decoded += member;
+      member.clear();
+      complete = true;
+      inflateReset(&z);
+      continue;
+    }
+    complete = false;
+    if (result != Z_OK) {
+      break;
+    }
+  }
+  inflateEnd(&z);
+  return decoded;
+}
+
+std::string gunzip(const std::string &data) {
+  bool complete;
+  return gunzip(data, complete);
+}
+
+class TestCompressedWriter : public ::testing::Test {
+public:
+protected:
+  void SetUp() override { output = std::make_unique<ChunkWriter>(chunks); }
+  /** Lines with some variety, as a log has. */
+  static std::string line(int i) {
+    return std::format("[10/17/26 12:00:{:02}.{:03}][INFO ] request {} took "
+                       "{} us\n",
+                       i / 1000 % 60, i % 1000, i, i * 7919 % 10007);
+  }
+  Chunks chunks;
+  std::unique_ptr<micro_logger::BaseWriter> output;
+};
+
+TEST_F(TestCompressedWriter, frames_decode_to_the_input) {
+  std::string expected;
+  {
+    micro_logger::CompressedWriter writer(output, {.frame_size = 4096});
+    for (int i = 0; i < 10000; ++i) {
+      auto text = line(i);
+      expected += text;
+      iovec fragments[2]{{text.data(), 10},
+                         {text.data() + 10, text.size() - 10}};
+      EXPECT_EQ(writer.writev(fragments, 2), text.size());
+    }
+  }
+  const auto compressed = chunks.joined();
+  EXPECT_GT(chunks.received().size(), 10);
+  EXPECT_LT(compressed.size(), expected.size() / 3);
+  bool complete;
+  EXPECT_EQ(gunzip(compressed, complete), expected);
+  EXPECT_TRUE(complete);
+}
+
+TEST_F(TestCompressedWriter, every_frame_decodes_on_its_own) {
+  std::string expected;
+  {
+    micro_logger::CompressedWriter writer(output, {.frame_size = 1024});
+    for (int i = 0; i < 1000; ++i) {
+      auto text = line(i);
+      expected += text;
+      writer.write(text.data(), text.size());
+    }
+  }
+  std::string decoded;
+  for (const auto &chunk : chunks.received()) {
+    bool complete;
+    decoded += gunzip(chunk, complete);
+    EXPECT_TRUE(complete);
+  }
+  EXPECT_EQ(decoded, expected);
+}
+
+TEST_F(TestCompressedWriter, truncated_stream_keeps_complete_frames) {
+  {
+    micro_logger::CompressedWriter writer(output, {.frame_size = 1024});
+    for (int i = 0; i < 1000; ++i) {
+      auto text = line(i);
+      writer.write(text.data(), text.size());
+    }
+  }
+  auto received = chunks.received();
+  ASSERT_GT(received.size(), 2);
+  std::string head;
+  for (size_t i = 0; i + 1 < received.size(); ++i) {
+    head += received[i];
+  }
+  const auto &last = received.back();
+  bool complete;
+  EXPECT_EQ(gunzip(head + last.substr(0, last.size() / 2), complete),
+            gunzip(head));
+  EXPECT_FALSE(complete);
+}
+
+TEST_F(TestCompressedWriter, flush_closes_the_frame) {
+  micro_logger::CompressedWriter writer(output, {.frame_interval = 0ms});
+  auto text = line(1);
+  writer.write(text.data(), text.size());
+  EXPECT_TRUE(chunks.received().empty());
+  EXPECT_TRUE(writer.flush());
+  EXPECT_EQ(gunzip(chunks.joined()), text);
+}
+
+TEST_F(TestCompressedWriter, interval_closes_a_quiet_frame) {
+  micro_logger::CompressedWriter writer(output, {.frame_interval = 20ms});
+  auto text = line(1);
+  writer.write(text.data(), text.size());
+  for (int i = 0; i < 500 and chunks.received().empty(); ++i) {
+    std::this_thread::sleep_for(10ms);
+  }
+  EXPECT_EQ(gunzip(chunks.joined()), text);
+}
+
+TEST_F(TestCompressedWriter, concurrent_lines_stay_intact) {
+  constexpr int threads = 4;
+  constexpr int lines = 2000;
+  {
+    micro_logger::CompressedWriter writer(output, {.frame_size = 4096});
+    std::vector<std::jthread> workers;
+    for (int t = 0; t < threads; ++t) {
+      workers.emplace_back([&writer, t]() {
+        for (int i = 0; i < lines; ++i) {
+          auto text = std::format("thread {} line {:05}\n", t, i);
+          writer.write(text.data(), text.size());
+        }
+      });
+    }
+  }
+  std::istringstream in(gunzip(chunks.joined()));
+  int count = 0;
+  for (std::string text; std::getline(in, text); ++count) {
+    EXPECT_TRUE(text.starts_with("thread ")) << text;
+  }
+  EXPECT_EQ(count, threads * lines);
+}
+
+TEST_F(TestCompressedWriter, gzip_file_behind_async_writer) {
+  const auto path = std::filesystem::temp_directory_path() /
+                    std::format("test_compressed_writer_{}.gz", getpid());
+  std::string expected;
+  {
+    std::unique_ptr<micro_logger::BaseWriter> file =
+        std::make_unique<micro_logger::FileWriter>(path.c_str());
+    std::unique_ptr<micro_logger::BaseWriter> compressed =
+        std::make_unique<micro_logger::CompressedWriter>(
+            file, micro_logger::CompressedWriterParameters{.frame_size = 8192});
+    micro_logger::AsyncWriter writer(
+        compressed, {.overflow = micro_logger::OverflowPolicy::block,
+                     .block_timeout = std::chrono::seconds(10)});
+    for (int i = 0; i < 5000; ++i) {
+      auto text = line(i);
+      expected += text;
+      writer.write(text.data(), text.size());
+    }
+  }
+  std::string decoded;
+  gzFile in = gzopen(path.c_str(), "rb");
+  ASSERT_NE(in, nullptr);
+  char chunk[4096];
+  int size;
+  while ((size = gzread(in, chunk, sizeof(chunk))) > 0) {
+    decoded.append(chunk, size);
+  }
+  gzclose(in);
+  std::filesystem::remove(path);
+  EXPECT_EQ(decoded, expected);
+}
@@ -0,0 +1,154 @@
+/*
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/.
+ */
+#include "common.h"
+#include "micro_logger/micro_logger.hpp"
+//
+#include <cstdint>
+#include <gtest/gtest.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+void setup_logger() { micro_logger::initialize(TestWriter::get_instance()); }
+
+class TestDeferredFormatting : public ::testing::Test {
+public:
+protected:
+  static void SetUpTestSuite() { setup_logger(); }
+  void SetUp() override { TestWriter::get_instance().line_buffer.clear(); }
+  void TearDown() override { micro_logger::set_deferred_formatting(false); }
+};
+
+/** Drop the timestamp, everything after it has to match byte by byte. */
+std::string without_time(const std::string &line) {
+  return line.substr(line.find(']') + 1);
+}
+
+void log_all_conversions() {
+  const char not_terminated[3] = {'a', 'b', 'c'};
+  int value = 42;
+  MSG_INFO("plain text");
+  MSG_INFO("%d %i %u %x %X %o %%", -1, 2, 3u, 0xbeef, 0xbeef, 8);
+  MSG_INFO("%hhd %hd %ld %lld %zu %jd %td", 1, 2, -3L, -4LL, size_t{5},
+           intmax_t{6}, ptrdiff_t{7});
+  MSG_INFO("[%08.3f] [%-8e] [%g] [%a] [%Lf]", 3.14159, 2.5, 1e10, 1.0,
+           1.5L);
+  MSG_INFO("[%s] [%10s] [%-10s] [%.2s] [%.*s]", "str", "right", "left",
+           "cut", 3, not_terminated);
+  MSG_INFO("[%*d] [%-*d] [%.*f]", 6, 1, 6, 2, 2, 3.14159);
+  MSG_INFO("%c%c %p", 'o', 'k', static_cast<void *>(&value));
+  MSG_INFO("%s", nullptr);
+}
+
+TEST_F(TestDeferredFormatting, matches_immediate_formatting) {
+  auto &obj = TestWriter::get_instance();
+  log_all_conversions();
+  const auto immediate = obj.line_buffer;
+  obj.line_buffer.clear();
+
+  micro_logger::set_deferred_formatting(true);
+  log_all_conversions();
+  micro_logger::set_deferred_formatting(false);
+
+  ASSERT_EQ(obj.line_buffer.size(), immediate.size());
+  for (size_t i = 0; i < immediate.size(); ++i) {
+    EXPECT_EQ(without_time(obj.line_buffer[i]), without_time(immediate[i]));
+  }
+}
+
+TEST_F(TestDeferredFormatting, keeps_per_thread_order) {
+  auto &obj = TestWriter::get_instance();
+  constexpr size_t threads_count = 8;
+  constexpr size_t data_set_size = 2000;
+
+  micro_logger::set_deferred_formatting(true, 16 * 1024);
+  std::vector<std::thread> producers;
+  for (size_t t = 0; t < threads_count; ++t) {
+    producers.emplace_back([t]() {
+      for (size_t i = 0; i < data_set_size; ++i) {
+        MSG_DEBUG("%zu:%zu", t, i);
+      }
+    });
+  }
+  for (auto &th : producers) {
+    th.join();
+  }
+  micro_logger::set_deferred_formatting(false);
+
+  ASSERT_EQ(obj.line_buffer.size(), threads_count * data_set_size);
+  std::vector<size_t> next(threads_count, 0);
+  for (const auto &line : obj.line_buffer) {
+    auto begin = line.rfind('[') + 1;
+    auto sep = line.find(':', begin);
+    auto t = std::stoul(line.substr(begin, sep - begin));
+    auto i = std::stoul(line.substr(sep + 1));
+    EXPECT_EQ(i, next[t]++);
+  }
+}
+
+TEST_F(TestDeferredFormatting, keeps_per_thread_order_with_immediate_lines) {
+  auto &obj = TestWriter::get_instance();
+  constexpr size_t threads_count = 4;
+  constexpr size_t data_set_size = 2000;
+  // longer than a record may be, formatted by the caller
+  const std::string oversized(2 * 4096, 'x');
+
+  micro_logger::set_deferred_formatting(true, 16 * 1024);
+  std::vector<std::thread> producers;
+  for (size_t t = 0; t < threads_count; ++t) {
+    producers.emplace_back([t, &oversized]() {
+      for (size_t i = 0; i < data_set_size; ++i) {
+        switch (i % 8) {
+        case 3:
+          // %m can not be deferred
+          MSG_DEBUG("%zu:%zu %m", t, i);
+          break;
+        case 5:
+          MSG_DEBUG("%zu:%zu %s", t, i, oversized.c_str());
+          break;
+        case 7:
+          micro_logger::debug("{}:{}", t, i);
+          break;
+        default:
+          MSG_DEBUG("%zu:%zu", t, i);
+        }
+      }
+    });
+  }
+  for (auto &th : producers) {
+    th.join();
+  }
+  micro_logger::set_deferred_formatting(false);
+
+  ASSERT_EQ(obj.line_buffer.size(), threads_count * data_set_size);
+  std::vector<size_t> next(threads_count, 0);
+  for (const auto &line : obj.line_buffer) {
+    auto begin = line.rfind('[') + 1;
+    auto sep = line.find(':', begin);
+    auto t = std::stoul(line.substr(begin, sep - begin));
+    auto i = std::stoul(line.substr(sep + 1));
+    EXPECT_EQ(i, next[t]++);
+  }
+}
+
+TEST_F(TestDeferredFormatting, flush_writes_queued_lines) {
+  auto &obj = TestWriter::get_instance();
+  constexpr size_t data_set_size = 1000;
+
+  micro_logger::set_deferred_formatting(true);
+  std::thread producer([]() {
+    for (size_t i = 0; i < data_set_size; ++i) {
+      MSG_DEBUG("%zu", i);
+    }
+  });
+  producer.join();
+  for (size_t i = 0; i < data_set_size; ++i) {
+    MSG_DEBUG("%zu", i);
+  }
+  EXPECT_TRUE(micro_logger::flush());
+  // still deferred, the barrier alone got the lines out
+  EXPECT_EQ(obj.line_buffer.size(), 2 * data_set_size);
+}
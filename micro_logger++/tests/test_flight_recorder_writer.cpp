@@ -0,0 +1,208 @@
+/*
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/.
+ */
+#include "micro_logger/micro_logger.hpp"
+//
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <format>
+#include <gtest/gtest.h>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace std::chrono_literals;
+
+/** Every line a LineWriter got, outlives the writer. */
+class Lines {
+public:
+  void add(const char *buf, size_t size) {
+    std::scoped_lock lock(sync);
+    lines.emplace_back(buf, size);
+  }
+  std::vector<std::string> received() const {
+    std::scoped_lock lock(sync);
+    return lines;
+  }
+
+private:
+  mutable std::mutex sync;
+  std::vector<std::string> lines;
+};
+
+/** Keeps every line it gets. */
+class LineWriter : public micro_logger::BaseWriter {
+public:
+  explicit LineWriter(Lines &lines) : lines(lines) {}
+  size_t write(const char *buf, size_t size) const final {
+    lines.add(buf, size);
+    return size;
+  }
+
+private:
+  Lines &lines;
+};
+
+class TestFlightRecorderWriter : public ::testing::Test {
+public:
+protected:
+  void SetUp() override { output = std::make_unique<LineWriter>(lines); }
+  static std::string line(int i) { return std::format("line {:06}\n", i); }
+  Lines lines;
+  std::unique_ptr<micro_logger::BaseWriter> output;
+};
+
+TEST_F(TestFlightRecorderWriter, lines_wait_for_a_dump) {
+  micro_logger::FlightRecorderWriter writer(output);
+  std::vector<std::string> expected;
+  for (int i = 0; i < 10; ++i) {
+    expected.push_back(line(i));
+    EXPECT_EQ(writer.write(expected.back().data(), expected.back().size()),
+              expected.back().size());
+  }
+  EXPECT_TRUE(lines.received().empty());
+  EXPECT_EQ(writer.dump(), 10);
+  EXPECT_EQ(lines.received(), expected);
+}
+
+TEST_F(TestFlightRecorderWriter, dump_writes_new_lines_only) {
+  micro_logger::FlightRecorderWriter writer(output);
+  auto first = line(1), second = line(2);
+  writer.write(first.data(), first.size());
+  EXPECT_EQ(writer.dump(), 1);
+  EXPECT_EQ(writer.dump(), 0);
+  iovec fragments[2]{{second.data(), 4},
+                     {second.data() + 4, second.size() - 4}};
+  writer.writev(fragments, 2);
+  EXPECT_EQ(writer.dump(), 1);
+  EXPECT_EQ(lines.received(), (std::vector<std::string>{first, second}));
+}
+
+TEST_F(TestFlightRecorderWriter, oldest_lines_are_overwritten) {
+  micro_logger::FlightRecorderWriter writer(
+      output, {.capacity = 1024, .block_size = 256});
+  for (int i = 0; i < 1000; ++i) {
+    auto text = line(i);
+    writer.write(text.data(), text.size());
+  }
+  writer.dump();
+  auto received = lines.received();
+  ASSERT_FALSE(received.empty());
+  EXPECT_LT(received.size(), 1000);
+  // the newest lines, without gaps
+  const int first = 1000 - static_cast<int>(received.size());
+  for (size_t i = 0; i < received.size(); ++i) {
+    EXPECT_EQ(received[i], line(first + i));
+  }
+}
+
+TEST_F(TestFlightRecorderWriter, long_line_is_truncated_to_a_block) {
+  micro_logger::FlightRecorderWriter writer(output, {.block_size = 256});
+  std::string text(1000, 'x');
+  EXPECT_EQ(writer.write(text.data(), text.size()), 256 - 8);
+  writer.dump();
+  EXPECT_EQ(lines.received(), std::vector<std::string>{text.substr(0, 248)});
+}
+
+TEST_F(TestFlightRecorderWriter, severe_line_dumps) {
+  micro_logger::FlightRecorderWriter writer(output);
+  auto info = line(1), error = line(2);
+  iovec fragment{info.data(), info.size()};
+  writer.write_record(micro_logger::Level::info, &fragment, 1);
+  EXPECT_TRUE(lines.received().empty());
+  fragment = {error.data(), error.size()};
+  writer.write_record(micro_logger::Level::error, &fragment, 1);
+  EXPECT_EQ(lines.received(), (std::vector<std::string>{info, error}));
+}
+
+TEST_F(TestFlightRecorderWriter, signal_dumps) {
+  micro_logger::FlightRecorderWriter writer(output);
+  writer.install_signal_handler(SIGUSR1);
+  auto text = line(1);
+  writer.write(text.data(), text.size());
+  raise(SIGUSR1);
+  for (int i = 0; i < 500 and lines.received().empty(); ++i) {
+    std::this_thread::sleep_for(10ms);
+  }
+  EXPECT_EQ(lines.received(), std::vector<std::string>{text});
+}
+
+namespace {
+std::atomic<int> previous_handler_calls{0};
+} // namespace
+
+TEST_F(TestFlightRecorderWriter, last_writer_restores_previous_handler) {
+  struct sigaction action = {};
+  action.sa_handler = [](int) { previous_handler_calls.fetch_add(1); };
+  sigemptyset(&action.sa_mask);
+  struct sigaction original;
+  ASSERT_EQ(sigaction(SIGUSR2, &action, &original), 0);
+  {
+    std::unique_ptr<micro_logger::BaseWriter> second =
+        std::make_unique<LineWriter>(lines);
+    micro_logger::FlightRecorderWriter first_writer(output);
+    micro_logger::FlightRecorderWriter second_writer(second);
+    first_writer.install_signal_handler(SIGUSR2);
+    second_writer.install_signal_handler(SIGUSR2);
+    raise(SIGUSR2);
+    EXPECT_EQ(previous_handler_calls, 0);
+  }
+  raise(SIGUSR2);
+  EXPECT_EQ(previous_handler_calls, 1);
+  sigaction(SIGUSR2, &original, nullptr);
+}
+
+TEST_F(TestFlightRecorderWriter, concurrent_lines_stay_intact) {
+  constexpr int threads = 4;
+  constexpr int count = 20000;
+  {
+    micro_logger::FlightRecorderWriter writer(
+        output, {.capacity = 64 * 1024, .block_size = 4096});
+    std::vector<std::jthread> workers;
+    for (int t = 0; t < threads; ++t) {
+      workers.emplace_back([&writer, t]() {
+        for (int i = 0; i < count; ++i) {
+          auto text = std::format("thread {} line {:06}\n", t, i);
+          writer.write(text.data(), text.size());
+        }
+      });
+    }
+    workers.clear();
+    writer.dump();
+  }
+  auto received = lines.received();
+  EXPECT_GT(received.size(), 1000);
+  std::map<int, int> last;
+  for (const auto &text : received) {
+    int t, i;
+    ASSERT_EQ(std::sscanf(text.c_str(), "thread %d line %d\n", &t, &i), 2)
+        << text;
+    EXPECT_EQ(text, std::format("thread {} line {:06}\n", t, i));
+    // every thread's lines keep their order
+    EXPECT_GT(i, last.contains(t) ? last[t] : -1);
+    last[t] = i;
+  }
+}
+
+TEST_F(TestFlightRecorderWriter, logger_error_dumps_the_context) {
+  static Lines logged;
+  std::unique_ptr<micro_logger::BaseWriter> line_writer =
+      std::make_unique<LineWriter>(logged);
+  static micro_logger::FlightRecorderWriter writer(line_writer);
+  micro_logger::initialize(writer);
+  micro_logger::set_level(micro_logger::Level::trace);
+  for (int i = 0; i < 100; ++i) {
+    micro_logger::trace("context {}", i);
+  }
+  EXPECT_TRUE(logged.received().empty());
+  micro_logger::error("{}", "incident");
+  auto received = logged.received();
+  ASSERT_EQ(received.size(), 101);
+  EXPECT_NE(received.front().find("[context 0]"), std::string::npos);
+  EXPECT_NE(received.back().find("[incident]"), std::string::npos);
+}
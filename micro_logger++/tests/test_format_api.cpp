@@ -0,0 +1,91 @@
+/*
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/.
+ */
+#include "common.h"
+#include "micro_logger/micro_logger.hpp"
+//
+#include <algorithm>
+#include <format>
+#include <gtest/gtest.h>
+#include <regex>
+#include <string>
+
+using namespace std::string_literals;
+
+std::regex regex_pattern(
+    R"(\[(\d{2}/\d{2}/\d{2})[ ](\d{2}:\d{2}:\d{2}\.\d{3})\]\[(TRACE|DEBUG|INFO[ ]|WARN[ ]|ERROR|CRITI)\]\[pid:(\d{8})\]\[tid:(\d{16})\]\[(\w+[-\w]*\.[cp]{1,3}):(\d{1,5})::([^\]]+)\]\[(.*?)\]\n$)",
+    std::regex::ECMAScript);
+
+struct Point {
+  int x;
+  int y;
+};
+
+template <> struct std::formatter<Point> : std::formatter<std::string_view> {
+  auto format(const Point &point, std::format_context &ctx) const {
+    return std::format_to(ctx.out(), "({}, {})", point.x, point.y);
+  }
+};
+
+void setup_logger() { micro_logger::initialize(TestWriter::get_instance()); }
+
+class TestFormatApi : public ::testing::Test {
+public:
+protected:
+  static void SetUpTestSuite() { setup_logger(); }
+  void SetUp() override { TestWriter::get_instance().line_buffer.clear(); }
+};
+
+TEST_F(TestFormatApi, header_and_message) {
+  const auto &line_buffer = TestWriter::get_instance().line_buffer;
+  std::string name{"task"};
+  int line_num = __LINE__;
+  micro_logger::info("{} took {}ms", name, 12);
+  micro_logger::critical("{:>5}|{:.2f}|{:#x}", "ab", 3.14159, 255);
+
+  ASSERT_EQ(line_buffer.size(), 2);
+  const std::vector<std::pair<std::string, std::string>> exp{
+      {"INFO ", "task took 12ms"},
+      {"CRITI", "   ab|3.14|0xff"},
+  };
+  for (size_t i = 0; i < exp.size(); ++i) {
+    std::smatch match;
+    ASSERT_TRUE(std::regex_search(line_buffer[i], match, regex_pattern))
+        << line_buffer[i];
+    EXPECT_EQ(match[3], exp[i].first);
+    EXPECT_EQ(std::stoi(match[4]), getpid());
+    EXPECT_EQ(std::stoul(match[5]), get_tid());
+    EXPECT_EQ(match[6], "test_format_api.cpp"s);
+    EXPECT_EQ(std::stoi(match[7]), ++line_num);
+    EXPECT_NE(match[8].str().find("TestBody"), std::string::npos);
+    EXPECT_EQ(match[9], exp[i].second);
+  }
+}
+
+TEST_F(TestFormatApi, user_formatter) {
+  const auto &line_buffer = TestWriter::get_instance().line_buffer;
+  micro_logger::warn("moved to {}", Point{3, -4});
+
+  ASSERT_EQ(line_buffer.size(), 1);
+  std::smatch match;
+  ASSERT_TRUE(std::regex_search(line_buffer[0], match, regex_pattern));
+  EXPECT_EQ(match[9], "moved to (3, -4)"s);
+}
+
+TEST_F(TestFormatApi, message_is_truncated) {
+  const auto &line_buffer = TestWriter::get_instance().line_buffer;
+  const auto message_size = micro_logger::default_parameters.message_size;
+  std::string long_message(message_size * 2, 'x');
+  micro_logger::error("{}", long_message);
+
+  ASSERT_EQ(line_buffer.size(), 1);
+  const auto &line = line_buffer[0];
+  // same limits as the printf path: message_size including the terminator
+  // and header_size + message_size for the whole line
+  EXPECT_LE(line.size(), micro_logger::default_parameters.header_size +
+                             message_size);
+  EXPECT_LE(std::count(line.begin(), line.end(), 'x'), message_size - 1);
+  EXPECT_TRUE(line.ends_with("x]\n"));
+}
@@ -0,0 +1,71 @@
+/*
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/.
+ */
+#include "common.h"
+#include "micro_logger/micro_logger.hpp"
+//
+#include <gtest/gtest.h>
+
+void setup_logger() { micro_logger::initialize(TestWriter::get_instance()); }
+
+class TestLevel : public ::testing::Test {
+public:
+protected:
+  static void SetUpTestSuite() { setup_logger(); }
+  void SetUp() override { TestWriter::get_instance().line_buffer.clear(); }
+  void TearDown() override {
+    micro_logger::set_level(micro_logger::Level::trace);
+  }
+};
+
+int evaluated(int &counter) { return ++counter; }
+
+TEST_F(TestLevel, threshold_filters_lower_levels) {
+  const auto &line_buffer = TestWriter::get_instance().line_buffer;
+  micro_logger::set_level(micro_logger::Level::warn);
+  EXPECT_EQ(micro_logger::get_level(), micro_logger::Level::warn);
+
+  MSG_ENTER();
+  MSG_DEBUG("debug");
+  MSG_INFO("info");
+  MSG_WARN("warning");
+  MSG_ERROR("error");
+  MSG_CRITICAL("critical");
+  MSG_EXIT();
+  micro_logger::info("{}", "info");
+  micro_logger::error("{}", "error");
+
+  ASSERT_EQ(line_buffer.size(), 4);
+  EXPECT_NE(line_buffer[0].find("[WARN ]"), std::string::npos);
+  EXPECT_NE(line_buffer[1].find("[ERROR]"), std::string::npos);
+  EXPECT_NE(line_buffer[2].find("[CRITI]"), std::string::npos);
+  EXPECT_NE(line_buffer[3].find("[ERROR]"), std::string::npos);
+}
+
+TEST_F(TestLevel, disabled_arguments_are_not_evaluated) {
+  const auto &line_buffer = TestWriter::get_instance().line_buffer;
+  int counter = 0;
+  micro_logger::set_level(micro_logger::Level::info);
+  MSG_DEBUG("%d", evaluated(counter));
+  EXPECT_EQ(counter, 0);
+  MSG_INFO("%d", evaluated(counter));
+  EXPECT_EQ(counter, 1);
+
+  micro_logger::set_level(micro_logger::Level::off);
+  MSG_CRITICAL("%d", evaluated(counter));
+  EXPECT_EQ(counter, 1);
+  EXPECT_EQ(line_buffer.size(), 1);
+}
+
+TEST_F(TestLevel, switch_on_at_runtime) {
+  const auto &line_buffer = TestWriter::get_instance().line_buffer;
+  micro_logger::set_level(micro_logger::Level::info);
+  MSG_DEBUG("hidden");
+  micro_logger::set_level(micro_logger::Level::debug);
+  MSG_DEBUG("visible");
+
+  ASSERT_EQ(line_buffer.size(), 1);
+  EXPECT_NE(line_buffer[0].find("[visible]"), std::string::npos);
+}
@@ -0,0 +1,127 @@
+/*
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/.
+ */
+#include "common.h"
+#include "micro_logger/micro_logger_writer.hpp"
+//
+#include <chrono>
+#include <filesystem>
+#include <format>
+#include <gtest/gtest.h>
+#include <set>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+class TestMmapFileWriter : public FileTest {};
+
+TEST_F(TestMmapFileWriter, lines_are_visible_before_close) {
+  micro_logger::MmapFileWriter writer(path.c_str(), {.segment_size = 4096});
+  std::string line{"first line\n"};
+  EXPECT_EQ(writer.write(line.data(), line.size()), line.size());
+  EXPECT_TRUE(writer.flush());
+  auto mapped = content(segments().at(0));
+  EXPECT_EQ(mapped.size(), 4096);
+  EXPECT_EQ(mapped.substr(0, line.size()), line);
+}
+
+TEST_F(TestMmapFileWriter, close_truncates_to_content) {
+  std::string line{"first line\n"};
+  {
+    micro_logger::MmapFileWriter writer(path.c_str(), {.segment_size = 4096});
+    writer.write(line.data(), line.size());
+  }
+  auto found = segments();
+  ASSERT_EQ(found.size(), 1);
+  EXPECT_EQ(found[0].filename(), "app.log.000000");
+  EXPECT_EQ(content(found[0]), line);
+}
+
+TEST_F(TestMmapFileWriter, full_segment_rolls_over) {
+  std::string line{"0123456789\n"};
+  {
+    micro_logger::MmapFileWriter writer(path.c_str(), {.segment_size = 32});
+    for (int i = 0; i < 5; ++i) {
+      EXPECT_EQ(writer.write(line.data(), line.size()), line.size());
+    }
+  }
+  auto found = segments();
+  ASSERT_EQ(found.size(), 3);
+  EXPECT_EQ(content(found[0]), line + line);
+  EXPECT_EQ(content(found[1]), line + line);
+  EXPECT_EQ(content(found[2]), line);
+}
+
+TEST_F(TestMmapFileWriter, flush_waits_for_full_segments) {
+  std::string line{"0123456789\n"};
+  micro_logger::MmapFileWriter writer(path.c_str(), {.segment_size = 16});
+  for (int i = 0; i < 2; ++i) {
+    writer.write(line.data(), line.size());
+  }
+  EXPECT_TRUE(writer.flush(std::chrono::seconds(10)));
+  auto found = segments();
+  // the active segment and the one mapped ahead of it follow
+  ASSERT_GE(found.size(), 2);
+  EXPECT_EQ(content(found[0]), line);
+  EXPECT_EQ(std::filesystem::file_size(found[1]), 16);
+}
+
+TEST_F(TestMmapFileWriter, existing_segments_are_kept) {
+  std::string line{"0123456789\n"};
+  for (int run = 0; run < 2; ++run) {
+    micro_logger::MmapFileWriter writer(path.c_str(), {.segment_size = 4096});
+    writer.write(line.data(), line.size());
+  }
+  auto found = segments();
+  ASSERT_EQ(found.size(), 2);
+  EXPECT_EQ(found[1].filename(), "app.log.000001");
+  EXPECT_EQ(content(found[0]), line);
+  EXPECT_EQ(content(found[1]), line);
+  // the oldest one archived away, a new run still goes after the newest
+  std::filesystem::remove(found[0]);
+  {
+    micro_logger::MmapFileWriter writer(path.c_str(), {.segment_size = 4096});
+    writer.write(line.data(), line.size());
+  }
+  found = segments();
+  ASSERT_EQ(found.size(), 2);
+  EXPECT_EQ(found[0].filename(), "app.log.000001");
+  EXPECT_EQ(found[1].filename(), "app.log.000002");
+}
+
+TEST_F(TestMmapFileWriter, oversized_line_is_dropped) {
+  micro_logger::MmapFileWriter writer(path.c_str(), {.segment_size = 8});
+  std::string line{"0123456789\n"};
+  EXPECT_EQ(writer.write(line.data(), line.size()), 0);
+}
+
+TEST_F(TestMmapFileWriter, concurrent_lines_stay_intact) {
+  constexpr int threads = 8;
+  constexpr int lines = 2000;
+  {
+    micro_logger::MmapFileWriter writer(path.c_str(), {.segment_size = 4096});
+    std::vector<std::jthread> workers;
+    for (int t = 0; t < threads; ++t) {
+      workers.emplace_back([&writer, t]() {
+        for (int i = 0; i < lines; ++i) {
+          auto line = std::format("thread {} line {:05}\n", t, i);
+          iovec fragments[2]{{line.data(), 7}, {line.data() + 7,
+                                                line.size() - 7}};
+          writer.writev(fragments, 2);
+        }
+      });
+    }
+  }
+  std::set<std::string> seen;
+  for (const auto &segment : segments()) {
+    std::istringstream in(content(segment));
+    for (std::string line; std::getline(in, line);) {
+      EXPECT_TRUE(line.starts_with("thread ")) << line;
+      seen.insert(line);
+    }
+  }
+  EXPECT_EQ(seen.size(), threads * lines);
+}
@@ -0,0 +1,334 @@
+/*
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/.
+ */
+#include "micro_logger/micro_logger_writer.hpp"
+//
+#include <arpa/inet.h>
+#include <atomic>
+#include <chrono>
+#include <format>
+#include <gtest/gtest.h>
+#include <mutex>
+#include <netinet/in.h>
+#include <string>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+using namespace std::chrono_literals;
+
+/** Accepts connections on 127.0.0.1 and keeps what it reads. */
+class Collector {
+public:
+  explicit Collector(int port = 0, bool reading = true) : reading(reading) {
+    listener = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    int reuse = 1;
+    setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+    sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(port);
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    bind(listener, reinterpret_cast<sockaddr *>(&address), sizeof(address));
+    socklen_t length = sizeof(address);
+    getsockname(listener, reinterpret_cast<sockaddr *>(&address), &length);
+    this->port = ntohs(address.sin_port);
+    listen(listener, 4);
+    thread = std::thread([this]() { serve(); });
+  }
+  ~Collector() {
+    shutdown(client, SHUT_RDWR);
+    shutdown(listener, SHUT_RDWR);
+    thread.join();
+    close(listener);
+  }
+  std::string received() const {
+    std::scoped_lock lock(sync);
+    return data;
+  }
+  int port;
+
+private:
+  void serve() {
+    while ((client = accept(listener, nullptr, nullptr)) >= 0) {
+      if (not reading) {
+        // hold the connection open without reading from it
+        while (accept(listener, nullptr, nullptr) >= 0) {
+        }
+        close(client);
+        return;
+      }
+      char chunk[4096];
+      ssize_t size;
+      while ((size = read(client, chunk, sizeof(chunk))) > 0) {
+        std::scoped_lock lock(sync);
+        data.append(chunk, size);
+      }
+      close(client);
+    }
+  }
+  const bool reading;
+  int listener;
+  /** Connection being read, shut down with the collector. */
+  std::atomic<int> client{-1};
+  std::thread thread;
+  mutable std::mutex sync;
+  std::string data;
+};
+
+/**
+ * A local agent on an AF_UNIX socket which keeps every message it reads,
+ * for a stream every read.
+ */
+class LocalAgent {
+public:
+  LocalAgent(const std::string &path, int type) : type(type) {
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    std::memcpy(address.sun_path, path.data(), path.size());
+    socklen_t length = offsetof(sockaddr_un, sun_path) + path.size();
+    if (path.starts_with('@')) {
+      address.sun_path[0] = '\0';
+    } else {
+      unlink(path.c_str());
+      this->path = path;
+      ++length;
+    }
+    listener = socket(AF_UNIX, type | SOCK_CLOEXEC, 0);
+    bind(listener, reinterpret_cast<sockaddr *>(&address), length);
+    if (type != SOCK_DGRAM) {
+      listen(listener, 4);
+    }
+    thread = std::thread([this]() { serve(); });
+  }
+  ~LocalAgent() {
+    shutdown(client, SHUT_RDWR);
+    shutdown(listener, SHUT_RDWR);
+    thread.join();
+    close(listener);
+    if (not path.empty()) {
+      unlink(path.c_str());
+    }
+  }
+  std::vector<std::string> received() const {
+    std::scoped_lock lock(sync);
+    return messages;
+  }
+  std::string joined() const {
+    std::string all;
+    for (const auto &message : received()) {
+      all += message;
+    }
+    return all;
+  }
+
+private:
+  void serve() {
+    if (type == SOCK_DGRAM) {
+      read_messages(listener);
+      return;
+    }
+    while ((client = accept(listener, nullptr, nullptr)) >= 0) {
+      read_messages(client);
+      close(client);
+    }
+  }
+  void read_messages(int from) {
+    char chunk[4096];
+    ssize_t size;
+    while ((size = recv(from, chunk, sizeof(chunk), 0)) > 0) {
+      std::scoped_lock lock(sync);
+      messages.emplace_back(chunk, size);
+    }
+  }
+  const int type;
+  std::string path;
+  int listener;
+  std::atomic<int> client{-1};
+  std::thread thread;
+  mutable std::mutex sync;
+  std::vector<std::string> messages;
+};
+
+/** Socket path in the temp directory, unique per test. */
+std::string local_path() {
+  return std::format("/tmp/test_network_writer_{}_{}.sock", getpid(),
+                     ::testing::UnitTest::GetInstance()
+                         ->current_test_info()
+                         ->name());
+}
+
+/** A port nothing listens on, for now. */
+int unused_port() {
+  Collector probe;
+  return probe.port;
+}
+
+/** Poll @p done for up to a few seconds. */
+template <typename F> bool eventually(F done) {
+  for (int i = 0; i < 500 and not done(); ++i) {
+    std::this_thread::sleep_for(10ms);
+  }
+  return done();
+}
+
+TEST(TestNetworkWriter, lines_arrive_in_order) {
+  Collector collector;
+  std::string expected;
+  {
+    micro_logger::NetworkWriter writer("127.0.0.1", collector.port);
+    for (int i = 0; i < 1000; ++i) {
+      auto line = std::format("line {}\n", i);
+      expected += line;
+      EXPECT_EQ(writer.write(line.data(), line.size()), line.size());
+    }
+    EXPECT_TRUE(writer.flush());
+    EXPECT_EQ(writer.dropped(), 0);
+  }
+  EXPECT_TRUE(eventually([&]() { return collector.received() == expected; }));
+}
+
+TEST(TestNetworkWriter, lines_wait_for_the_collector) {
+  const int port = unused_port();
+  micro_logger::NetworkWriter writer(
+      "127.0.0.1", port, {.min_backoff = 10ms, .max_backoff = 20ms});
+  std::string line{"queued line\n"};
+  EXPECT_EQ(writer.write(line.data(), line.size()), line.size());
+  EXPECT_FALSE(writer.flush(50ms));
+  Collector collector(port);
+  EXPECT_TRUE(writer.flush(5s));
+  EXPECT_TRUE(eventually([&]() { return collector.received() == line; }));
+}
+
+TEST(TestNetworkWriter, drop_policy_while_disconnected) {
+  micro_logger::NetworkWriter writer(
+      "127.0.0.1", unused_port(),
+      {.disconnected = micro_logger::DisconnectedPolicy::drop});
+  std::string line{"lost line\n"};
+  EXPECT_EQ(writer.write(line.data(), line.size()), 0);
+  EXPECT_EQ(writer.dropped(), 1);
+}
+
+TEST(TestNetworkWriter, full_buffer_drops_and_reports) {
+  const int port = unused_port();
+  micro_logger::NetworkWriter writer(
+      "127.0.0.1", port,
+      {.buffer_size = 64, .min_backoff = 10ms, .max_backoff = 20ms});
+  std::string line{"0123456789abcdef\n"};
+  for (int i = 0; i < 6; ++i) {
+    writer.write(line.data(), line.size());
+  }
+  EXPECT_EQ(writer.dropped(), 3);
+  Collector collector(port);
+  EXPECT_TRUE(writer.flush(5s));
+  EXPECT_TRUE(eventually([&]() {
+    return collector.received() ==
+           line + line + line + "[micro_logger] 3 messages dropped\n";
+  }));
+}
+
+TEST(TestNetworkWriter, stalled_collector_does_not_block) {
+  Collector collector(0, false);
+  const auto begin = std::chrono::steady_clock::now();
+  {
+    micro_logger::NetworkWriter writer(
+        "127.0.0.1", collector.port,
+        {.buffer_size = 1024 * 1024, .connect_timeout = 100ms});
+    std::string line(1023, 'x');
+    line += '\n';
+    // far more than the socket buffers and ours together, with pauses for
+    // the sender to fill the socket
+    for (int round = 0; round < 64; ++round) {
+      for (int i = 0; i < 1024; ++i) {
+        writer.write(line.data(), line.size());
+      }
+      std::this_thread::sleep_for(1ms);
+    }
+    EXPECT_GT(writer.dropped(), 0);
+    EXPECT_FALSE(writer.flush(10ms));
+  }
+  EXPECT_LT(std::chrono::steady_clock::now() - begin, 5s);
+}
+
+TEST(TestNetworkWriter, invalid_address_throws) {
+  EXPECT_THROW(micro_logger::NetworkWriter("not an address", 1),
+               std::domain_error);
+}
+
+TEST(TestNetworkWriter, unix_stream_lines_arrive) {
+  LocalAgent agent(local_path(), SOCK_STREAM);
+  std::string expected;
+  {
+    micro_logger::UnixSocketWriter writer(local_path());
+    for (int i = 0; i < 1000; ++i) {
+      auto line = std::format("line {}\n", i);
+      expected += line;
+      EXPECT_EQ(writer.write(line.data(), line.size()), line.size());
+    }
+    EXPECT_TRUE(writer.flush());
+  }
+  EXPECT_TRUE(eventually([&]() { return agent.joined() == expected; }));
+}
+
+TEST(TestNetworkWriter, unix_seqpacket_sends_a_message_per_line) {
+  LocalAgent agent(local_path(), SOCK_SEQPACKET);
+  {
+    micro_logger::UnixSocketWriter writer(
+        local_path(), micro_logger::UnixSocketType::seqpacket);
+    std::string first{"first\n"}, second{"second\n"};
+    iovec lines[2]{{first.data(), first.size()},
+                   {second.data(), second.size()}};
+    EXPECT_EQ(writer.write_batch(lines, 2), first.size() + second.size());
+    EXPECT_TRUE(writer.flush());
+  }
+  EXPECT_TRUE(eventually([&]() {
+    return agent.received() == std::vector<std::string>{"first\n", "second\n"};
+  }));
+}
+
+TEST(TestNetworkWriter, unix_datagram_sends_a_message_per_line) {
+  LocalAgent agent(local_path(), SOCK_DGRAM);
+  std::vector<std::string> expected;
+  {
+    micro_logger::UnixSocketWriter writer(
+        local_path(), micro_logger::UnixSocketType::datagram);
+    for (int i = 0; i < 200; ++i) {
+      expected.push_back(std::format("line {}\n", i));
+      writer.write(expected.back().data(), expected.back().size());
+    }
+    EXPECT_TRUE(writer.flush());
+  }
+  EXPECT_TRUE(eventually([&]() { return agent.received() == expected; }));
+}
+
+TEST(TestNetworkWriter, unix_datagram_waits_for_the_agent) {
+  micro_logger::UnixSocketWriter writer(
+      local_path(), micro_logger::UnixSocketType::datagram,
+      {.min_backoff = 10ms, .max_backoff = 20ms});
+  std::string line{"queued line\n"};
+  EXPECT_EQ(writer.write(line.data(), line.size()), line.size());
+  LocalAgent agent(local_path(), SOCK_DGRAM);
+  EXPECT_TRUE(writer.flush(5s));
+  EXPECT_TRUE(eventually(
+      [&]() { return agent.received() == std::vector<std::string>{line}; }));
+}
+
+TEST(TestNetworkWriter, unix_abstract_address) {
+  const auto name = std::format("@test_network_writer_{}", getpid());
+  LocalAgent agent(name, SOCK_STREAM);
+  std::string line{"abstract line\n"};
+  {
+    micro_logger::UnixSocketWriter writer(name);
+    writer.write(line.data(), line.size());
+    EXPECT_TRUE(writer.flush());
+  }
+  EXPECT_TRUE(eventually([&]() { return agent.joined() == line; }));
+}
+
+TEST(TestNetworkWriter, unix_path_too_long_throws) {
+  EXPECT_THROW(micro_logger::UnixSocketWriter(std::string(200, 'x')),
+               std::domain_error);
+}
@@ -0,0 +1,139 @@
+/*
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/.
+ */
+#include "common.h"
+#include "micro_logger/micro_logger_writer.hpp"
+//
+#include <atomic>
+#include <chrono>
+#include <format>
+#include <gtest/gtest.h>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+
+class TestPerThreadAsyncWriter : public ::testing::Test {
+public:
+};
+
+TEST_F(TestPerThreadAsyncWriter, single_producer_keeps_order) {
+  std::vector<std::string> lines;
+  std::unique_ptr<micro_logger::BaseWriter> output =
+      std::make_unique<CollectingWriter>(lines);
+  constexpr size_t data_set_size = 5000;
+  {
+    // a small queue makes the producer wrap and wait for the worker
+    micro_logger::PerThreadAsyncWriter writer(output, {.queue_capacity = 512});
+    for (size_t i = 0; i < data_set_size; ++i) {
+      auto line = std::to_string(i);
+      EXPECT_EQ(writer.write(line.data(), line.size()), line.size());
+    }
+  }
+  ASSERT_EQ(lines.size(), data_set_size);
+  for (size_t i = 0; i < data_set_size; ++i) {
+    EXPECT_EQ(lines[i], std::to_string(i));
+  }
+}
+
+TEST_F(TestPerThreadAsyncWriter, multiple_producers_lose_nothing) {
+  std::vector<std::string> lines;
+  std::unique_ptr<micro_logger::BaseWriter> output =
+      std::make_unique<CollectingWriter>(lines);
+  constexpr size_t threads_count = 8;
+  constexpr size_t data_set_size = 1000;
+  {
+    micro_logger::PerThreadAsyncWriter writer(output, {.queue_capacity = 1024});
+    std::vector<std::thread> threads;
+    for (size_t t = 0; t < threads_count; ++t) {
+      threads.emplace_back([&writer, t]() {
+        for (size_t i = 0; i < data_set_size; ++i) {
+          auto line = std::format("{}:{}", t, i);
+          writer.write(line.data(), line.size());
+        }
+      });
+    }
+    for (auto &thread : threads) {
+      thread.join();
+    }
+  }
+  ASSERT_EQ(lines.size(), threads_count * data_set_size);
+  // every thread's lines come out in its own order
+  std::map<size_t, size_t> next;
+  for (const auto &line : lines) {
+    auto colon = line.find(':');
+    auto thread = std::stoul(line.substr(0, colon));
+    EXPECT_EQ(std::stoul(line.substr(colon + 1)), next[thread]++);
+  }
+}
+
+TEST_F(TestPerThreadAsyncWriter, lines_are_merged_in_enqueue_order) {
+  std::vector<std::string> lines;
+  std::unique_ptr<micro_logger::BaseWriter> output =
+      std::make_unique<CollectingWriter>(lines);
+  constexpr size_t data_set_size = 1000;
+  {
+    micro_logger::PerThreadAsyncWriter writer(output);
+    // two threads take turns, each line is enqueued after the previous one
+    std::atomic<size_t> turn{0};
+    auto producer = [&](size_t parity) {
+      for (size_t i = parity; i < data_set_size; i += 2) {
+        while (turn.load() != i) {
+          std::this_thread::yield();
+        }
+        auto line = std::to_string(i);
+        writer.write(line.data(), line.size());
+        turn.store(i + 1);
+      }
+    };
+    std::thread even(producer, 0);
+    std::thread odd(producer, 1);
+    even.join();
+    odd.join();
+  }
+  ASSERT_EQ(lines.size(), data_set_size);
+  for (size_t i = 0; i < data_set_size; ++i) {
+    EXPECT_EQ(lines[i], std::to_string(i));
+  }
+}
+
+TEST_F(TestPerThreadAsyncWriter, flush_skips_merge_window) {
+  std::vector<std::string> lines;
+  std::unique_ptr<micro_logger::BaseWriter> output =
+      std::make_unique<CollectingWriter>(lines);
+  micro_logger::PerThreadAsyncWriter writer(
+      output, {.merge_window = std::chrono::seconds(10)});
+  std::thread([&writer]() {
+    std::string line{"from exited thread"};
+    writer.write(line.data(), line.size());
+  }).join();
+  std::string line{"from main thread"};
+  writer.write(line.data(), line.size());
+  // both lines are still inside the window
+  EXPECT_TRUE(lines.empty());
+  EXPECT_TRUE(writer.flush(std::chrono::seconds(10)));
+  ASSERT_EQ(lines.size(), 2);
+  EXPECT_EQ(lines[0], "from exited thread");
+  EXPECT_EQ(lines[1], "from main thread");
+}
+
+TEST_F(TestPerThreadAsyncWriter, zero_timeout_flush_reports_drained_queues) {
+  std::vector<std::string> lines;
+  std::unique_ptr<micro_logger::BaseWriter> output =
+      std::make_unique<CollectingWriter>(lines);
+  micro_logger::PerThreadAsyncWriter writer(
+      output, {.merge_window = std::chrono::seconds(10)});
+  EXPECT_TRUE(writer.flush(std::chrono::milliseconds::zero()));
+  std::string line{"queued"};
+  writer.write(line.data(), line.size());
+  // the request skips the window, the line is out soon after
+  bool drained = writer.flush(std::chrono::milliseconds::zero());
+  for (int i = 0; i < 500 and not drained; ++i) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    drained = writer.flush(std::chrono::milliseconds::zero());
+  }
+  EXPECT_TRUE(drained);
+  EXPECT_EQ(lines, std::vector<std::string>{line});
+}
@@ -0,0 +1,155 @@
+/*
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/.
+ */
+#include "common.h"
+#include "micro_logger/micro_logger_writer.hpp"
+//
+#include <chrono>
+#include <ctime>
+#include <filesystem>
+#include <fstream>
+#include <gtest/gtest.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+class TestRotatingFileWriter : public FileTest {};
+
+TEST_F(TestRotatingFileWriter, size_limit_rolls_over) {
+  std::string line{"0123456789\n"};
+  {
+    micro_logger::RotatingFileWriter writer(path.c_str(), {.max_size = 32});
+    for (int i = 0; i < 5; ++i) {
+      EXPECT_EQ(writer.write(line.data(), line.size()), line.size());
+    }
+  }
+  auto rotated = segments();
+  ASSERT_EQ(rotated.size(), 2);
+  EXPECT_EQ(content(rotated[0]), line + line);
+  EXPECT_EQ(content(rotated[1]), line + line);
+  EXPECT_EQ(content(path), line);
+}
+
+TEST_F(TestRotatingFileWriter, batch_is_not_split_across_files) {
+  std::string line{"0123456789\n"};
+  std::vector<iovec> lines(5, iovec{line.data(), line.size()});
+  {
+    micro_logger::RotatingFileWriter writer(path.c_str(), {.max_size = 32});
+    EXPECT_EQ(writer.write_batch(lines.data(), lines.size()),
+              line.size() * lines.size());
+  }
+  auto rotated = segments();
+  ASSERT_EQ(rotated.size(), 2);
+  EXPECT_EQ(content(rotated[0]), line + line);
+  EXPECT_EQ(content(path), line);
+}
+
+TEST_F(TestRotatingFileWriter, flush_writes_out_rolled_over_files) {
+  std::string line{"0123456789\n"};
+  micro_logger::RotatingFileWriter writer(path.c_str(), {.max_size = 16});
+  for (int i = 0; i < 2; ++i) {
+    writer.write(line.data(), line.size());
+  }
+  EXPECT_TRUE(writer.flush(std::chrono::seconds(10)));
+  // the file the next rollover switches to may already be open
+  auto rotated = segments();
+  std::erase_if(rotated, [](const auto &segment) {
+    return segment.extension() == ".next";
+  });
+  ASSERT_EQ(rotated.size(), 1);
+  EXPECT_EQ(content(rotated[0]), line);
+  EXPECT_EQ(content(path), line);
+}
+
+TEST_F(TestRotatingFileWriter, oldest_segments_are_deleted) {
+  std::string line{"0123456789\n"};
+  {
+    micro_logger::RotatingFileWriter writer(
+        path.c_str(), {.max_size = 16, .max_segments = 2});
+    for (int i = 0; i < 6; ++i) {
+      line[0] = '0' + i;
+      writer.write(line.data(), line.size());
+    }
+  }
+  auto rotated = segments();
+  ASSERT_EQ(rotated.size(), 2);
+  line[0] = '3';
+  EXPECT_EQ(content(rotated[0]), line);
+  line[0] = '4';
+  EXPECT_EQ(content(rotated[1]), line);
+  line[0] = '5';
+  EXPECT_EQ(content(path), line);
+}
+
+TEST_F(TestRotatingFileWriter, segments_are_compressed) {
+  std::string line{"0123456789\n"};
+  try {
+    micro_logger::RotatingFileWriter writer(
+        path.c_str(), {.max_size = 16, .compress = true});
+    for (int i = 0; i < 3; ++i) {
+      writer.write(line.data(), line.size());
+    }
+  } catch (const std::domain_error &) {
+    GTEST_SKIP() << "built without zlib";
+  }
+  auto rotated = segments();
+  ASSERT_EQ(rotated.size(), 2);
+  for (const auto &segment : rotated) {
+    EXPECT_EQ(segment.extension(), ".gz");
+    auto gzip = content(segment);
+    ASSERT_GE(gzip.size(), 2);
+    EXPECT_EQ(static_cast<unsigned char>(gzip[0]), 0x1f);
+    EXPECT_EQ(static_cast<unsigned char>(gzip[1]), 0x8b);
+  }
+  EXPECT_EQ(content(path), line);
+}
+
+TEST_F(TestRotatingFileWriter, interval_rolls_over) {
+  std::string line{"0123456789\n"};
+  // start right after a boundary, the first line is far from the next one
+  const auto second = std::time(nullptr);
+  while (std::time(nullptr) == second) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  {
+    micro_logger::RotatingFileWriter writer(
+        path.c_str(), {.max_size = 0, .interval = std::chrono::seconds(1)});
+    writer.write(line.data(), line.size());
+    std::this_thread::sleep_for(std::chrono::milliseconds(1100));
+    writer.write(line.data(), line.size());
+  }
+  auto rotated = segments();
+  ASSERT_EQ(rotated.size(), 1);
+  EXPECT_EQ(content(rotated[0]), line);
+  EXPECT_EQ(content(path), line);
+}
+
+TEST_F(TestRotatingFileWriter, empty_file_is_not_rolled_over) {
+  std::string line{"0123456789\n"};
+  {
+    micro_logger::RotatingFileWriter writer(
+        path.c_str(), {.max_size = 0, .interval = std::chrono::seconds(1)});
+    std::this_thread::sleep_for(std::chrono::milliseconds(1100));
+    writer.write(line.data(), line.size());
+  }
+  EXPECT_TRUE(segments().empty());
+  EXPECT_EQ(content(path), line);
+}
+
+TEST_F(TestRotatingFileWriter, appends_to_existing_file) {
+  std::string line{"0123456789\n"};
+  {
+    std::ofstream existing(path);
+    existing << line;
+  }
+  {
+    micro_logger::RotatingFileWriter writer(path.c_str(), {.max_size = 16});
+    writer.write(line.data(), line.size());
+  }
+  auto rotated = segments();
+  ASSERT_EQ(rotated.size(), 1);
+  EXPECT_EQ(content(rotated[0]), line);
+  EXPECT_EQ(content(path), line);
+}
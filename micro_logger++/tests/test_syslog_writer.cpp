@@ -0,0 +1,269 @@
+/*
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/.
+ */
+#include "micro_logger/micro_logger.hpp"
+//
+#include <arpa/inet.h>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <endian.h>
+#include <format>
+#include <gtest/gtest.h>
+#include <mutex>
+#include <netinet/in.h>
+#include <regex>
+#include <string>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+using namespace std::chrono_literals;
+
+/**
+ * Stands in for the syslog daemon or journald: keeps every datagram it
+ * reads, the content of a passed file descriptor in place of an empty one.
+ */
+class Daemon {
+public:
+  /** Bound to @p path, or to a UDP port on 127.0.0.1 when it is empty. */
+  explicit Daemon(const std::string &path = {}) : path(path) {
+    if (path.empty()) {
+      sock = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+      sockaddr_in address{};
+      address.sin_family = AF_INET;
+      address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+      bind(sock, reinterpret_cast<sockaddr *>(&address), sizeof(address));
+      socklen_t length = sizeof(address);
+      getsockname(sock, reinterpret_cast<sockaddr *>(&address), &length);
+      port = ntohs(address.sin_port);
+    } else {
+      unlink(path.c_str());
+      sock = socket(AF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+      sockaddr_un address{};
+      address.sun_family = AF_UNIX;
+      std::strcpy(address.sun_path, path.c_str());
+      bind(sock, reinterpret_cast<sockaddr *>(&address), sizeof(address));
+    }
+    thread = std::thread([this]() { serve(); });
+  }
+  ~Daemon() {
+    shutdown(sock, SHUT_RDWR);
+    thread.join();
+    close(sock);
+    if (not path.empty()) {
+      unlink(path.c_str());
+    }
+  }
+  std::vector<std::string> received() const {
+    std::scoped_lock lock(sync);
+    return messages;
+  }
+  /** Wait for @p count messages for up to a few seconds. */
+  std::vector<std::string> wait_for(size_t count) const {
+    for (int i = 0; i < 500 and received().size() < count; ++i) {
+      std::this_thread::sleep_for(10ms);
+    }
+    return received();
+  }
+  int port{0};
+  /** Messages which came as a file descriptor. */
+  std::atomic<int> passed_fds{0};
+
+private:
+  void serve() {
+    std::vector<char> chunk(64 * 1024);
+    while (true) {
+      iovec data{chunk.data(), chunk.size()};
+      alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int))]{};
+      msghdr message{};
+      message.msg_iov = &data;
+      message.msg_iovlen = 1;
+      message.msg_control = control;
+      message.msg_controllen = sizeof(control);
+      auto size = recvmsg(sock, &message, MSG_CMSG_CLOEXEC);
+      if (size < 0) {
+        return;
+      }
+      auto *rights = CMSG_FIRSTHDR(&message);
+      if (rights and rights->cmsg_type == SCM_RIGHTS) {
+        int fd;
+        std::memcpy(&fd, CMSG_DATA(rights), sizeof(fd));
+        std::string content;
+        ssize_t part;
+        while ((part = pread(fd, chunk.data(), chunk.size(), content.size())) >
+               0) {
+          content.append(chunk.data(), part);
+        }
+        close(fd);
+        std::scoped_lock lock(sync);
+        ++passed_fds;
+        messages.push_back(std::move(content));
+        continue;
+      }
+      if (size == 0) {
+        // shut down
+        return;
+      }
+      std::scoped_lock lock(sync);
+      messages.emplace_back(chunk.data(), size);
+    }
+  }
+  const std::string path;
+  int sock;
+  std::thread thread;
+  mutable std::mutex sync;
+  std::vector<std::string> messages;
+};
+
+/** Socket path in the temp directory, unique per test. */
+std::string daemon_path() {
+  return std::format("/tmp/test_syslog_writer_{}_{}.sock", getpid(),
+                     ::testing::UnitTest::GetInstance()
+                         ->current_test_info()
+                         ->name());
+}
+
+/** Journal entry for @p message as the native protocol encodes it. */
+std::string journal_entry(int priority, const std::string &message) {
+  std::string entry = std::format(
+      "PRIORITY={}\nSYSLOG_IDENTIFIER=app\nMESSAGE\n", priority);
+  const uint64_t length = htole64(message.size());
+  entry.append(reinterpret_cast<const char *>(&length), sizeof(length));
+  return entry + message + "\n";
+}
+
+TEST(TestSyslogWriter, rfc5424_message) {
+  Daemon daemon(daemon_path());
+  micro_logger::SyslogWriter writer(
+      {.path = daemon_path(), .facility = 16, .app_name = "app",
+       .hostname = "host"});
+  std::string line{"disk full\n"};
+  iovec fragment{line.data(), line.size()};
+  EXPECT_EQ(writer.write_record(micro_logger::Level::error, &fragment, 1),
+            line.size());
+  auto messages = daemon.wait_for(1);
+  ASSERT_EQ(messages.size(), 1);
+  // local0 * 8 + error
+  const std::regex expected(std::format(
+      R"(<131>1 \d{{4}}-\d\d-\d\dT\d\d:\d\d:\d\d\.\d{{6}}Z host app {} - - )"
+      "disk full",
+      getpid()));
+  EXPECT_TRUE(std::regex_match(messages[0], expected)) << messages[0];
+}
+
+TEST(TestSyslogWriter, levels_map_to_severity) {
+  Daemon daemon(daemon_path());
+  micro_logger::SyslogWriter writer({.path = daemon_path()});
+  using micro_logger::Level;
+  const std::pair<Level, int> levels[]{
+      {Level::trace, 15},    {Level::debug, 15}, {Level::info, 14},
+      {Level::warn, 12},     {Level::error, 11}, {Level::critical, 10},
+  };
+  std::string line{"line\n"};
+  iovec fragment{line.data(), line.size()};
+  for (const auto &[level, priority] : levels) {
+    writer.write_record(level, &fragment, 1);
+  }
+  writer.write(line.data(), line.size());
+  auto messages = daemon.wait_for(std::size(levels) + 1);
+  ASSERT_EQ(messages.size(), std::size(levels) + 1);
+  for (size_t i = 0; i < std::size(levels); ++i) {
+    EXPECT_TRUE(
+        messages[i].starts_with(std::format("<{}>1 ", levels[i].second)))
+        << messages[i];
+  }
+  EXPECT_TRUE(messages.back().starts_with("<14>1 ")) << messages.back();
+}
+
+TEST(TestSyslogWriter, one_datagram_per_line) {
+  Daemon daemon(daemon_path());
+  micro_logger::SyslogWriter writer({.path = daemon_path()});
+  for (int i = 0; i < 100; ++i) {
+    auto line = std::format("line {}\n", i);
+    iovec fragments[2]{{line.data(), 2}, {line.data() + 2, line.size() - 2}};
+    EXPECT_EQ(writer.writev(fragments, 2), line.size());
+  }
+  auto messages = daemon.wait_for(100);
+  ASSERT_EQ(messages.size(), 100);
+  for (int i = 0; i < 100; ++i) {
+    EXPECT_TRUE(messages[i].ends_with(std::format(" - - line {}", i)))
+        << messages[i];
+  }
+}
+
+TEST(TestSyslogWriter, udp_collector) {
+  Daemon daemon;
+  micro_logger::SyslogWriter writer({.port = daemon.port});
+  std::string line{"over udp\n"};
+  EXPECT_EQ(writer.write(line.data(), line.size()), line.size());
+  auto messages = daemon.wait_for(1);
+  ASSERT_EQ(messages.size(), 1);
+  EXPECT_TRUE(messages[0].ends_with(" - - over udp")) << messages[0];
+}
+
+TEST(TestSyslogWriter, missing_daemon_counts_drops) {
+  micro_logger::SyslogWriter writer({.path = daemon_path()});
+  std::string line{"lost\n"};
+  EXPECT_EQ(writer.write(line.data(), line.size()), 0);
+  EXPECT_EQ(writer.dropped(), 1);
+}
+
+TEST(TestSyslogWriter, invalid_address_throws) {
+  EXPECT_THROW(micro_logger::SyslogWriter({.address = "nowhere", .port = 514}),
+               std::domain_error);
+}
+
+TEST(TestSyslogWriter, logger_passes_the_level) {
+  static Daemon daemon(daemon_path());
+  static micro_logger::SyslogWriter writer({.path = daemon_path()});
+  micro_logger::initialize(writer);
+  micro_logger::warn("{}", "from the logger");
+  micro_logger::critical("{}", "from the logger");
+  auto messages = daemon.wait_for(2);
+  ASSERT_EQ(messages.size(), 2);
+  EXPECT_TRUE(messages[0].starts_with("<12>1 ")) << messages[0];
+  EXPECT_TRUE(messages[0].ends_with("[from the logger]")) << messages[0];
+  EXPECT_TRUE(messages[1].starts_with("<10>1 ")) << messages[1];
+}
+
+TEST(TestJournalWriter, native_protocol_entry) {
+  Daemon daemon(daemon_path());
+  micro_logger::JournalWriter writer(
+      {.path = daemon_path(), .identifier = "app"});
+  std::string line{"two\nlines\n"};
+  iovec fragment{line.data(), line.size()};
+  EXPECT_EQ(writer.write_record(micro_logger::Level::warn, &fragment, 1),
+            line.size());
+  writer.write(line.data(), line.size());
+  auto messages = daemon.wait_for(2);
+  ASSERT_EQ(messages.size(), 2);
+  EXPECT_EQ(messages[0], journal_entry(4, "two\nlines"));
+  EXPECT_EQ(messages[1], journal_entry(6, "two\nlines"));
+  EXPECT_EQ(daemon.passed_fds, 0);
+}
+
+TEST(TestJournalWriter, large_entry_goes_through_memfd) {
+  Daemon daemon(daemon_path());
+  micro_logger::JournalWriter writer(
+      {.path = daemon_path(), .identifier = "app"});
+  std::string line(1024 * 1024, 'x');
+  line += '\n';
+  EXPECT_EQ(writer.write(line.data(), line.size()), line.size());
+  auto messages = daemon.wait_for(1);
+  ASSERT_EQ(messages.size(), 1);
+  EXPECT_EQ(messages[0], journal_entry(6, line.substr(0, line.size() - 1)));
+  EXPECT_EQ(daemon.passed_fds, 1);
+  EXPECT_EQ(writer.dropped(), 0);
+}
+
+TEST(TestJournalWriter, missing_journal_counts_drops) {
+  micro_logger::JournalWriter writer({.path = daemon_path()});
+  std::string line{"lost\n"};
+  EXPECT_EQ(writer.write(line.data(), line.size()), 0);
+  EXPECT_EQ(writer.dropped(), 1);
+}
@@ -0,0 +1,68 @@
+/*
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/.
+ */
+#include "micro_logger/micro_logger.hpp"
+#include "timestamp.h"
+//
+#include <chrono>
+#include <gtest/gtest.h>
+#include <string>
+#include <vector>
+
+using namespace std::chrono_literals;
+
+class TestTimestamp : public ::testing::Test {
+public:
+};
+
+std::string render(decltype(&micro_logger::get_time) get_time,
+                   std::chrono::system_clock::time_point time_point,
+                   const micro_logger_CustomParameters &parameters) {
+  char output[128];
+  auto size = get_time(output, time_point, parameters);
+  return {output, size};
+}
+
+TEST_F(TestTimestamp, cached_matches_uncached) {
+  auto time_point = std::chrono::system_clock::now();
+  // walk over several second boundaries, including going back in time
+  const std::vector<std::chrono::milliseconds> steps{
+      0ms, 1ms, 998ms, 1ms, 1s, -3s, 7ms, 24h};
+  for (auto step : steps) {
+    time_point += step;
+    EXPECT_EQ(render(micro_logger::get_time, time_point,
+                     micro_logger::default_parameters),
+              render(micro_logger::get_time_uncached, time_point,
+                     micro_logger::default_parameters));
+  }
+}
+
+TEST_F(TestTimestamp, custom_formats) {
+  constexpr micro_logger_CustomParameters iso_parameters{
+      .header_size = 128,
+      .message_size = 1024,
+      .header_pattern = micro_logger::default_parameters.header_pattern,
+      .align_filename_length = "",
+      .align_lines_length = "03",
+      .time_format = "%FT%T",
+      .milliseconds_format = ",%ld ",
+  };
+  constexpr micro_logger_CustomParameters no_milliseconds_parameters{
+      .header_size = 128,
+      .message_size = 1024,
+      .header_pattern = micro_logger::default_parameters.header_pattern,
+      .align_filename_length = "",
+      .align_lines_length = "03",
+      .time_format = "[%T]",
+      .milliseconds_format = nullptr,
+  };
+  auto time_point = std::chrono::system_clock::now();
+  for (const auto *parameters :
+       {&iso_parameters, &no_milliseconds_parameters,
+        &micro_logger::default_parameters, &iso_parameters}) {
+    EXPECT_EQ(render(micro_logger::get_time, time_point, *parameters),
+              render(micro_logger::get_time_uncached, time_point, *parameters));
+  }
+}
@@ -0,0 +1,97 @@
+/*
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/.
+ */
+#include "common.h"
+#include "micro_logger/micro_logger_writer.hpp"
+//
+#include <format>
+#include <gtest/gtest.h>
+#include <string>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+
+class TestUringWriter : public FileTest {};
+
+TEST_F(TestUringWriter, flush_waits_for_the_file) {
+  micro_logger::UringWriter writer(path.c_str());
+  std::string line{"first line\n"};
+  EXPECT_EQ(writer.write(line.data(), line.size()), line.size());
+  EXPECT_TRUE(writer.flush());
+  EXPECT_EQ(content(), line);
+}
+
+TEST_F(TestUringWriter, lines_keep_their_order) {
+  std::string expected;
+  {
+    // small buffers, so callers keep running into the write in flight
+    micro_logger::UringWriter writer(path.c_str(), {.buffer_size = 64});
+    for (int i = 0; i < 5000; ++i) {
+      auto line = std::format("line {}\n", i);
+      expected += line;
+      iovec fragments[2]{{line.data(), 5}, {line.data() + 5, line.size() - 5}};
+      EXPECT_EQ(writer.writev(fragments, 2), line.size());
+    }
+  }
+  EXPECT_EQ(content(), expected);
+}
+
+TEST_F(TestUringWriter, oversized_line_stays_in_order) {
+  std::string small{"small\n"};
+  std::string large(100, 'x');
+  large += '\n';
+  {
+    micro_logger::UringWriter writer(path.c_str(), {.buffer_size = 32});
+    writer.write(small.data(), small.size());
+    EXPECT_EQ(writer.write(large.data(), large.size()), large.size());
+    writer.write(small.data(), small.size());
+  }
+  EXPECT_EQ(content(), small + large + small);
+}
+
+TEST_F(TestUringWriter, socket_receives_lines) {
+  int pair[2];
+  ASSERT_EQ(socketpair(AF_UNIX, SOCK_STREAM, 0, pair), 0);
+  std::string received;
+  std::thread reader([&]() {
+    char chunk[4096];
+    ssize_t size;
+    while ((size = read(pair[1], chunk, sizeof(chunk))) > 0) {
+      received.append(chunk, size);
+    }
+  });
+  std::string expected;
+  {
+    micro_logger::UringWriter writer(pair[0], {.buffer_size = 256});
+    for (int i = 0; i < 1000; ++i) {
+      auto line = std::format("line {}\n", i);
+      expected += line;
+      writer.write(line.data(), line.size());
+    }
+    EXPECT_TRUE(writer.flush());
+  }
+  close(pair[0]);
+  reader.join();
+  close(pair[1]);
+  EXPECT_EQ(received, expected);
+}
+
+TEST_F(TestUringWriter, async_writer_output) {
+  std::string expected;
+  {
+    std::unique_ptr<micro_logger::BaseWriter> output =
+        std::make_unique<micro_logger::UringWriter>(path.c_str());
+    micro_logger::AsyncWriter writer(
+        output, {.overflow = micro_logger::OverflowPolicy::block,
+                 .block_timeout = std::chrono::seconds(10)});
+    for (int i = 0; i < 5000; ++i) {
+      auto line = std::format("line {}\n", i);
+      expected += line;
+      writer.write(line.data(), line.size());
+    }
+    EXPECT_TRUE(writer.flush());
+    EXPECT_EQ(content(), expected);
+  }
+}
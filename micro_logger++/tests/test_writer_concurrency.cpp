@@ -0,0 +1,73 @@
+/*
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/.
+ */
+#include "micro_logger/micro_logger.hpp"
+//
+#include <atomic>
+#include <gtest/gtest.h>
+#include <thread>
+#include <vector>
+
+/** Not thread safe on purpose: records how many writes overlapped. */
+class OverlapWriter : public micro_logger::BaseWriter {
+public:
+  size_t write(const char * /*buf*/, size_t size) const final {
+    auto in_flight = ++active;
+    max_active = std::max(max_active.load(), in_flight);
+    std::this_thread::yield();
+    ++lines;
+    --active;
+    return size;
+  }
+  inline static OverlapWriter &get_instance() {
+    static OverlapWriter obj;
+    return obj;
+  }
+
+  mutable std::atomic<int> active{0};
+  mutable std::atomic<int> max_active{0};
+  mutable std::atomic<size_t> lines{0};
+};
+
+class TestWriterConcurrency : public ::testing::Test {
+public:
+protected:
+  static void SetUpTestSuite() {
+    micro_logger::initialize(OverlapWriter::get_instance());
+  }
+};
+
+TEST_F(TestWriterConcurrency, builtin_contracts) {
+  std::unique_ptr<micro_logger::BaseWriter> output =
+      std::make_unique<micro_logger::SilentWriter>();
+  EXPECT_TRUE(output->is_thread_safe());
+  micro_logger::AsyncWriter async(output);
+  EXPECT_TRUE(async.is_thread_safe());
+  EXPECT_FALSE(micro_logger::StandardOutWriter().is_thread_safe());
+  EXPECT_FALSE(OverlapWriter::get_instance().is_thread_safe());
+}
+
+TEST_F(TestWriterConcurrency, unsafe_writer_is_serialised) {
+  auto &writer = OverlapWriter::get_instance();
+  constexpr size_t threads_count = 8;
+  constexpr size_t data_set_size = 500;
+  std::vector<std::thread> threads;
+  for (size_t t = 0; t < threads_count; ++t) {
+    threads.emplace_back([]() {
+      for (size_t i = 0; i < data_set_size; ++i) {
+        if (i % 2) {
+          MSG_INFO("%zu", i);
+        } else {
+          micro_logger::info("{}", i);
+        }
+      }
+    });
+  }
+  for (auto &th : threads) {
+    th.join();
+  }
+  EXPECT_EQ(writer.lines, threads_count * data_set_size);
+  EXPECT_EQ(writer.max_active, 1);
+}
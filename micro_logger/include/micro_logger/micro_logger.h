@@ -7,6 +7,7 @@
 #define MICRO_LOGGER_MICRO_LOGGER_H
 
 #include "micro_logger/micro_logger_custom_parameters.h"
+#include "micro_logger/micro_logger_level.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -22,21 +23,65 @@ void *micro_logger_get_stdout_writer();
 
 void *micro_logger_get_net_writer(const char *address, int port);
 
+/* Socket types of micro_logger_get_unix_writer */
+#define MICRO_LOGGER_UNIX_STREAM 0
+#define MICRO_LOGGER_UNIX_SEQPACKET 1
+#define MICRO_LOGGER_UNIX_DATAGRAM 2
+/*
+ * @param path socket of a local agent, a leading '@' names an abstract one
+ * @param type one of MICRO_LOGGER_UNIX_STREAM, MICRO_LOGGER_UNIX_SEQPACKET,
+ * MICRO_LOGGER_UNIX_DATAGRAM
+ */
+void *micro_logger_get_unix_writer(const char *path, int type);
+
 void *micro_logger_get_file_writer(const char *path);
 /*
  * @param use one of @micro_logger_get_silent_writer
  * @micro_logger_get_stdout_writer @micro_logger_get_net_writer
- * @micro_logger_get_file_writer to get correct writer
+ * @micro_logger_get_unix_writer @micro_logger_get_file_writer to get correct
+ * writer
  * @param parameter if not provided set to NULL
  */
 void micro_logger_initialize(void *writer,
                              struct micro_logger_CustomParameters *parameter);
 
+/*
+ * Flush the writer passed to micro_logger_initialize, e.g. before fork/exec
+ * @return non zero once everything logged so far has been written
+ */
+int micro_logger_flush(void);
+
 void micro_logger_logme(const char *level, const char *file, const char *func,
                         int line, const char *fmt, ...);
 
 const char *micro_logger_basename(const char *const filename);
 
+/*
+ * @param level lowest level still logged, one of MICRO_LOGGER_LEVEL_*,
+ * MICRO_LOGGER_LEVEL_OFF disables logging
+ */
+void micro_logger_set_level(int level);
+
+int micro_logger_get_level(void);
+
+/*
+ * @return non zero when @p level passes the runtime threshold
+ */
+int micro_logger_is_enabled(int level);
+
+/*
+ * Inline version of micro_logger_is_enabled, one relaxed atomic load; the
+ * MSG_* macros check it before evaluating their arguments
+ */
+#ifdef __cplusplus
+#define MICRO_LOGGER_IS_ENABLED(level)                                         \
+  ((level) >= micro_logger_level_threshold.load(std::memory_order_relaxed))
+#else
+#define MICRO_LOGGER_IS_ENABLED(level)                                         \
+  ((level) >= atomic_load_explicit(&micro_logger_level_threshold,              \
+                                   memory_order_relaxed))
+#endif
+
 extern const char *MICRO_LOGGER_LVL_TRACE;
 extern const char *MICRO_LOGGER_LVL_DEBUG;
 extern const char *MICRO_LOGGER_LVL_INFO;
@@ -44,34 +89,74 @@ extern const char *MICRO_LOGGER_LVL_WARN;
 extern const char *MICRO_LOGGER_LVL_ERROR;
 extern const char *MICRO_LOGGER_LVL_CRITICAL;
 
-#ifndef NODEBUG
+#if MICRO_LOGGER_ACTIVE_LEVEL <= MICRO_LOGGER_LEVEL_DEBUG
 #define MSG_DEBUG(fmt, ...)                                                    \
-  micro_logger_logme(MICRO_LOGGER_LVL_DEBUG, micro_logger_basename(__FILE__), __FUNCTION__, \
-                     __LINE__, fmt, ##__VA_ARGS__)
+  (MICRO_LOGGER_IS_ENABLED(MICRO_LOGGER_LEVEL_DEBUG)                           \
+       ? micro_logger_logme(MICRO_LOGGER_LVL_DEBUG,                            \
+                            micro_logger_basename(__FILE__), __FUNCTION__,     \
+                            __LINE__, fmt, ##__VA_ARGS__)                      \
+       : (void)0)
+#else
+#define MSG_DEBUG(fmt, ...) ((void)0)
+#endif
+#if MICRO_LOGGER_ACTIVE_LEVEL <= MICRO_LOGGER_LEVEL_TRACE
 #define MSG_ENTER()                                                            \
-  micro_logger_logme(MICRO_LOGGER_LVL_TRACE, micro_logger_basename(__FILE__), __FUNCTION__, \
-                     __LINE__, "%s", "--ENTER--")
+  (MICRO_LOGGER_IS_ENABLED(MICRO_LOGGER_LEVEL_TRACE)                           \
+       ? micro_logger_logme(MICRO_LOGGER_LVL_TRACE,                            \
+                            micro_logger_basename(__FILE__), __FUNCTION__,     \
+                            __LINE__, "%s", "--ENTER--")                       \
+       : (void)0)
 #define MSG_EXIT()                                                             \
-  micro_logger_logme(MICRO_LOGGER_LVL_TRACE, micro_logger_basename(__FILE__), __FUNCTION__, \
-                     __LINE__, "%s", "--EXIT--")
+  (MICRO_LOGGER_IS_ENABLED(MICRO_LOGGER_LEVEL_TRACE)                           \
+       ? micro_logger_logme(MICRO_LOGGER_LVL_TRACE,                            \
+                            micro_logger_basename(__FILE__), __FUNCTION__,     \
+                            __LINE__, "%s", "--EXIT--")                        \
+       : (void)0)
 #else
-#define MSG_DEBUG(fmt, ...)
-#define MSG_ENTER()
-#define MSG_EXIT()
+#define MSG_ENTER() ((void)0)
+#define MSG_EXIT() ((void)0)
 #endif
 
+#if MICRO_LOGGER_ACTIVE_LEVEL <= MICRO_LOGGER_LEVEL_INFO
 #define MSG_INFO(fmt, ...)                                                     \
-  micro_logger_logme(MICRO_LOGGER_LVL_INFO, micro_logger_basename(__FILE__), __FUNCTION__,  \
-                     __LINE__, fmt, ##__VA_ARGS__)
+  (MICRO_LOGGER_IS_ENABLED(MICRO_LOGGER_LEVEL_INFO)                            \
+       ? micro_logger_logme(MICRO_LOGGER_LVL_INFO,                             \
+                            micro_logger_basename(__FILE__), __FUNCTION__,     \
+                            __LINE__, fmt, ##__VA_ARGS__)                      \
+       : (void)0)
+#else
+#define MSG_INFO(fmt, ...) ((void)0)
+#endif
+#if MICRO_LOGGER_ACTIVE_LEVEL <= MICRO_LOGGER_LEVEL_WARN
 #define MSG_WARN(fmt, ...)                                                     \
-  micro_logger_logme(MICRO_LOGGER_LVL_WARN, micro_logger_basename(__FILE__), __FUNCTION__,  \
-                     __LINE__, fmt, ##__VA_ARGS__)
+  (MICRO_LOGGER_IS_ENABLED(MICRO_LOGGER_LEVEL_WARN)                            \
+       ? micro_logger_logme(MICRO_LOGGER_LVL_WARN,                             \
+                            micro_logger_basename(__FILE__), __FUNCTION__,     \
+                            __LINE__, fmt, ##__VA_ARGS__)                      \
+       : (void)0)
+#else
+#define MSG_WARN(fmt, ...) ((void)0)
+#endif
+#if MICRO_LOGGER_ACTIVE_LEVEL <= MICRO_LOGGER_LEVEL_ERROR
 #define MSG_ERROR(fmt, ...)                                                    \
-  micro_logger_logme(MICRO_LOGGER_LVL_ERROR, micro_logger_basename(__FILE__), __FUNCTION__, \
-                     __LINE__, fmt, ##__VA_ARGS__)
+  (MICRO_LOGGER_IS_ENABLED(MICRO_LOGGER_LEVEL_ERROR)                           \
+       ? micro_logger_logme(MICRO_LOGGER_LVL_ERROR,                            \
+                            micro_logger_basename(__FILE__), __FUNCTION__,     \
+                            __LINE__, fmt, ##__VA_ARGS__)                      \
+       : (void)0)
+#else
+#define MSG_ERROR(fmt, ...) ((void)0)
+#endif
+#if MICRO_LOGGER_ACTIVE_LEVEL <= MICRO_LOGGER_LEVEL_CRITICAL
 #define MSG_CRITICAL(fmt, ...)                                                 \
-  micro_logger_logme(MICRO_LOGGER_LVL_CRITICAL, micro_logger_basename(__FILE__),            \
-                     __FUNCTION__, __LINE__, fmt, ##__VA_ARGS__)
+  (MICRO_LOGGER_IS_ENABLED(MICRO_LOGGER_LEVEL_CRITICAL)                        \
+       ? micro_logger_logme(MICRO_LOGGER_LVL_CRITICAL,                         \
+                            micro_logger_basename(__FILE__), __FUNCTION__,     \
+                            __LINE__, fmt, ##__VA_ARGS__)                      \
+       : (void)0)
+#else
+#define MSG_CRITICAL(fmt, ...) ((void)0)
+#endif
 
 #ifdef __cplusplus
 }
@@ -19,6 +19,20 @@ const char *micro_logger_basename(const char *const file) {
   return micro_logger::basename(file);
 }
 
+int micro_logger_flush() { return micro_logger::flush(); }
+
+void micro_logger_set_level(int level) {
+  micro_logger::set_level(static_cast<micro_logger::Level>(level));
+}
+
+int micro_logger_get_level() {
+  return static_cast<int>(micro_logger::get_level());
+}
+
+int micro_logger_is_enabled(int level) {
+  return micro_logger::is_enabled(static_cast<micro_logger::Level>(level));
+}
+
 void *micro_logger_get_silent_writer() {
   static micro_logger::SilentWriter instance;
   return &instance;
@@ -34,6 +48,12 @@ void *micro_logger_get_net_writer(const char *address, int port) {
   return &instance;
 }
 
+void *micro_logger_get_unix_writer(const char *path, int type) {
+  static micro_logger::UnixSocketWriter instance(
+      path, static_cast<micro_logger::UnixSocketType>(type));
+  return &instance;
+}
+
 void *micro_logger_get_file_writer(const char *path) {
   static micro_logger::FileWriter instance(path);
   return &instance;
@@ -21,6 +21,7 @@ from .custom_popen import (
 )
 from .network_server import (
     ThreadedTCPServer,
+    ThreadedUnixStreamServer,
     NetworkServerRequestHandler,
 )
 from .file_handler import (
@@ -35,6 +36,7 @@ __all__ = [
     "NetworkServerRequestHandler",
     "PathToObjects",
     "ThreadedTCPServer",
+    "ThreadedUnixStreamServer",
     "create_temp_file",
     "custom_popen",
     "custom_popen_wrapper",
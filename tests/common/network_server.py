@@ -5,8 +5,8 @@
 """
 Network server utilities for testing.
 
-This module provides TCP server implementations for receiving and handling
-log messages over the network during testing.
+This module provides TCP and Unix domain server implementations for
+receiving and handling log messages over the network during testing.
 """
 
 import threading
@@ -86,3 +86,10 @@ class ThreadedTCPServer(socketserver.ThreadingMixIn, socketserver.TCPServer):
     allow_reuse_address = True
     pass
 
+
+class ThreadedUnixStreamServer(
+    socketserver.ThreadingMixIn, socketserver.UnixStreamServer
+):
+    """Unix domain stream server standing in for a local log-shipping agent."""
+
+    pass
@@ -13,12 +13,26 @@ testing functionality through Python's ctypes bindings.
 
 import ctypes
 from ctypes import string_at, c_char_p, c_int, c_void_p
+import multiprocessing
+import os
+import tempfile
+import threading
 import unittest
-from common import PathToObjects, get_linenumber, get_function_name
+from common import (
+    NetworkServerRequestHandler,
+    PathToObjects,
+    ThreadedUnixStreamServer,
+    get_function_name,
+    get_linenumber,
+    regex_line_pattern,
+)
 
 paths = PathToObjects()
 c_lib = ctypes.CDLL(paths.logger_library_location)
 
+# micro_logger.h
+MICRO_LOGGER_UNIX_STREAM = 0
+
 
 class LibStdOutTesting(unittest.TestCase):
     """
@@ -62,5 +76,77 @@ class LibStdOutTesting(unittest.TestCase):
         )
 
 
+def log_to_agent(path, function, line):
+    """
+    Log one line to the agent at @p path from a child process.
+
+    The library takes the first writer it is initialized with, so the
+    Unix socket writer gets a process of its own.
+    """
+    lib = ctypes.CDLL(paths.logger_library_location)
+    lib.micro_logger_get_unix_writer.restype = c_void_p
+    lib.micro_logger_get_unix_writer.argtypes = [c_char_p, c_int]
+    writer = lib.micro_logger_get_unix_writer(
+        path.encode("utf-8"), MICRO_LOGGER_UNIX_STREAM
+    )
+    lib.micro_logger_initialize.argtypes = [c_void_p, c_void_p]
+    lib.micro_logger_initialize(writer, None)
+    lib.micro_logger_logme(
+        string_at(c_char_p.in_dll(lib, "MICRO_LOGGER_LVL_INFO")),
+        c_char_p(b"library.c"),
+        c_char_p(function.encode("utf-8")),
+        c_int(line),
+        c_char_p(b"agent is %s"),
+        c_char_p(b"listening"),
+    )
+    if not lib.micro_logger_flush():
+        raise RuntimeError("flush failed")
+
+
+class LibUnixSocketTesting(unittest.TestCase):
+    """
+    Test the C library logging to a local agent over a Unix domain socket.
+
+    A threaded Unix stream server stands in for the agent; the writer is
+    created through micro_logger_get_unix_writer.
+    """
+
+    def setUp(self):
+        """Start the agent on a socket in a temporary directory."""
+        self.directory = tempfile.TemporaryDirectory()
+        self.path = os.path.join(self.directory.name, "agent.sock")
+        self.server = ThreadedUnixStreamServer(
+            self.path, NetworkServerRequestHandler
+        )
+        self.server_thread = threading.Thread(target=self.server.serve_forever)
+        self.server_thread.daemon = True
+        self.server_thread.start()
+
+    def tearDown(self):
+        """Stop the agent."""
+        self.server.shutdown()
+        self.server.server_close()
+        self.directory.cleanup()
+
+    def test_msg_reaches_agent(self):
+        """
+        Test a line logged through the C library arrives at the agent.
+
+        micro_logger_flush returns once the writer handed the line over.
+        """
+        child = multiprocessing.get_context("spawn").Process(
+            target=log_to_agent,
+            args=(self.path, get_function_name(), get_linenumber()),
+        )
+        child.start()
+        child.join(timeout=10)
+        self.assertEqual(child.exitcode, 0)
+        out = NetworkServerRequestHandler.get_output(regex_line_pattern)
+        self.assertEqual(len(out), 1)
+        self.assertEqual(out[0].level, "INFO ")
+        self.assertEqual(out[0].function, "test_msg_reaches_agent")
+        self.assertEqual(out[0].message, "agent is listening")
+
+
 if __name__ == "__main__":
     unittest.main()